@@ -13,6 +13,12 @@
                                      INCLUDES
 --------------------------------------------------------------------------------*/
 
+#include <stdint.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#endif
+
 #include "hmap_intf.h"
 
 
@@ -21,6 +27,116 @@
 --------------------------------------------------------------------------------*/
 
 #define HMAP_INVALID_POINTER    ( (void *)0 )
+#define HMAP_INVALID_REF        ( 0 )
+#define HMAP_INVALID_LINK       ( 0 )
+#define HMAP_INLINE_SIZE        ( 8 )           /* sizeof ref      */
+
+#define HMAP_REGION_MAGIC       ( 0x484D4150 )  /* "HMAP"          */
+#define HMAP_REGION_ALIGN       ( 16 )
+#define HMAP_REGION_CLASS_MIN   ( 4 )           /* 16 byte blocks  */
+#define HMAP_REGION_CLASS_COUNT ( 28 )
+
+#define HMAP_LOCK_WRITER        ( 0x80000000u )
+#define HMAP_LOCK_PENDING       ( 0x40000000u ) /* writer waiting  */
+#define HMAP_LOCK_SPIN_MAX      ( 1024 )        /* pauses per retry*/
+
+#define HMAP_LOG_MAGIC          ( 0x474C4D48 )  /* "HMLG"          */
+#define HMAP_LOG_VERSION        ( 1 )
+#define HMAP_LOG_BUFFER_SIZE    ( 64 * 1024 )
+#define HMAP_LOG_GROUP_SIZE     ( 64 )
+#define HMAP_LOG_HEADER_SIZE    ( 7 + HMAP_CHECKSUM_SIZE )
+#define HMAP_LOG_PREFIX_MAX     ( 5 + 2 * HMAP_VARINT_MAX )
+#define HMAP_LOG_RECORD_MAX     ( 0x80000000u )
+#define HMAP_LOG_RECORD_SET     ( 1 )
+#define HMAP_LOG_RECORD_REMOVE  ( 2 )
+#define HMAP_LOG_RECORD_HEADER  ( 3 )
+
+#define HMAP_SNAPSHOT_MAGIC     ( 0x4E534D48 )  /* "HMSN"          */
+#define HMAP_SNAPSHOT_VERSION   ( 1 )
+#define HMAP_SNAPSHOT_BLOCK_SIZE ( 64 * 1024 )
+#define HMAP_SNAPSHOT_WAVE      ( 16 )          /* blocks per job  */
+#define HMAP_SNAPSHOT_HEADER_SIZE ( 8 )
+#define HMAP_SNAPSHOT_INDEX_SIZE ( 24 )
+#define HMAP_SNAPSHOT_TRAILER_SIZE ( 24 )
+#define HMAP_SNAPSHOT_PREFIX_MAX ( 4 + 2 * HMAP_VARINT_MAX )
+
+#define HMAP_LZ_HASH_BITS       ( 12 )
+#define HMAP_LZ_MIN_MATCH       ( 4 )
+#define HMAP_LZ_END_LITERALS    ( 5 )
+#define HMAP_LZ_MAX_OFFSET      ( 0xFFFF )
+
+#define HMAP_PREFIX_MIN         ( 16 )          /* shortest shared */
+#define HMAP_PREFIX_TABLE_MIN   ( 64 )
+#define HMAP_KEY_SEPARATOR      ( '/' )
+
+#define HMAP_VALUES_HEADER_SIZE ( 8 )           /* count, length   */
+
+#define HMAP_INTERN_ARENA_SIZE  ( 64 * 1024 )
+#define HMAP_INTERN_SLOTS_MIN   ( 16 )
+
+#define HMAP_ORDER_MIN          ( 16 )
+
+#define HMAP_DENSE_MIN          ( 8 )
+
+#define HMAP_SLAB_MIN           ( 64 )          /* records in first*/
+#define HMAP_SLAB_COUNT         ( 26 )          /* 32-bit links    */
+
+#define HMAP_FRONT_INTERVAL     ( 8 )           /* deep hits a move*/
+
+#define HMAP_SORTED_MAX         ( 32 )          /* longest chain   */
+#define HMAP_SORTED_MIN         ( 16 )          /* smallest index  */
+
+#define HMAP_CUCKOO_WAYS        ( 4 )           /* slots per bucket*/
+#define HMAP_CUCKOO_SEARCH      ( 256 )         /* buckets searched*/
+#define HMAP_CUCKOO_TAG_MIX     ( 0x5BD1E995u )
+#define HMAP_CUCKOO_RESIZES     ( 4 )           /* per insert      */
+
+#define HMAP_HOPSCOTCH_RANGE    ( 32 )          /* neighborhood    */
+#define HMAP_HOPSCOTCH_PROBE    ( 256 )         /* empty slot reach*/
+#define HMAP_HOPSCOTCH_MIX      ( 0x85EBCA6Bu )
+#define HMAP_HOPSCOTCH_RESIZES  ( 4 )           /* per insert      */
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define HMAP_X86                                /* SIMD kernels    */
+#define HMAP_TARGET_SSE2        __attribute__(( target( "sse2" ) ))
+#define HMAP_TARGET_SSE42       __attribute__(( target( "sse4.2" ) ))
+#define HMAP_TARGET_AVX2        __attribute__(( target( "avx2" ) ))
+#define HMAP_TARGET_AVX512      __attribute__(( target( "avx512f" ) ))
+#define HMAP_CPU_PAUSE()        _mm_pause()
+#elif defined( __aarch64__ )
+#define HMAP_CPU_PAUSE()        __asm__ __volatile__( "yield" )
+#else
+#define HMAP_CPU_PAUSE()        __asm__ __volatile__( "" ::: "memory" )
+#endif
+
+#define HMAP_CPU_SSE2           ( 0x01 )
+#define HMAP_CPU_SSE42          ( 0x02 )
+#define HMAP_CPU_AVX2           ( 0x04 )
+#define HMAP_CPU_AVX512         ( 0x08 )
+
+#define HMAP_SDBM_POWERS        ( 17 )          /* 65599^16..^0    */
+#define HMAP_BATCH_SIZE         ( 16 )          /* keys per group  */
+#define HMAP_STREAM_WAYS        ( 16 )          /* lookups in      */
+                                                /* flight          */
+
+#define HMAP_LOOKUP_IDLE        ( 0 )
+#define HMAP_LOOKUP_BUCKET      ( 1 )           /* read bucket     */
+#define HMAP_LOOKUP_ENTRY       ( 2 )           /* compare entry   */
+#define HMAP_LOOKUP_SEARCH      ( 3 )           /* engine search   */
+
+#define HMAP_ENTRY_REFERENCED   ( 0x01 )        /* read since hand */
+#define HMAP_ENTRY_SPILLED      ( 0x02 )        /* data in a file  */
+#define HMAP_ENTRY_SPILL_FILE   ( 0x04 )        /* which file      */
+
+#define HMAP_SEGMENT_MIN        ( 4 * 1024 )
+#define HMAP_SEGMENT_ALIGN      ( 8 )
+#define HMAP_SEGMENT_NONE       ( 0xFFFFFFFFu ) /* own allocation  */
+#define HMAP_SEGMENT_SPARSE     ( 2 )           /* used per live   */
+#define HMAP_SEGMENT_LIST_MIN   ( 16 )
+
+#define HMAP_VARINT_MAX         ( 5 )
+#define HMAP_CHECKSUM_SEED      ( 2166136261u )
+#define HMAP_CHECKSUM_SIZE      ( 4 )
 
 
 /*--------------------------------------------------------------------------------
@@ -28,34 +144,513 @@
 --------------------------------------------------------------------------------*/
 
 /*-------------------------------------------------------------
-Map entry type. Typedef prior to struct definition in order to
-reference own type (next and previous)
+References to map memory. A reference is the address of the
+memory relative to the map's base address. Heap maps have a
+base of zero, so a reference is simply the address. Maps in a
+shared region use the region as the base, so references stay
+valid in every process that maps the region.
+-------------------------------------------------------------*/
+typedef unsigned long long hmap_ref_type;
+
+/*-------------------------------------------------------------
+Links between the entries of chained maps. Their entries are
+records in the map's entry slabs, each slab twice the size of
+the one before, and a link is the record's number plus one.
+-------------------------------------------------------------*/
+typedef unsigned int hmap_link_type;
+
+/*-------------------------------------------------------------
+Block of bytes owned by the map. Blocks of up to
+HMAP_INLINE_SIZE bytes are stored in place of the reference,
+so small keys and data need no allocation of their own.
 -------------------------------------------------------------*/
-typedef struct hmap_entry_struct hmap_entry_type;
-struct hmap_entry_struct
+typedef union
     {
-    HMAP_anon_type      data;       /* pointer to entry data */
-    HMAP_anon_type      key;        /* pointer to key data   */
+    hmap_ref_type       ref;        /* reference to bytes    */
+    unsigned char       bytes[ HMAP_INLINE_SIZE ];
+                                    /* bytes stored inline   */
+    } hmap_blob_storage_type;
+
+typedef struct
+    {
+    hmap_blob_storage_type
+                        storage;    /* bytes or reference    */
+    unsigned int        size;       /* num bytes             */
+    } hmap_blob_type;
+
+/*-------------------------------------------------------------
+Map entry type. The data of a spilled entry is in a spill file
+and its data reference is the offset in the file. Only chained
+maps link their entries, and only forward, as an entry is
+unlinked through the link found while searching for it. A
+freed slab record's next link is the next freed record.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    hmap_blob_type      data;       /* entry data            */
+    hmap_blob_type      key;        /* key data              */
+    hmap_link_type      next;       /* next entry in bucket  */
     HMAP_hash_val_type  key_hash;   /* key's hashed value    */
-    hmap_entry_type   * next;       /* next entry in bucket  */
-    hmap_entry_type   * previous;   /* prev entry in bucket  */
     unsigned int        size;       /* size of entry in bytes*/
-    };
+    unsigned int        epoch;      /* last save it is in    */
+    unsigned char       flags;      /* HMAP_ENTRY_* flags    */
+    } hmap_entry_type;
 
 /*-------------------------------------------------------------
-The hash map's private data.
+Entry of an ordered map, which also knows its place in the
+map's insertion order array. Removed entries leave an invalid
+reference in the array until it is compacted.
 -------------------------------------------------------------*/
-typedef struct hmap_map_struct
+typedef struct
+    {
+    hmap_entry_type     entry;      /* the map entry         */
+    unsigned int        order;      /* index in order array  */
+    } hmap_ordered_entry_type;
+
+/*-------------------------------------------------------------
+The position independent state of the map's table. Kept in the
+shared region for shared maps. Dense maps keep their entries
+in the entries array and use buckets as the index table, with
+index_size bytes per slot. Cuckoo and hopscotch maps use
+buckets as an array of cuckoo buckets or hopscotch slots.
+Chained maps use buckets as an array of links and take their
+entries from the slabs. Buckets of chained maps that grow past
+HMAP_SORTED_MAX entries are sorted, and sorted is then an array
+with a reference to the index of each sorted bucket.
+Move-to-front chained maps count their hits and how deep in
+their buckets they were found.
+-------------------------------------------------------------*/
+typedef struct
     {
-    hmap_entry_type  ** buckets;    /* array of map buckets  */
+    hmap_ref_type       buckets;    /* array of map buckets  */
     unsigned int        buckets_len;/* num buckets in map    */
+    HMAP_engine_t8      engine;     /* table layout          */
+    unsigned char       index_size; /* bytes per dense index */
+    hmap_ref_type       entries;    /* dense entry array     */
+    unsigned int        entries_len;/* num records used      */
+    unsigned int        entries_capacity;
+                                    /* num records           */
     unsigned int        data_size;  /* total size of all data*/
     unsigned int        entry_count;/* num entries in map    */
     unsigned int        key_size;   /* total size of all keys*/
     unsigned int        size;       /* total size of map     */
+    HMAP_hash_func_t8   hash_type;  /* hash algorithm in use */
+    HMAP_key_mode_t8    key_mode;   /* how keys are stored   */
+    unsigned char       key_separator;
+                                    /* end of key prefixes   */
+    hmap_ref_type       prefixes;   /* buckets of prefixes   */
+    unsigned int        prefixes_len;
+                                    /* num prefix buckets    */
+    unsigned int        prefix_count;
+                                    /* num shared prefixes   */
+    HMAP_bool_t8        multimap;   /* data is a value list  */
+    HMAP_bool_t8        ordered;    /* keep insertion order  */
+    hmap_ref_type       order;      /* entries in order      */
+    unsigned int        order_len;  /* num used order slots  */
+    unsigned int        order_capacity;
+                                    /* num order slots       */
+    unsigned int        save_epoch; /* num saves started     */
+    hmap_ref_type       slabs[ HMAP_SLAB_COUNT ];
+                                    /* chained entry records */
+    unsigned int        slab_len;   /* num records handed out*/
+    hmap_link_type      slab_free;  /* first freed record    */
+    hmap_ref_type       sorted;     /* sorted bucket indexes */
+    HMAP_bool_t8        move_to_front;
+                                    /* move hits to the head */
+    unsigned int        deep_hits;  /* hits past bucket head */
+    unsigned long long  hits;       /* num lookup hits       */
+    unsigned long long  hit_depth;  /* links followed to hits*/
+    } hmap_table_type;
+
+/*-------------------------------------------------------------
+Index of a sorted chained map bucket. Its slots follow it, one
+per entry of the bucket. The bucket's entries are linked in the
+order of their key hashes, then of their keys unless the map
+has a custom key equality, and the slots are in the same order,
+so a key is found by binary search and the link to an entry is
+the next link of the entry in the slot before. The bucket goes
+back to an unsorted chain below HMAP_SORTED_MIN entries.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    unsigned int        count;      /* num slots used        */
+    unsigned int        capacity;   /* num slots             */
+    } hmap_sorted_type;
+
+typedef struct
+    {
+    HMAP_hash_val_type  key_hash;   /* key's hashed value    */
+    hmap_link_type      link;       /* link to the entry     */
+    } hmap_sorted_slot_type;
+
+/*-------------------------------------------------------------
+Bucket of a cuckoo map. Each used slot holds an entry and a tag
+taken from the entry's hash, so most slots can be ruled out
+without reading the entry. A zero tag marks an empty slot.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    unsigned char       tags[ HMAP_CUCKOO_WAYS ];
+                                    /* tags of the entries   */
+    hmap_ref_type       entries[ HMAP_CUCKOO_WAYS ];
+                                    /* entries in bucket     */
+    } hmap_cuckoo_bucket_type;
+
+/*-------------------------------------------------------------
+Bucket reached by the search for a free cuckoo slot, and how it
+was reached: from the parent bucket by moving the entry in the
+given slot there to its other bucket.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    unsigned int        bucket;     /* bucket reached        */
+    unsigned int        parent;     /* search index of parent*/
+    unsigned char       slot;       /* slot moved from parent*/
+    } hmap_cuckoo_node_type;
+
+/*-------------------------------------------------------------
+Slot of a hopscotch map. Each slot is the home of the entries
+whose hash maps to it, which are kept within the next
+HMAP_HOPSCOTCH_RANGE slots; bit i of hop is set if the slot i
+places on holds one of them. The entry's hash is kept in its
+slot so most slots can be ruled out without reading the entry.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    hmap_ref_type       entry;      /* entry in slot, if any */
+    HMAP_hash_val_type  hash;       /* hash of slot's entry  */
+    unsigned int        hop;        /* neighborhood bitmap   */
+    } hmap_hopscotch_slot_type;
+
+/*-------------------------------------------------------------
+A key prefix shared by the entries of a prefix mode map. The
+prefix bytes follow the structure. In prefix mode an entry's
+key block holds a reference to its prefix (invalid if the key
+has no prefix worth sharing) followed by the rest of the key.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    hmap_ref_type       next;       /* next prefix in bucket */
+    HMAP_hash_val_type  hash;       /* hash of prefix bytes  */
+    unsigned int        refs;       /* num keys using prefix */
+    unsigned int        size;       /* num prefix bytes      */
+    } hmap_prefix_type;
+
+/*-------------------------------------------------------------
+Header at the start of a shared region. Region memory is
+handed out in power of two blocks, each preceded by a header
+holding its size class. Freed blocks are kept on per class
+free lists.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    unsigned int        magic;      /* HMAP_REGION_MAGIC     */
+    unsigned int        lock;       /* readers/writer lock   */
+    unsigned long long  region_size;/* size of region        */
+    unsigned long long  top;        /* first unused offset   */
+    hmap_ref_type       free_lists[ HMAP_REGION_CLASS_COUNT ];
+                                    /* free blocks by class  */
+    hmap_table_type     table;      /* the shared table      */
+    } hmap_region_type;
+
+/*-------------------------------------------------------------
+Header preceding each block allocated from a shared region.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    unsigned long long  size_class; /* log2 of block size    */
+    } hmap_block_type;
+
+/*-------------------------------------------------------------
+Mutation log of a map. Records are collected in the buffer and
+written as a group. Once a write or sync fails the log may end
+in a torn record, so it is failed for good rather than have
+later records appended after it.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    void              * context;    /* caller's log stream   */
+    HMAP_write_fptr     write;      /* append to the log     */
+    HMAP_sync_fptr      sync;       /* sync the log          */
+    unsigned char     * buffer;     /* buffered records      */
+    unsigned int        buffer_size;/* size of buffer        */
+    unsigned int        length;     /* num buffered bytes    */
+    unsigned int        group_size; /* mutations per group   */
+    unsigned int        group_count;/* mutations in group    */
+    HMAP_log_sync_t8    sync_policy;/* when to sync the log  */
+    HMAP_bool_t8        failed;     /* log unusable          */
+    } hmap_log_type;
+
+/*-------------------------------------------------------------
+Reader of a mutation log during replay.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    void              * context;    /* caller's log stream   */
+    HMAP_read_fptr      read;       /* log reader            */
+    HMAP_malloc_fptr    malloc;     /* allocate memory       */
+    HMAP_free_fptr      free;       /* deallocate memory     */
+    unsigned long long  offset;     /* log offset of buffer  */
+    unsigned long long  valid_size; /* end of last good rec  */
+    unsigned char     * buffer;     /* buffered log bytes    */
+    unsigned int        buffer_size;/* size of buffer        */
+    unsigned int        length;     /* num buffered bytes    */
+    unsigned int        position;   /* next unread byte      */
+    HMAP_status_t8      status;     /* reader error, if any  */
+    } hmap_log_reader_type;
+
+/*-------------------------------------------------------------
+Index entry of a snapshot block.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    unsigned long long  offset;     /* snapshot offset       */
+    unsigned int        stored_size;/* size in the snapshot  */
+    unsigned int        raw_size;   /* uncompressed size     */
+    unsigned int        entry_count;/* num entries in block  */
+    unsigned int        checksum;   /* uncompressed checksum */
+    } hmap_snapshot_index_type;
+
+/*-------------------------------------------------------------
+A snapshot block being compressed or decompressed. A block is
+stored as is when it does not compress, so entries points at
+whichever buffer holds the uncompressed entries.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    hmap_snapshot_index_type
+                        index;      /* the block's index     */
+    unsigned char     * raw;        /* uncompressed buffer   */
+    unsigned int        raw_capacity;
+                                    /* size of raw           */
+    unsigned char     * stored;     /* compressed buffer     */
+    unsigned int        stored_capacity;
+                                    /* size of stored        */
+    unsigned char     * entries;    /* raw or stored         */
+    HMAP_status_t8      status;     /* task result           */
+    } hmap_snapshot_block_type;
+
+/*-------------------------------------------------------------
+A group of snapshot blocks handled as one parallel job.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    hmap_snapshot_block_type
+                        blocks[ HMAP_SNAPSHOT_WAVE ];
+                                    /* blocks of the job     */
+    unsigned int        count;      /* num blocks in job     */
+    HMAP_bool_t8        reading;    /* reads in flight       */
+    } hmap_snapshot_wave_type;
+
+/*-------------------------------------------------------------
+Position of an iteration over the map's entries. Ordered maps
+use bucket as the position in the order array.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    unsigned int        bucket;     /* next bucket to visit  */
+    hmap_ref_type       entry;      /* next entry in bucket  */
+    } hmap_iterator_type;
+
+/*-------------------------------------------------------------
+A snapshot being saved by HMAP_save_step. The snapshot holds
+the entries as they were when the save started: an entry is
+packed before it is first changed, removed or moved, and the
+scan packs the rest. Entries whose epoch is the table's save
+epoch have been packed, or were added after the save started.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    HMAP_snapshot_def_type
+                      * snapshot;   /* snapshot to write     */
+    hmap_snapshot_wave_type
+                      * wave;       /* blocks being filled   */
+    hmap_snapshot_index_type
+                      * index;      /* index of blocks saved */
+    unsigned int        index_capacity;
+                                    /* capacity of index     */
+    unsigned int        index_count;/* num blocks in index   */
+    unsigned long long  offset;     /* snapshot offset       */
+    unsigned int        block_size; /* raw bytes per block   */
+    hmap_iterator_type  iterator;   /* scan position         */
+    HMAP_status_t8      status;     /* first error, if any   */
+    } hmap_save_type;
+
+/*-------------------------------------------------------------
+Spill files of a map. The data of a spilled entry is in the
+file selected by its HMAP_ENTRY_SPILL_FILE flag. Data is
+appended to the current file; while the files are compacted,
+live data is moved out of the other one. The clock hand sweeps
+the entries, spilling those not read since it last passed.
+After a failed write the offset of the end of the current file
+is unknown, so nothing more is written to it.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    HMAP_spill_def_type files[ 2 ]; /* spill files           */
+    unsigned long long  file_size[ 2 ];
+                                    /* bytes written         */
+    unsigned long long  live_size[ 2 ];
+                                    /* bytes still in use    */
+    unsigned int        current;    /* file appended to      */
+    HMAP_bool_t8        compacting; /* other file in use     */
+    HMAP_bool_t8        failed;     /* current file unusable */
+    hmap_iterator_type  hand;       /* clock hand            */
+    hmap_iterator_type  iterator;   /* compaction scan       */
+    unsigned char     * buffer;     /* data read back        */
+    unsigned int        buffer_capacity;
+                                    /* size of buffer        */
+    } hmap_spill_type;
+
+/*-------------------------------------------------------------
+Value segments. Data blocks are appended to the current
+segment, each after a header naming its segment, and a segment
+is freed once none of its data is live. Blocks too large for a
+segment get an allocation of their own, still with a header.
+Sparse segments are emptied by moving their live blocks to the
+current segment.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    unsigned int        segment;    /* index, or NONE        */
+    unsigned int        size;       /* bytes with header     */
+    } hmap_value_header_type;
+
+typedef struct
+    {
+    unsigned char     * bytes;      /* segment, NULL if free */
+    unsigned int        used;       /* bytes appended        */
+    unsigned int        live;       /* bytes still in use    */
+    HMAP_bool_t8        evacuating; /* being emptied         */
+    } hmap_segment_type;
+
+typedef struct
+    {
+    hmap_segment_type * list;       /* segments by index     */
+    unsigned int        count;      /* num indexes used      */
+    unsigned int        capacity;   /* num indexes in list   */
+    unsigned int        segment_size;
+                                    /* bytes per segment     */
+    unsigned int        current;    /* segment appended to   */
+    unsigned int        evacuating; /* num being emptied     */
+    hmap_iterator_type  iterator;   /* compaction scan       */
+    } hmap_segments_type;
+
+/*-------------------------------------------------------------
+A lookup in flight in HMAP_get_data_stream. Each step reads
+memory prefetched by the step before it.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    HMAP_anon_type      key;        /* key being looked up   */
+    HMAP_hash_val_type  key_hash;   /* hash value of key     */
+    hmap_ref_type       entry;      /* entry to compare, or  */
+                                    /* entry found when done */
+    unsigned char       state;      /* HMAP_LOOKUP_*         */
+    } hmap_lookup_type;
+
+/*-------------------------------------------------------------
+Arena of interned string bytes. Arenas are never moved or
+freed before the table is destroyed, so interned strings keep
+their address. The bytes follow the structure.
+-------------------------------------------------------------*/
+typedef struct hmap_arena_struct
+    {
+    struct hmap_arena_struct
+                      * next;       /* previous arena        */
+    unsigned int        size;       /* num bytes in arena    */
+    unsigned int        used;       /* num bytes handed out  */
+    } hmap_arena_type;
+
+/*-------------------------------------------------------------
+An interned string, indexed by its ID.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    unsigned char     * bytes;      /* bytes in an arena     */
+    unsigned int        size;       /* num bytes             */
+    HMAP_hash_val_type  hash;       /* hash of the bytes     */
+    } hmap_intern_string_type;
+
+/*-------------------------------------------------------------
+Slot of the interning table's open addressed index. The hash
+is kept with the ID so probing rarely touches the strings.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    HMAP_hash_val_type  hash;       /* hash of the string    */
+    unsigned int        id;         /* ID + 1, 0 when empty  */
+    } hmap_intern_slot_type;
+
+/*-------------------------------------------------------------
+The interning table's private data.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    hmap_intern_slot_type
+                      * slots;      /* index of the strings  */
+    unsigned int        slots_len;  /* num slots, power of 2 */
+    hmap_intern_string_type
+                      * strings;    /* strings by ID         */
+    unsigned int        strings_len;/* capacity of strings   */
+    unsigned int        count;      /* num interned strings  */
+    hmap_arena_type   * arena;      /* arena being filled    */
+    HMAP_hash_fptr_type hash;       /* hashing function      */
+    HMAP_equal_fptr     equal;      /* string comparison     */
+    HMAP_free_fptr      free;       /* deallocate memory     */
+    HMAP_malloc_fptr    malloc;     /* allocate memory       */
+    } hmap_intern_type;
+
+/*-------------------------------------------------------------
+Compares two keys.
+-------------------------------------------------------------*/
+typedef HMAP_bool_t8 hmap_match_func_type
+    (
+    HMAP_anon_type
+                const * data_1,     /* anonymous data to be compared    */
+    HMAP_anon_type
+                const * data_2      /* anonymous data to be compared    */
+    );
+typedef hmap_match_func_type * hmap_match_fptr_type;
+
+/*-------------------------------------------------------------
+Hashes a batch of keys.
+-------------------------------------------------------------*/
+typedef void hmap_hash_batch_func_type
+    (
+    HMAP_anon_type
+                const * keys,       /* keys to hash                     */
+    unsigned int        count,      /* num keys                         */
+    HMAP_hash_val_type
+                      * hashes      /* out: hash value per key          */
+    );
+typedef hmap_hash_batch_func_type * hmap_hash_batch_fptr_type;
+
+/*-------------------------------------------------------------
+The hash map's private data.
+-------------------------------------------------------------*/
+typedef struct hmap_map_struct
+    {
+    unsigned char     * base;       /* base address for refs */
+    hmap_region_type  * region;     /* shared region, if any */
+    hmap_table_type   * table;      /* the map's table       */
+    hmap_table_type     local_table;/* table of heap maps    */
+    hmap_log_type     * log;        /* mutation log, if any  */
+    hmap_save_type    * save;       /* save in progress      */
+    hmap_spill_type   * spill;      /* spill files, if any   */
+    hmap_segments_type* segments;   /* value segments, if any*/
     HMAP_hash_fptr_type hash;       /* hashing function      */
+    HMAP_equal_fptr     equal;      /* custom key equality   */
+    hmap_hash_batch_fptr_type
+                        hash_batch; /* batch hashing kernel  */
+    hmap_match_fptr_type
+                        match;      /* key comparison kernel */
+    unsigned int        features;   /* HMAP_CPU_* features   */
     HMAP_free_fptr      free;       /* deallocate memory     */
     HMAP_malloc_fptr    malloc;     /* allocae memory        */
+    HMAP_usable_size_fptr
+                        usable_size;/* allocated block size  */
+    unsigned long long  size_limit; /* bytes, 0 for no limit */
     } hmap_map_type;
 
 
@@ -63,6 +658,19 @@ typedef struct hmap_map_struct
                                  MEMORY CONSTANTS
 --------------------------------------------------------------------------------*/
 
+/*-------------------------------------------------------------
+Powers of the SDBM multiplier 65599, from the 16th down to the
+0th, used to hash blocks of bytes in SIMD lanes.
+-------------------------------------------------------------*/
+static const unsigned int hmap_sdbm_powers[ HMAP_SDBM_POWERS ] =
+    {
+    0x4F377C01u, 0x8DA473BFu, 0x50C7AC81u, 0x7280233Fu,
+    0xCC881D01u, 0x0D1B92BFu, 0x6698CD81u, 0xB156C23Fu,
+    0xD319BE01u, 0xA311B1BFu, 0xD62AEE81u, 0x162C613Fu,
+    0x43EC5F01u, 0x2E86D0BFu, 0x007E0F81u, 0x0001003Fu,
+    0x00000001u
+    };
+
 
 /*--------------------------------------------------------------------------------
                                  STATIC VARIABLES
@@ -73,6 +681,50 @@ typedef struct hmap_map_struct
                                     PROCEDURES
 --------------------------------------------------------------------------------*/
 
+static HMAP_status_t8 acquire_prefix
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * bytes,      /* prefix bytes                     */
+    hmap_ref_type     * out_ref     /* out: reference to prefix         */
+    );
+
+static HMAP_bool_t8 alloc_blob
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_blob_type    * blob,       /* out: block                       */
+    unsigned int        size        /* num bytes in block               */
+    );
+
+static HMAP_bool_t8 alloc_data_blob
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_blob_type    * blob,       /* out: block                       */
+    unsigned int        size        /* num bytes in block               */
+    );
+
+static hmap_entry_type * alloc_dense_entry
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    );
+
+static unsigned char * alloc_intern_bytes
+    (
+    hmap_intern_type  * intern,     /* interning table private data     */
+    unsigned long long  size        /* num bytes to allocate            */
+    );
+
+static void * alloc_memory
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned long long  size        /* num bytes to allocate            */
+    );
+
+static hmap_entry_type * alloc_slab_entry
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    );
+
 static HMAP_bool_t8 anon_data_match
     (
     HMAP_anon_type    
@@ -81,6 +733,119 @@ static HMAP_bool_t8 anon_data_match
                 const * data_2      /* anonymous data to be compared    */
     );
 
+#if defined( HMAP_X86 )
+static HMAP_TARGET_AVX2 HMAP_bool_t8 anon_data_match_avx2
+    (
+    HMAP_anon_type
+                const * data_1,     /* anonymous data to be compared    */
+    HMAP_anon_type
+                const * data_2      /* anonymous data to be compared    */
+    );
+
+static HMAP_TARGET_SSE2 HMAP_bool_t8 anon_data_match_sse2
+    (
+    HMAP_anon_type
+                const * data_1,     /* anonymous data to be compared    */
+    HMAP_anon_type
+                const * data_2      /* anonymous data to be compared    */
+    );
+#endif
+
+static HMAP_bool_t8 append_log
+    (
+    hmap_log_type     * log,        /* mutation log                     */
+    void        const * bytes,      /* bytes to append                  */
+    unsigned int        size        /* num bytes to append              */
+    );
+
+static HMAP_bool_t8 append_order
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* new entry                        */
+    );
+
+static hmap_value_header_type * append_segment
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned int        size        /* num bytes with header, aligned   */
+    );
+
+static HMAP_bool_t8 append_spill
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry,      /* entry being spilled              */
+    void        const * bytes       /* entry data                       */
+    );
+
+static HMAP_status_t8 append_value
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry,      /* multimap entry                   */
+    HMAP_anon_type
+                const * value       /* value to append                  */
+    );
+
+static void clear_cuckoo_buckets
+    (
+    hmap_cuckoo_bucket_type
+                      * buckets,    /* table to clear                   */
+    unsigned int        buckets_len /* num buckets                      */
+    );
+
+static void clear_hopscotch_slots
+    (
+    hmap_hopscotch_slot_type
+                      * slots,      /* table to clear                   */
+    unsigned int        slots_len   /* num slots                        */
+    );
+
+static void close_segment
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned int        index       /* index of segment                 */
+    );
+
+static int compare_key_parts
+    (
+    HMAP_anon_type
+                const * parts_1,    /* key as prefix and rest           */
+    HMAP_anon_type
+                const * parts_2     /* key as prefix and rest           */
+    );
+
+static int compare_sorted_slot
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_sorted_slot_type
+                      * slot,       /* slot of a sorted bucket          */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    HMAP_anon_type
+                const * key_parts   /* key as prefix and rest, or NULL  */
+    );
+
+static unsigned int compress_block
+    (
+    unsigned char const
+                      * source,     /* bytes to compress                */
+    unsigned int        source_size,/* num bytes to compress            */
+    unsigned char     * destination,/* out: compressed bytes            */
+    unsigned int        destination_size
+                                    /* capacity of destination          */
+    );
+
+static void compress_task
+    (
+    void              * argument,   /* snapshot wave                    */
+    unsigned int        index       /* index of block in wave           */
+    );
+
+static unsigned int compute_checksum
+    (
+    unsigned int        checksum,   /* checksum of preceding bytes      */
+    void        const * bytes,      /* bytes to checksum                */
+    unsigned int        size        /* num bytes                        */
+    );
+
 static void copy_anon_data
     (
     HMAP_anon_type    * destination,/* copy source data here            */
@@ -88,649 +853,12347 @@ static void copy_anon_data
                 const * source      /* source of data to be copied      */
     );
 
+static void copy_entry_key
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry,      /* entry holding the key            */
+    unsigned char     * destination /* out: key bytes                   */
+    );
+
+static unsigned int count_cuckoo_hash
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    );
+
+static unsigned int count_hopscotch_hash
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    );
+
 static hmap_entry_type * create_entry
     (
     hmap_map_type     * map,        /* hash map private data            */
     HMAP_anon_type    
                 const * key,        /* entry key                        */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
     HMAP_anon_type    
                 const * data        /* entry data                       */
     );
 
-static void destroy_entry
+static HMAP_status_t8 create_log
     (
     hmap_map_type     * map,        /* hash map private data            */
-    hmap_entry_type   * entry       /* entry to destroy                 */
+    HMAP_log_def_type * log_def     /* mutation log definition          */
+    );
+
+static HMAP_status_t8 create_segments
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned int        segment_size/* bytes per segment                */
+    );
+
+static hmap_snapshot_wave_type * create_snapshot_wave
+    (
+    hmap_map_type     * map         /* hash map private data            */
     );
 
-static hmap_entry_type ** get_bucket_by_hash
-    (
-    hmap_map_type     * map,        /* hash map private data            */
-    HMAP_hash_val_type  key_hash    /* hash value of key                */
-    );
+static HMAP_status_t8 create_spill
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_spill_def_type
+                      * spill_def   /* spill file definition            */
+    );
+
+static unsigned int decode_u32
+    (
+    unsigned char const
+                      * bytes       /* encoded value                    */
+    );
+
+static unsigned int decode_varint
+    (
+    unsigned char const
+                      * bytes,      /* encoded value                    */
+    unsigned int        size,       /* num bytes available              */
+    unsigned int      * value       /* out: decoded value               */
+    );
+
+static unsigned int decompress_block
+    (
+    unsigned char const
+                      * source,     /* compressed bytes                 */
+    unsigned int        source_size,/* num compressed bytes             */
+    unsigned char     * destination,/* out: decompressed bytes          */
+    unsigned int        destination_size
+                                    /* capacity of destination          */
+    );
+
+static void decompress_task
+    (
+    void              * argument,   /* snapshot wave                    */
+    unsigned int        index       /* index of block in wave           */
+    );
+
+static void destroy_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to destroy                 */
+    );
+
+static void destroy_snapshot_wave
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_snapshot_wave_type
+                      * wave        /* wave to free                     */
+    );
+
+static HMAP_bool_t8 emit_lz_sequence
+    (
+    unsigned char     * destination,/* compressed output                */
+    unsigned int        destination_size,
+                                    /* capacity of destination          */
+    unsigned int      * size,       /* in/out: size of output           */
+    unsigned char const
+                      * literals,   /* literal bytes                    */
+    unsigned int        literal_count,
+                                    /* num literal bytes                */
+    unsigned int        offset,     /* match offset                     */
+    unsigned int        match_length/* match length, or 0               */
+    );
+
+static void encode_u32
+    (
+    unsigned char     * bytes,      /* out: encoded value               */
+    unsigned int        value       /* value to encode                  */
+    );
+
+static unsigned int encode_varint
+    (
+    unsigned char     * bytes,      /* out: encoded value               */
+    unsigned int        value       /* value to encode                  */
+    );
+
+static void end_save
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_status_t8      status      /* result of the save               */
+    );
+
+static HMAP_bool_t8 entry_key_match
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry,      /* entry to compare                 */
+    HMAP_anon_type
+                const * key         /* key to compare                   */
+    );
+
+static void * fetch_entry_data
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry being read                 */
+    );
+
+static unsigned int fill_log_reader
+    (
+    hmap_log_reader_type
+                      * reader,     /* log reader                       */
+    unsigned int        size        /* num bytes needed                 */
+    );
+
+static hmap_entry_type * find_cuckoo_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    );
+
+static hmap_entry_type * find_dense_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    );
+
+static hmap_entry_type * find_hopscotch_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    );
+
+static HMAP_bool_t8 flush_log
+    (
+    hmap_log_type     * log,        /* mutation log                     */
+    HMAP_bool_t8        sync        /* sync the log after writing       */
+    );
+
+static void flush_save
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_bool_t8        last        /* write the partial block too      */
+    );
+
+static void free_blob
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_blob_type    * blob        /* block to free                    */
+    );
+
+static void free_data_blob
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_blob_type    * blob        /* block to free                    */
+    );
+
+static void free_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to free                    */
+    );
+
+static void free_memory
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    void              * memory      /* memory block to free             */
+    );
+
+static void free_sorted_bucket
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of a key in bucket    */
+    );
+
+static void * get_blob_bytes
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_blob_type    * blob        /* block of bytes                   */
+    );
+
+static hmap_link_type * get_bucket_by_hash
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    );
+
+static unsigned int get_cpu_features
+    (
+    void
+    );
+
+static unsigned int get_cuckoo_bucket
+    (
+    unsigned int        buckets_len,/* num buckets, power of 2          */
+    unsigned int        bucket_index,
+                                    /* one bucket of the entry          */
+    unsigned char       tag         /* tag of the entry                 */
+    );
+
+static unsigned char get_cuckoo_tag
+    (
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    );
+
+static unsigned int get_dense_index
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned int        slot        /* slot in index table              */
+    );
+
+static hmap_entry_type * get_entry_by_key
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type    
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    );
+
+static void * get_entry_data
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to read                    */
+    );
+
+static void get_entry_key_parts
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry,      /* entry holding the key            */
+    HMAP_anon_type    * parts       /* out: key's prefix and rest       */
+    );
+
+static hmap_link_type * get_entry_link
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type    
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    unsigned int      * depth       /* out: num links followed          */
+    );
+
+static unsigned int get_hopscotch_home
+    (
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    unsigned int        slots_len   /* num slots, power of 2            */
+    );
+
+static unsigned int get_key_size
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry holding the key            */
+    );
+
+static unsigned long long get_malloc_size
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    void              * memory,     /* allocated block                  */
+    unsigned long long  size        /* num bytes requested              */
+    );
+
+static unsigned long long get_memory_in_use
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    );
+
+static unsigned long long get_memory_size
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    void              * memory,     /* allocated block                  */
+    unsigned long long  size        /* num bytes requested              */
+    );
+
+static unsigned int get_prefix_size
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key         /* hash map entry key               */
+    );
+
+static unsigned int get_record_size
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    );
+
+static unsigned int get_slab
+    (
+    unsigned int        record      /* record number                    */
+    );
+
+static hmap_sorted_type * get_sorted_bucket
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of a key in bucket    */
+    );
+
+static unsigned int get_sorted_position
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_sorted_type  * sorted,     /* index of a sorted bucket         */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    HMAP_anon_type
+                const * key_parts   /* key as prefix and rest, or NULL  */
+    );
+
+static unsigned int get_spill_file
+    (
+    hmap_entry_type   * entry       /* spilled entry                    */
+    );
+
+static HMAP_bool_t8 grow_buffer
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned char    ** buffer,     /* in/out: buffer                   */
+    unsigned int      * capacity,   /* in/out: size of buffer           */
+    unsigned int        length,     /* num bytes to keep                */
+    unsigned int        size        /* num bytes needed                 */
+    );
+
+static HMAP_bool_t8 grow_intern_slots
+    (
+    hmap_intern_type  * intern      /* interning table private data     */
+    );
+
+static void hash_keys
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * keys,       /* keys to hash                     */
+    unsigned int        count,      /* num keys                         */
+    HMAP_hash_val_type
+                      * hashes      /* out: hash value per key          */
+    );
+
+static HMAP_hash_val_type hash_sdbm
+    (
+    HMAP_anon_type    
+                const * key         /* hash map entry key               */
+    );
+
+#if defined( HMAP_X86 )
+static HMAP_TARGET_AVX2 HMAP_hash_val_type hash_sdbm_avx2
+    (
+    const HMAP_anon_type
+                      * key         /* hash map entry key               */
+    );
+
+static HMAP_TARGET_AVX512 HMAP_hash_val_type hash_sdbm_avx512
+    (
+    const HMAP_anon_type
+                      * key         /* hash map entry key               */
+    );
+
+static HMAP_TARGET_AVX2 void hash_sdbm_batch_avx2
+    (
+    HMAP_anon_type
+                const * keys,       /* keys to hash                     */
+    unsigned int        count,      /* num keys                         */
+    HMAP_hash_val_type
+                      * hashes      /* out: hash value per key          */
+    );
+
+static HMAP_TARGET_AVX512 void hash_sdbm_batch_avx512
+    (
+    HMAP_anon_type
+                const * keys,       /* keys to hash                     */
+    unsigned int        count,      /* num keys                         */
+    HMAP_hash_val_type
+                      * hashes      /* out: hash value per key          */
+    );
+
+static HMAP_TARGET_SSE42 HMAP_hash_val_type hash_sdbm_sse42
+    (
+    const HMAP_anon_type
+                      * key         /* hash map entry key               */
+    );
+#endif
+
+static HMAP_bool_t8 insert_sorted
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to add                     */
+    );
+
+static HMAP_status_t8 link_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to add                     */
+    );
+
+static hmap_entry_type * link_to_ptr
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_link_type      link        /* link to an entry                 */
+    );
+
+static hmap_ref_type link_to_ref
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_link_type      link        /* link to an entry, or invalid     */
+    );
+
+static HMAP_status_t8 load_snapshot_block
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_snapshot_block_type
+                      * block       /* verified snapshot block          */
+    );
+
+static void lock_map
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_bool_t8        write       /* lock for writing                 */
+    );
+
+static HMAP_status_t8 log_mutation
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned char       record_type,/* HMAP_LOG_RECORD_SET or _REMOVE   */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    HMAP_anon_type
+                const * key,        /* entry key                        */
+    HMAP_anon_type
+                const * data        /* entry data, or invalid           */
+    );
+
+static hmap_entry_type * lookup_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    );
+
+static hmap_entry_type * next_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_iterator_type* iterator    /* in/out: position in map          */
+    );
+
+static HMAP_bool_t8 open_segment
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    );
+
+static HMAP_bool_t8 pack_snapshot_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_snapshot_block_type
+                      * block,      /* block being filled               */
+    hmap_entry_type   * entry       /* entry to pack                    */
+    );
+
+static HMAP_bool_t8 place_cuckoo_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_cuckoo_bucket_type
+                      * buckets,    /* table to place the entry in      */
+    unsigned int        buckets_len,/* num buckets, power of 2          */
+    hmap_entry_type   * entry       /* entry to place                   */
+    );
+
+static HMAP_bool_t8 place_hopscotch_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_hopscotch_slot_type
+                      * slots,      /* table to place the entry in      */
+    unsigned int        slots_len,  /* num slots, power of 2            */
+    hmap_entry_type   * entry       /* entry to place                   */
+    );
+
+static void prefetch_bucket
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    );
+
+static void preserve_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry about to change            */
+    );
+
+static hmap_link_type ptr_to_link
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry in a slab record           */
+    );
+
+static hmap_ref_type ptr_to_ref
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    void              * ptr         /* pointer to map memory            */
+    );
+
+static HMAP_bool_t8 read_log_record
+    (
+    hmap_log_reader_type
+                      * reader,     /* log reader                       */
+    unsigned char     * record_type,/* out: type of record              */
+    HMAP_hash_val_type* key_hash,   /* out: key hash                    */
+    HMAP_anon_type    * key,        /* out: entry key                   */
+    HMAP_anon_type    * data        /* out: entry data                  */
+    );
+
+static HMAP_bool_t8 read_lz_length
+    (
+    unsigned char const
+                      * source,     /* compressed bytes                 */
+    unsigned int        source_size,/* num compressed bytes             */
+    unsigned int      * input,      /* in/out: position in source       */
+    unsigned int        nibble,     /* length from the token            */
+    unsigned int      * length      /* out: decoded length              */
+    );
+
+static HMAP_bool_t8 read_snapshot
+    (
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to read                 */
+    unsigned long long  offset,     /* snapshot offset                  */
+    void              * buffer,     /* out: bytes read                  */
+    unsigned int        size        /* num bytes to read                */
+    );
+
+static HMAP_status_t8 read_snapshot_index
+    (
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to read                 */
+    HMAP_malloc_fptr    malloc,     /* index allocator                  */
+    HMAP_free_fptr      free,       /* index deallocator                */
+    hmap_snapshot_index_type
+                     ** out_index,  /* out: block index                 */
+    unsigned int      * block_count,/* out: num blocks                  */
+    unsigned int      * entry_count /* out: num entries                 */
+    );
+
+static HMAP_status_t8 read_snapshot_wave
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to read                 */
+    hmap_snapshot_wave_type
+                      * wave,       /* out: wave of stored blocks       */
+    unsigned int        first_tag,  /* tag of the wave's first read     */
+    hmap_snapshot_index_type
+                const * index,      /* block index                      */
+    unsigned int        block_count,/* num blocks                       */
+    unsigned int      * next_block  /* in/out: next block to read       */
+    );
+
+static HMAP_bool_t8 read_spill
+    (
+    HMAP_spill_def_type
+                      * file,       /* spill file to read               */
+    unsigned long long  offset,     /* file offset                      */
+    void              * buffer,     /* out: bytes read                  */
+    unsigned int        size        /* num bytes to read                */
+    );
+
+static void * ref_to_ptr
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_ref_type       ref         /* reference to map memory          */
+    );
+
+static void * region_alloc
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned long long  size        /* num bytes to allocate            */
+    );
+
+static void region_free
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    void              * memory      /* memory block to free             */
+    );
+
+static void release_entry_data
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry whose data is released     */
+    );
+
+static void release_prefix
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_ref_type       prefix_ref  /* reference to prefix              */
+    );
+
+static HMAP_bool_t8 remove_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    );
+
+static void remove_order
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry being removed              */
+    );
+
+static void remove_sorted
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry unlinked from its bucket   */
+    );
+
+static HMAP_bool_t8 reserve_memory
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * keep,       /* entry not to spill, or NULL      */
+    unsigned long long  size        /* num bytes about to be added      */
+    );
+
+static HMAP_bool_t8 resize_cuckoo
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    );
+
+static HMAP_bool_t8 resize_dense
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    );
+
+static HMAP_bool_t8 resize_hopscotch
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    );
+
+static HMAP_bool_t8 resize_order
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    );
+
+static void rewind_save
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    );
+
+static void run_snapshot_wave
+    (
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot definition              */
+    hmap_snapshot_wave_type
+                      * wave,       /* wave of blocks                   */
+    HMAP_task_fptr      task        /* task to run on each block        */
+    );
+
+static HMAP_status_t8 save_snapshot_index
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to write                */
+    hmap_snapshot_index_type
+                const * index,      /* block index                      */
+    unsigned int        block_count,/* num blocks                       */
+    unsigned long long  offset      /* snapshot offset of the index     */
+    );
+
+static HMAP_status_t8 save_snapshot_wave
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to write                */
+    hmap_snapshot_wave_type
+                      * wave,       /* wave of raw blocks               */
+    hmap_snapshot_index_type
+                     ** index,      /* in/out: block index              */
+    unsigned int      * index_capacity,
+                                    /* in/out: capacity of index        */
+    unsigned int      * index_count,/* in/out: num blocks in index      */
+    unsigned long long* offset      /* in/out: snapshot offset          */
+    );
+
+static HMAP_status_t8 select_hash
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_def_type     * hmap_def    /* hash map definition              */
+    );
+
+static void select_kernels
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    );
+
+static HMAP_hash_fptr_type select_sdbm
+    (
+    unsigned int        features    /* HMAP_CPU_* features              */
+    );
+
+static hmap_hash_batch_fptr_type select_sdbm_batch
+    (
+    unsigned int        features    /* HMAP_CPU_* features              */
+    );
+
+static void set_dense_index
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned int        slot,       /* slot in index table              */
+    unsigned int        index       /* entry position plus one          */
+    );
+
+static HMAP_status_t8 set_entry_data
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    HMAP_anon_type
+                const * data        /* entry data                       */
+    );
+
+static void sort_bucket
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of a key in bucket    */
+    );
+
+static void spill_cold_data
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * keep,       /* entry not to spill, or NULL      */
+    unsigned long long  size        /* num bytes about to be added      */
+    );
+
+static void spill_entry_data
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to spill                   */
+    );
+
+static void start_lookup
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_lookup_type  * lookup      /* lookup with its key set          */
+    );
+
+static HMAP_bool_t8 step_lookup
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_lookup_type  * lookup      /* lookup in flight                 */
+    );
+
+static void unlink_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to remove                  */
+    );
+
+static void unlock_map
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_bool_t8        write       /* lock was taken for writing       */
+    );
+
+static HMAP_status_t8 wait_snapshot_wave
+    (
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot being read              */
+    hmap_snapshot_wave_type
+                      * wave,       /* wave of blocks being read        */
+    unsigned int        first_tag   /* tag of the wave's first read     */
+    );
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_add_value
+ *
+ *  Description:
+ *      Append a value to the value list of a key in a multimap, creating
+ *      an entry for the key if it does not already exist. The list grows
+ *      geometrically, so appending takes amortized constant time.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_add_value
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_anon_type
+                const * value       /* value to append                  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entry;
+unsigned char           header[ HMAP_VALUES_HEADER_SIZE ];
+HMAP_anon_type          empty_list;
+HMAP_hash_val_type      key_hash;
+hmap_map_type         * map;
+HMAP_status_t8          status;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj   == HMAP_INVALID_POINTER
+ || key   == HMAP_INVALID_POINTER
+ || value == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+if( map->table->multimap == HMAP_BOOL_FALSE )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+lock_map( map, HMAP_BOOL_TRUE );
+
+/*-------------------------------------------------------------
+Find the key's entry, giving new keys an empty value list.
+-------------------------------------------------------------*/
+key_hash = map->hash( key );
+entry = get_entry_by_key( map, key, key_hash );
+if( entry == HMAP_INVALID_POINTER )
+    {
+    encode_u32( &header[ 0 ], 0 );
+    encode_u32( &header[ 4 ], HMAP_VALUES_HEADER_SIZE );
+    empty_list.ptr = header;
+    empty_list.size = sizeof( header );
+
+    status = set_entry_data( map, key, key_hash, &empty_list );
+    if( status != HMAP_STATUS_SUCCESS )
+        {
+        unlock_map( map, HMAP_BOOL_TRUE );
+        return( status );
+        }
+    entry = get_entry_by_key( map, key, key_hash );
+    }
+
+/*-------------------------------------------------------------
+Append the value.
+-------------------------------------------------------------*/
+status = append_value( map, entry, value );
+
+unlock_map( map, HMAP_BOOL_TRUE );
+return( status );
+
+}   /* HMAP_add_value() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_attach
+ *
+ *  Description:
+ *      Attach to a hash map previously created in a shared region by
+ *      another process (or by this one). The definition must provide
+ *      the region, the memory hooks for the local map object and, if
+ *      the map uses a custom hash, the hash function.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_attach
+    (
+    HMAP_def_type     * hmap_def,   /* definition with shared region    */
+    HMAP_obj_type     * out_obj     /* out: hash map object             */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_map_type         * map;
+hmap_region_type      * region;
+HMAP_status_t8          status;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER
+-------------------------------------------------------------*/
+if( hmap_def == HMAP_INVALID_POINTER
+ || out_obj  == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify the definition holds an initialized shared region and
+memory hooks for the local map object.
+-------------------------------------------------------------*/
+region = (hmap_region_type *)hmap_def->region;
+if( hmap_def->malloc == HMAP_INVALID_POINTER
+ || hmap_def->free   == HMAP_INVALID_POINTER
+ || region           == HMAP_INVALID_POINTER
+ || region->magic    != HMAP_REGION_MAGIC )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+out_obj->data = HMAP_INVALID_POINTER;
+
+/*-------------------------------------------------------------
+Allocate the local map object and point it at the region.
+-------------------------------------------------------------*/
+map = hmap_def->malloc( sizeof(*map) );
+if( map == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+map->malloc = hmap_def->malloc;
+map->free = hmap_def->free;
+map->usable_size = hmap_def->usable_size;
+map->size_limit = hmap_def->size_limit;
+map->base = (unsigned char *)region;
+map->region = region;
+map->table = &region->table;
+map->log = HMAP_INVALID_POINTER;
+map->save = HMAP_INVALID_POINTER;
+map->spill = HMAP_INVALID_POINTER;
+map->segments = HMAP_INVALID_POINTER;
+
+/*-------------------------------------------------------------
+Bind the kernels for this processor and use the hash algorithm
+the map was created with.
+-------------------------------------------------------------*/
+select_kernels( map );
+status = select_hash( map, hmap_def );
+if( status != HMAP_STATUS_SUCCESS )
+    {
+    map->free( map );
+    return( status );
+    }
+
+/*-------------------------------------------------------------
+Construct the public map object.
+-------------------------------------------------------------*/
+out_obj->data = map;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_attach() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_compact_values
+ *
+ *  Description:
+ *      Free the value segments that have become sparse, moving their
+ *      live data to the current segment, scanning up to budget
+ *      entries per call. The segments less than half in use are
+ *      picked when a round starts, and done is set once they have all
+ *      been freed, or if none were sparse. Call between other uses of
+ *      the map until done.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_compact_values
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned int        budget,     /* num entries to scan              */
+    HMAP_bool_t8      * done        /* out: no sparse segments are left */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            count;
+hmap_blob_type          data_blob;
+HMAP_anon_type          destination;
+hmap_entry_type       * entry;
+hmap_value_header_type* header;
+unsigned int            i;
+hmap_map_type         * map;
+hmap_segment_type     * segment;
+hmap_segments_type    * segments;
+HMAP_anon_type          source;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj  == HMAP_INVALID_POINTER
+ || done == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Verify the map keeps its data in segments.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+segments = map->segments;
+if( segments == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+Start a round by picking the sparse segments. The current
+segment is still being filled, so it is left alone.
+-------------------------------------------------------------*/
+*done = HMAP_BOOL_FALSE;
+if( segments->evacuating == 0 )
+    {
+    for( i = 0; i < segments->count; i++ )
+        {
+        segment = &segments->list[ i ];
+        if( segment->bytes != HMAP_INVALID_POINTER
+         && i != segments->current
+         && (unsigned long long)segment->live * HMAP_SEGMENT_SPARSE < segment->used )
+            {
+            segment->evacuating = HMAP_BOOL_TRUE;
+            segments->evacuating++;
+            }
+        }
+    segments->iterator.bucket = 0;
+    segments->iterator.entry = HMAP_INVALID_REF;
+    }
+
+/*-------------------------------------------------------------
+Move the data of the next entries out of the segments being
+emptied. Buckets of chained maps are finished within the call,
+as the entries of an unfinished one could be removed before
+the next. The scan starts over if it ends before the segments
+are empty, as entries may have been rearranged behind it.
+-------------------------------------------------------------*/
+count = 0;
+while( segments->evacuating > 0
+    && ( count < budget
+      || segments->iterator.entry != HMAP_INVALID_REF ) )
+    {
+    count++;
+    entry = next_entry( map, &segments->iterator );
+    if( entry == HMAP_INVALID_POINTER )
+        {
+        segments->iterator.bucket = 0;
+        continue;
+        }
+
+    if( entry->data.size <= HMAP_INLINE_SIZE
+     || ( entry->flags & HMAP_ENTRY_SPILLED ) != 0 )
+        {
+        continue;
+        }
+
+    header = (hmap_value_header_type *)get_blob_bytes( map, &entry->data ) - 1;
+    if( header->segment == HMAP_SEGMENT_NONE
+     || !segments->list[ header->segment ].evacuating )
+        {
+        continue;
+        }
+
+    if( !alloc_data_blob( map, &data_blob, entry->data.size ) )
+        {
+        segments->iterator.entry = HMAP_INVALID_REF;
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
+
+    destination.ptr = get_blob_bytes( map, &data_blob );
+    source.ptr = get_blob_bytes( map, &entry->data );
+    source.size = entry->data.size;
+    copy_anon_data( &destination, &source );
+    free_data_blob( map, &entry->data );
+    entry->data = data_blob;
+    }
+
+if( segments->evacuating == 0 )
+    {
+    segments->iterator.entry = HMAP_INVALID_REF;
+    *done = HMAP_BOOL_TRUE;
+    }
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_compact_values() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_create
+ *
+ *  Description:
+ *      Create a new hash map.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_create
+    (
+    HMAP_def_type     * hmap_def,   /* hash map definition              */
+    HMAP_obj_type     * out_obj     /* out: hash map object             */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_link_type        * buckets;
+hmap_cuckoo_bucket_type
+                      * cuckoo_buckets;
+unsigned int            i;
+hmap_map_type         * map;
+hmap_region_type      * region;
+hmap_hopscotch_slot_type
+                      * slots;
+HMAP_status_t8          status;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER
+-------------------------------------------------------------*/
+if( hmap_def == HMAP_INVALID_POINTER 
+ || out_obj  == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    } 
+
+/*-------------------------------------------------------------
+Verify memory allocator and deallocator functions are defined
+and the map has at least one bucket.
+-------------------------------------------------------------*/
+if( hmap_def->malloc   == HMAP_INVALID_POINTER
+ || hmap_def->free     == HMAP_INVALID_POINTER
+ || hmap_def->map_size == 0
+ || hmap_def->key_mode >= HMAP_KEY_MODE_COUNT
+ || hmap_def->engine   >= HMAP_ENGINE_COUNT )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+A shared region must be aligned and large enough to hold at
+least its own header. Shared maps can not be logged, as each
+process would write its own log, nor move entries to the front
+of their buckets, as lookups only lock the map for reading.
+-------------------------------------------------------------*/
+region = (hmap_region_type *)hmap_def->region;
+if( region != HMAP_INVALID_POINTER
+ && ( ( (uintptr_t)region % HMAP_REGION_ALIGN ) != 0
+   || hmap_def->region_size < sizeof(*region)
+   || hmap_def->log != HMAP_INVALID_POINTER
+   || hmap_def->move_to_front != HMAP_BOOL_FALSE ) )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    } 
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+map = HMAP_INVALID_POINTER;
+out_obj->data = HMAP_INVALID_POINTER;
+
+/*-------------------------------------------------------------
+Allocate and initialize the private map data.
+-------------------------------------------------------------*/
+map = hmap_def->malloc( sizeof(*map) );
+if( map == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+map->malloc = hmap_def->malloc;
+map->free = hmap_def->free;
+map->usable_size = hmap_def->usable_size;
+map->size_limit = hmap_def->size_limit;
+map->base = HMAP_INVALID_POINTER;
+map->region = HMAP_INVALID_POINTER;
+map->table = &map->local_table;
+map->table->size = sizeof(*map);
+map->log = HMAP_INVALID_POINTER;
+map->save = HMAP_INVALID_POINTER;
+map->spill = HMAP_INVALID_POINTER;
+map->segments = HMAP_INVALID_POINTER;
+
+/*-------------------------------------------------------------
+Maps in a shared region keep their table in the region header
+and allocate everything else from the region. The region is
+not marked valid until the map is completely built.
+-------------------------------------------------------------*/
+if( region != HMAP_INVALID_POINTER )
+    {
+    region->magic = 0;
+    region->lock = 0;
+    region->region_size = hmap_def->region_size;
+    region->top = ( sizeof(*region) + HMAP_REGION_ALIGN - 1 )
+                & ~(unsigned long long)( HMAP_REGION_ALIGN - 1 );
+    for( i = 0; i < HMAP_REGION_CLASS_COUNT; i++ )
+        {
+        region->free_lists[ i ] = HMAP_INVALID_REF;
+        }
+
+    map->base = (unsigned char *)region;
+    map->region = region;
+    map->table = &region->table;
+    map->table->size = sizeof(*region);
+    }
+
+map->table->hash_type = hmap_def->hash_type;
+map->table->entry_count = 0;
+map->table->data_size = 0;
+map->table->key_size = 0;
+map->table->buckets_len = hmap_def->map_size;
+map->table->key_mode = hmap_def->key_mode;
+map->table->key_separator = hmap_def->key_separator;
+if( map->table->key_separator == 0 )
+    {
+    map->table->key_separator = HMAP_KEY_SEPARATOR;
+    }
+map->table->prefixes = HMAP_INVALID_REF;
+map->table->prefixes_len = 0;
+map->table->prefix_count = 0;
+map->table->multimap = hmap_def->multimap;
+map->table->ordered = hmap_def->ordered;
+map->table->order = HMAP_INVALID_REF;
+map->table->order_len = 0;
+map->table->order_capacity = 0;
+map->table->save_epoch = 0;
+map->table->engine = hmap_def->engine;
+map->table->index_size = 0;
+map->table->entries = HMAP_INVALID_REF;
+map->table->entries_len = 0;
+map->table->entries_capacity = 0;
+for( i = 0; i < HMAP_SLAB_COUNT; i++ )
+    {
+    map->table->slabs[ i ] = HMAP_INVALID_REF;
+    }
+map->table->slab_len = 0;
+map->table->slab_free = HMAP_INVALID_LINK;
+map->table->sorted = HMAP_INVALID_REF;
+map->table->move_to_front = hmap_def->move_to_front;
+map->table->deep_hits = 0;
+map->table->hits = 0;
+map->table->hit_depth = 0;
+if( map->table->engine != HMAP_ENGINE_CHAINED )
+    {
+    map->table->move_to_front = HMAP_BOOL_FALSE;
+    }
+if( map->table->engine == HMAP_ENGINE_DENSE )
+    {
+    map->table->buckets = HMAP_INVALID_REF;
+    map->table->buckets_len = 0;
+    map->table->ordered = HMAP_BOOL_FALSE;
+    }
+else if( map->table->engine == HMAP_ENGINE_CUCKOO )
+    {
+    map->table->buckets_len = 1;
+    while( map->table->buckets_len * HMAP_CUCKOO_WAYS < hmap_def->map_size )
+        {
+        map->table->buckets_len *= 2;
+        }
+    }
+else if( map->table->engine == HMAP_ENGINE_HOPSCOTCH )
+    {
+    map->table->buckets_len = HMAP_HOPSCOTCH_RANGE;
+    while( map->table->buckets_len < hmap_def->map_size )
+        {
+        map->table->buckets_len *= 2;
+        }
+    }
+
+/*-------------------------------------------------------------
+Bind the kernels for this processor and set the appropriate
+hashing function per map definition.
+-------------------------------------------------------------*/
+select_kernels( map );
+status = select_hash( map, hmap_def );
+if( status != HMAP_STATUS_SUCCESS )
+    {
+    map->free( map );
+    return( status );
+    }
+    
+/*-------------------------------------------------------------
+Allocate the empty buckets. Dense maps allocate their entry
+array and index table when the first entry is added.
+-------------------------------------------------------------*/
+if( map->table->engine == HMAP_ENGINE_CUCKOO )
+    {
+    cuckoo_buckets = alloc_memory( map, (unsigned long long)map->table->buckets_len * sizeof(*cuckoo_buckets) );
+    if( cuckoo_buckets == HMAP_INVALID_POINTER )
+        {
+        map->free( map );
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
+    clear_cuckoo_buckets( cuckoo_buckets, map->table->buckets_len );
+    map->table->buckets = ptr_to_ref( map, cuckoo_buckets );
+    map->table->size += sizeof(*cuckoo_buckets) * map->table->buckets_len;
+    }
+else if( map->table->engine == HMAP_ENGINE_HOPSCOTCH )
+    {
+    slots = alloc_memory( map, (unsigned long long)map->table->buckets_len * sizeof(*slots) );
+    if( slots == HMAP_INVALID_POINTER )
+        {
+        map->free( map );
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
+    clear_hopscotch_slots( slots, map->table->buckets_len );
+    map->table->buckets = ptr_to_ref( map, slots );
+    map->table->size += sizeof(*slots) * map->table->buckets_len;
+    }
+else if( map->table->engine == HMAP_ENGINE_CHAINED )
+    {
+    buckets = alloc_memory( map, (unsigned long long)map->table->buckets_len * sizeof(*buckets) );
+    if( buckets == HMAP_INVALID_POINTER )
+        {
+        map->free( map );
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
+    for( i = 0; i < map->table->buckets_len; i++ )
+        {
+        buckets[ i ] = HMAP_INVALID_LINK;
+        }
+    map->table->buckets = ptr_to_ref( map, buckets );
+    map->table->size += sizeof(*buckets) * map->table->buckets_len;
+    }
+
+/*-------------------------------------------------------------
+Set up the value segments and attach the spill file, if they
+are defined.
+-------------------------------------------------------------*/
+if( hmap_def->segment_size != 0 )
+    {
+    out_obj->data = map;
+    status = create_segments( map, hmap_def->segment_size );
+    if( status != HMAP_STATUS_SUCCESS )
+        {
+        HMAP_destroy( out_obj );
+        return( status );
+        }
+    }
+
+if( hmap_def->spill != HMAP_INVALID_POINTER )
+    {
+    out_obj->data = map;
+    status = create_spill( map, hmap_def->spill );
+    if( status != HMAP_STATUS_SUCCESS )
+        {
+        HMAP_destroy( out_obj );
+        return( status );
+        }
+    }
+
+/*-------------------------------------------------------------
+Start the mutation log, if one is defined.
+-------------------------------------------------------------*/
+if( hmap_def->log != HMAP_INVALID_POINTER )
+    {
+    out_obj->data = map;
+    status = create_log( map, hmap_def->log );
+    if( status != HMAP_STATUS_SUCCESS )
+        {
+        HMAP_destroy( out_obj );
+        return( status );
+        }
+    }
+
+/*-------------------------------------------------------------
+The shared region now holds a valid map.
+-------------------------------------------------------------*/
+if( region != HMAP_INVALID_POINTER )
+    {
+    __atomic_store_n( &region->magic, HMAP_REGION_MAGIC, __ATOMIC_RELEASE );
+    }
+
+/*-------------------------------------------------------------
+Construct the public map object.
+-------------------------------------------------------------*/
+out_obj->data = map;
+
+/*-------------------------------------------------------------
+Object has been created successfully.
+-------------------------------------------------------------*/
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_create() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_destroy
+ *
+ *  Description:
+ *      Destroy the hash map object. For maps in a shared region only
+ *      the local map object is destroyed; the map itself stays in the
+ *      region, which is owned by the caller.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_destroy
+    (
+    HMAP_obj_type     * obj       /* hash map object                    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_link_type        * buckets;
+unsigned int            i;
+hmap_entry_type       * entry;
+hmap_iterator_type      iterator;
+hmap_map_type         * map;
+hmap_ref_type         * sorted_refs;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER
+-------------------------------------------------------------*/
+if( obj == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    } 
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+buckets = ref_to_ptr( map, map->table->buckets );
+
+/*-------------------------------------------------------------
+Cancel a save in progress.
+-------------------------------------------------------------*/
+if( map->save != HMAP_INVALID_POINTER )
+    {
+    end_save( map, HMAP_STATUS_CANCELED );
+    }
+
+/*-------------------------------------------------------------
+Free the map entries and buckets of heap maps. Destroying the
+entries releases all shared key prefixes.
+-------------------------------------------------------------*/
+if( map->region == HMAP_INVALID_POINTER
+ && map->table->engine != HMAP_ENGINE_CHAINED )
+    {
+    /*---------------------------------------------------------
+    Entries of the other engines are destroyed as they are
+    visited. Destroying them leaves their slots in place, so
+    the iteration is not disturbed.
+    ---------------------------------------------------------*/
+    iterator.bucket = 0;
+    iterator.entry = HMAP_INVALID_REF;
+    entry = next_entry( map, &iterator );
+    while( entry != HMAP_INVALID_POINTER )
+        {
+        destroy_entry( map, entry );
+        entry = next_entry( map, &iterator );
+        }
+
+    free_memory( map, ref_to_ptr( map, map->table->entries ) );
+    free_memory( map, buckets );
+    free_memory( map, ref_to_ptr( map, map->table->prefixes ) );
+    free_memory( map, ref_to_ptr( map, map->table->order ) );
+    }
+else if( map->region == HMAP_INVALID_POINTER )
+    {
+    for( i = 0; i < map->table->buckets_len; i++ )
+        {
+        while( buckets[ i ] != HMAP_INVALID_LINK )
+            {
+            /*-------------------------------------------------
+            Pop the top entry from the bucket and then destroy
+            it.
+            -------------------------------------------------*/
+            entry = link_to_ptr( map, buckets[ i ] );
+            buckets[ i ] = entry->next;
+            destroy_entry( map, entry );
+            }
+        }
+
+    for( i = 0; i < HMAP_SLAB_COUNT; i++ )
+        {
+        free_memory( map, ref_to_ptr( map, map->table->slabs[ i ] ) );
+        }
+    if( map->table->sorted != HMAP_INVALID_REF )
+        {
+        sorted_refs = ref_to_ptr( map, map->table->sorted );
+        for( i = 0; i < map->table->buckets_len; i++ )
+            {
+            free_memory( map, ref_to_ptr( map, sorted_refs[ i ] ) );
+            }
+        free_memory( map, sorted_refs );
+        }
+    free_memory( map, buckets );
+    free_memory( map, ref_to_ptr( map, map->table->prefixes ) );
+    free_memory( map, ref_to_ptr( map, map->table->order ) );
+    }
+
+/*-------------------------------------------------------------
+Commit and free the mutation log. A failed log is left as it
+is.
+-------------------------------------------------------------*/
+if( map->log != HMAP_INVALID_POINTER )
+    {
+    if( !map->log->failed )
+        {
+        flush_log( map->log, HMAP_BOOL_TRUE );
+        }
+    map->free( map->log->buffer );
+    map->free( map->log );
+    }
+
+/*-------------------------------------------------------------
+Free the value segments still holding data and the spill
+state. The spill files belong to the caller.
+-------------------------------------------------------------*/
+if( map->segments != HMAP_INVALID_POINTER )
+    {
+    for( i = 0; i < map->segments->count; i++ )
+        {
+        free_memory( map, map->segments->list[ i ].bytes );
+        }
+    if( map->segments->list != HMAP_INVALID_POINTER )
+        {
+        map->free( map->segments->list );
+        }
+    map->free( map->segments );
+    }
+
+if( map->spill != HMAP_INVALID_POINTER )
+    {
+    if( map->spill->buffer != HMAP_INVALID_POINTER )
+        {
+        map->free( map->spill->buffer );
+        }
+    map->free( map->spill );
+    }
+
+/*-------------------------------------------------------------
+Free the hash map.
+-------------------------------------------------------------*/
+map->free( map );
+obj->data = HMAP_INVALID_POINTER;
+
+/*-------------------------------------------------------------
+The hash map object has been destroyed successfully.
+-------------------------------------------------------------*/
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_destroy() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_for_each
+ *
+ *  Description:
+ *      Visit every entry of the map, in insertion order for ordered
+ *      maps and in bucket order otherwise. Multimap keys are visited
+ *      once for each of their values. The visit stops early if visit
+ *      returns HMAP_BOOL_FALSE.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_for_each
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_visit_fptr     visit,      /* function to visit entries        */
+    void              * context     /* passed to visit                  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+HMAP_anon_type          data;
+hmap_entry_type       * entry;
+hmap_iterator_type      iterator;
+HMAP_anon_type          key;
+unsigned char         * key_buffer;
+unsigned int            key_capacity;
+unsigned char         * list;
+hmap_map_type         * map;
+HMAP_bool_t8            more;
+HMAP_status_t8          status;
+HMAP_values_type        values;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj   == HMAP_INVALID_POINTER
+ || visit == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+key_buffer = HMAP_INVALID_POINTER;
+key_capacity = 0;
+more = HMAP_BOOL_TRUE;
+status = HMAP_STATUS_SUCCESS;
+iterator.bucket = 0;
+iterator.entry = HMAP_INVALID_REF;
+lock_map( map, HMAP_BOOL_FALSE );
+
+/*-------------------------------------------------------------
+Visit the entries.
+-------------------------------------------------------------*/
+entry = next_entry( map, &iterator );
+while( entry != HMAP_INVALID_POINTER
+    && more )
+    {
+    /*---------------------------------------------------------
+    Keys are passed in place, except in prefix mode where they
+    are rebuilt in a local buffer.
+    ---------------------------------------------------------*/
+    key.ptr = get_blob_bytes( map, &entry->key );
+    key.size = entry->key.size;
+    if( map->table->key_mode == HMAP_KEY_MODE_PREFIX )
+        {
+        key.size = get_key_size( map, entry );
+        if( !grow_buffer( map, &key_buffer, &key_capacity, 0, key.size ) )
+            {
+            status = HMAP_STATUS_OUT_OF_MEMORY;
+            break;
+            }
+        copy_entry_key( map, entry, key_buffer );
+        key.ptr = key_buffer;
+        }
+
+    /*---------------------------------------------------------
+    Visit the entry's data, or each of a multimap's values.
+    ---------------------------------------------------------*/
+    if( map->table->multimap != HMAP_BOOL_FALSE )
+        {
+        list = get_blob_bytes( map, &entry->data );
+        values.next = &list[ HMAP_VALUES_HEADER_SIZE ];
+        values.end = &list[ decode_u32( &list[ 4 ] ) ];
+        while( more
+            && HMAP_next_value( &values, &data ) )
+            {
+            more = visit( context, &key, &data );
+            }
+        }
+    else
+        {
+        data.ptr = get_entry_data( map, entry );
+        data.size = entry->data.size;
+        if( data.ptr == HMAP_INVALID_POINTER )
+            {
+            status = HMAP_STATUS_IO_ERROR;
+            break;
+            }
+        more = visit( context, &key, &data );
+        }
+
+    entry = next_entry( map, &iterator );
+    }
+
+unlock_map( map, HMAP_BOOL_FALSE );
+
+/*-------------------------------------------------------------
+Clean up.
+-------------------------------------------------------------*/
+if( key_buffer != HMAP_INVALID_POINTER )
+    {
+    map->free( key_buffer );
+    }
+
+return( status );
+
+}   /* HMAP_for_each() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_get_data
+ *
+ *  Description:
+ *      Get the data associated with the key.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_get_data
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    const HMAP_anon_type
+                      * key,        /* hash map entry key               */
+    HMAP_anon_type    * data        /* out: entry data                  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entry;
+HMAP_anon_type          entry_data;
+hmap_map_type         * map;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj  == HMAP_INVALID_POINTER 
+ || key  == HMAP_INVALID_POINTER
+ || data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    } 
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Get the private hash map data. Multimap values are read with
+HMAP_get_values.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+if( map->table->multimap != HMAP_BOOL_FALSE )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+lock_map( map, HMAP_BOOL_FALSE );
+
+/*-------------------------------------------------------------
+Get the entry associated with the key.
+-------------------------------------------------------------*/
+entry = lookup_entry( map, key, map->hash( key ) );
+
+/*-------------------------------------------------------------
+Verify a valid entry was found.
+-------------------------------------------------------------*/
+if( entry == HMAP_INVALID_POINTER )
+    {
+    unlock_map( map, HMAP_BOOL_FALSE );
+    return( HMAP_STATUS_KEY_NOT_IN_MAP );
+    }
+
+/*-------------------------------------------------------------
+Get the entry data, reading it back if it was spilled.
+-------------------------------------------------------------*/
+entry_data.ptr = fetch_entry_data( map, entry );
+entry_data.size = entry->data.size;
+if( entry_data.ptr == HMAP_INVALID_POINTER )
+    {
+    unlock_map( map, HMAP_BOOL_FALSE );
+    return( HMAP_STATUS_IO_ERROR );
+    }
+copy_anon_data( data, &entry_data );
+
+unlock_map( map, HMAP_BOOL_FALSE );
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_get_data() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_get_data_batch
+ *
+ *  Description:
+ *      Get the data associated with each of a batch of keys. Keys are
+ *      hashed and their buckets prefetched a group at a time before
+ *      any of the group is looked up, so the memory accesses of a
+ *      group overlap. Each key's result is written to its element of
+ *      statuses: HMAP_STATUS_SUCCESS with its data copied to its
+ *      element of data, HMAP_STATUS_KEY_NOT_IN_MAP, or
+ *      HMAP_STATUS_IO_ERROR if its spilled data could not be read.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_get_data_batch
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_anon_type
+                const * keys,       /* hash map entry keys              */
+    unsigned int        count,      /* num keys                         */
+    HMAP_anon_type    * data,       /* out: entry data per key          */
+    HMAP_status_t8    * statuses    /* out: status per key              */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entry;
+HMAP_anon_type          entry_data;
+unsigned int            first;
+unsigned int            group;
+HMAP_hash_val_type      hashes[ HMAP_BATCH_SIZE ];
+unsigned int            i;
+hmap_map_type         * map;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj      == HMAP_INVALID_POINTER
+ || keys     == HMAP_INVALID_POINTER
+ || data     == HMAP_INVALID_POINTER
+ || statuses == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Get the private hash map data. Multimap values are read with
+HMAP_get_values.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+if( map->table->multimap != HMAP_BOOL_FALSE )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+lock_map( map, HMAP_BOOL_FALSE );
+
+/*-------------------------------------------------------------
+Look the keys up a group at a time.
+-------------------------------------------------------------*/
+for( first = 0; first < count; first += group )
+    {
+    group = count - first;
+    if( group > HMAP_BATCH_SIZE )
+        {
+        group = HMAP_BATCH_SIZE;
+        }
+
+    /*---------------------------------------------------------
+    Hash the group's keys together, then start loading each of
+    their buckets.
+    ---------------------------------------------------------*/
+    hash_keys( map, &keys[ first ], group, hashes );
+    for( i = 0; i < group; i++ )
+        {
+        prefetch_bucket( map, hashes[ i ] );
+        }
+
+    /*---------------------------------------------------------
+    Look each key up and copy out its data.
+    ---------------------------------------------------------*/
+    for( i = 0; i < group; i++ )
+        {
+        entry = lookup_entry( map, &keys[ first + i ], hashes[ i ] );
+        if( entry == HMAP_INVALID_POINTER )
+            {
+            statuses[ first + i ] = HMAP_STATUS_KEY_NOT_IN_MAP;
+            continue;
+            }
+
+        entry_data.ptr = fetch_entry_data( map, entry );
+        entry_data.size = entry->data.size;
+        if( entry_data.ptr == HMAP_INVALID_POINTER )
+            {
+            statuses[ first + i ] = HMAP_STATUS_IO_ERROR;
+            continue;
+            }
+        copy_anon_data( &data[ first + i ], &entry_data );
+        statuses[ first + i ] = HMAP_STATUS_SUCCESS;
+        }
+    }
+
+unlock_map( map, HMAP_BOOL_FALSE );
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_get_data_batch() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_get_data_stream
+ *
+ *  Description:
+ *      Look up a stream of keys, keeping up to HMAP_STREAM_WAYS lookups
+ *      in flight. Each lookup prefetches the memory its next step will
+ *      read and yields to the others, so a miss in one lookup is hidden
+ *      behind the work of the rest, however long its bucket. The result
+ *      of each key is visited with its data, or with data
+ *      HMAP_INVALID_POINTER if it is not in the map, in the order the
+ *      lookups finish. The stream stops early if visit returns
+ *      HMAP_BOOL_FALSE, or with HMAP_STATUS_IO_ERROR if spilled data
+ *      could not be read back.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_get_data_stream
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_key_source_fptr
+                        next_key,   /* function supplying keys          */
+    HMAP_visit_fptr     visit,      /* function to visit results        */
+    void              * context     /* passed to next_key and visit     */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            active;
+HMAP_anon_type          data;
+hmap_entry_type       * entry;
+unsigned int            i;
+hmap_lookup_type        lookups[ HMAP_STREAM_WAYS ];
+hmap_map_type         * map;
+HMAP_bool_t8            more;
+HMAP_status_t8          status;
+HMAP_bool_t8            supplied;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj      == HMAP_INVALID_POINTER
+ || next_key == HMAP_INVALID_POINTER
+ || visit    == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Get the private hash map data. Multimap values are read with
+HMAP_get_values.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+if( map->table->multimap != HMAP_BOOL_FALSE )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+lock_map( map, HMAP_BOOL_FALSE );
+
+/*-------------------------------------------------------------
+Start a lookup in every way.
+-------------------------------------------------------------*/
+active = 0;
+supplied = HMAP_BOOL_TRUE;
+more = HMAP_BOOL_TRUE;
+status = HMAP_STATUS_SUCCESS;
+for( i = 0; i < HMAP_STREAM_WAYS; i++ )
+    {
+    lookups[ i ].state = HMAP_LOOKUP_IDLE;
+    if( supplied )
+        {
+        supplied = next_key( context, &lookups[ i ].key );
+        }
+    if( supplied )
+        {
+        start_lookup( map, &lookups[ i ] );
+        active++;
+        }
+    }
+
+/*-------------------------------------------------------------
+Step the lookups in turn, visiting the result of each one that
+finishes and starting the next key in its place.
+-------------------------------------------------------------*/
+while( active > 0
+    && more )
+    {
+    for( i = 0; i < HMAP_STREAM_WAYS && more; i++ )
+        {
+        if( lookups[ i ].state == HMAP_LOOKUP_IDLE
+         || !step_lookup( map, &lookups[ i ] ) )
+            {
+            continue;
+            }
+
+        if( lookups[ i ].entry == HMAP_INVALID_REF )
+            {
+            more = visit( context, &lookups[ i ].key, HMAP_INVALID_POINTER );
+            }
+        else
+            {
+            entry = ref_to_ptr( map, lookups[ i ].entry );
+            data.ptr = fetch_entry_data( map, entry );
+            data.size = entry->data.size;
+            if( data.ptr == HMAP_INVALID_POINTER )
+                {
+                status = HMAP_STATUS_IO_ERROR;
+                more = HMAP_BOOL_FALSE;
+                }
+            else
+                {
+                more = visit( context, &lookups[ i ].key, &data );
+                }
+            }
+
+        lookups[ i ].state = HMAP_LOOKUP_IDLE;
+        active--;
+        if( more
+         && supplied )
+            {
+            supplied = next_key( context, &lookups[ i ].key );
+            }
+        if( more
+         && supplied )
+            {
+            start_lookup( map, &lookups[ i ] );
+            active++;
+            }
+        }
+    }
+
+unlock_map( map, HMAP_BOOL_FALSE );
+return( status );
+
+}   /* HMAP_get_data_stream() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_get_entry_count
+ *
+ *  Description:
+ *      Get the number of entries in the map.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_get_entry_count
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned int      * entry_count /* out: number of entries in map    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entry;
+hmap_map_type         * map;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj  == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    } 
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Get the private hash map data.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+
+/*-------------------------------------------------------------
+Get the entry associated with the key.
+-------------------------------------------------------------*/
+*entry_count = map->table->entry_count;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_get_entry_count() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_get_hash
+ *
+ *  Description:
+ *      Get the hash value of provided data.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_get_hash
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_anon_type
+                const * data,       /* data to hash                     */
+    HMAP_hash_val_type* hash        /* out: hash value of data          */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_map_type         * map;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj  == HMAP_INVALID_POINTER
+ || data == HMAP_INVALID_POINTER
+ || hash == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    } 
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Get the private hash map data.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+
+/*-------------------------------------------------------------
+Hash the given data.
+-------------------------------------------------------------*/
+*hash = map->hash( data );
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_get_hash() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_get_hit_depth
+ *
+ *  Description:
+ *      Get the number of reads that found their key in a
+ *      move-to-front map and the number of links followed past the
+ *      head of their buckets to find them. Their ratio is the average
+ *      hit depth.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_get_hit_depth
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned long long* hits,       /* out: num lookups that hit        */
+    unsigned long long* depth       /* out: links followed to the hits  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_map_type         * map;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj   == HMAP_INVALID_POINTER
+ || hits  == HMAP_INVALID_POINTER
+ || depth == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Verify the map moves its hits to the front.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+if( map->table->move_to_front == HMAP_BOOL_FALSE )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+*hits = map->table->hits;
+*depth = map->table->hit_depth;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_get_hit_depth() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_get_memory_usage
+ *
+ *  Description:
+ *      Get the memory used by the hash map, broken down into its
+ *      bucket arrays, entry records, keys, data and overhead. Blocks
+ *      are counted at the size the allocator set aside for them when
+ *      the map has a usable_size hook, or is shared, and at the size
+ *      requested otherwise. Spilled data is not counted. The entries
+ *      are walked, so this takes time in proportion to the map.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_get_memory_usage
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_memory_usage_type
+                      * usage       /* out: memory used by the map      */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned long long      array_size;
+unsigned long long      bucket_size;
+hmap_entry_type       * entry;
+unsigned int            entry_size;
+hmap_value_header_type* header;
+unsigned int            i;
+hmap_iterator_type      iterator;
+hmap_map_type         * map;
+hmap_prefix_type      * prefix;
+hmap_ref_type           prefix_ref;
+hmap_ref_type         * prefixes;
+hmap_segment_type     * segment;
+hmap_sorted_type      * sorted;
+hmap_ref_type         * sorted_refs;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj   == HMAP_INVALID_POINTER
+ || usage == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+usage->buckets = 0;
+usage->entries = 0;
+usage->keys = 0;
+usage->values = 0;
+usage->overhead = get_malloc_size( map, map, sizeof(*map) );
+lock_map( map, HMAP_BOOL_FALSE );
+
+/*-------------------------------------------------------------
+Count the bucket array. Dense maps have none until the first
+entry is added.
+-------------------------------------------------------------*/
+bucket_size = sizeof( hmap_link_type );
+if( map->table->engine == HMAP_ENGINE_CUCKOO )
+    {
+    bucket_size = sizeof( hmap_cuckoo_bucket_type );
+    }
+else if( map->table->engine == HMAP_ENGINE_HOPSCOTCH )
+    {
+    bucket_size = sizeof( hmap_hopscotch_slot_type );
+    }
+else if( map->table->engine == HMAP_ENGINE_DENSE )
+    {
+    bucket_size = map->table->index_size;
+    }
+
+if( map->table->buckets != HMAP_INVALID_REF )
+    {
+    usage->buckets = get_memory_size( map, ref_to_ptr( map, map->table->buckets ),
+                                      bucket_size * map->table->buckets_len );
+    }
+
+/*-------------------------------------------------------------
+Count the indexes of sorted buckets with the buckets.
+-------------------------------------------------------------*/
+if( map->table->sorted != HMAP_INVALID_REF )
+    {
+    sorted_refs = ref_to_ptr( map, map->table->sorted );
+    usage->buckets += get_memory_size( map, sorted_refs,
+                                       (unsigned long long)map->table->buckets_len * sizeof(*sorted_refs) );
+    for( i = 0; i < map->table->buckets_len; i++ )
+        {
+        if( sorted_refs[ i ] != HMAP_INVALID_REF )
+            {
+            sorted = ref_to_ptr( map, sorted_refs[ i ] );
+            usage->buckets += get_memory_size( map, sorted, sizeof(*sorted)
+                                             + (unsigned long long)sorted->capacity * sizeof( hmap_sorted_slot_type ) );
+            }
+        }
+    }
+
+/*-------------------------------------------------------------
+Count the entry records. A dense map's records are in its
+entry array, and a chained map's in its slabs. Their removed
+and unused records are overhead.
+-------------------------------------------------------------*/
+entry_size = get_record_size( map );
+if( map->table->engine == HMAP_ENGINE_DENSE
+ && map->table->entries != HMAP_INVALID_REF )
+    {
+    array_size = get_memory_size( map, ref_to_ptr( map, map->table->entries ),
+                                  (unsigned long long)map->table->entries_capacity * sizeof(*entry) );
+    usage->entries = (unsigned long long)map->table->entry_count * sizeof(*entry);
+    usage->overhead += array_size - usage->entries;
+    }
+else if( map->table->engine == HMAP_ENGINE_CHAINED )
+    {
+    array_size = 0;
+    for( i = 0; i < HMAP_SLAB_COUNT; i++ )
+        {
+        if( map->table->slabs[ i ] != HMAP_INVALID_REF )
+            {
+            array_size += get_memory_size( map, ref_to_ptr( map, map->table->slabs[ i ] ),
+                                           ( (unsigned long long)HMAP_SLAB_MIN << i ) * entry_size );
+            }
+        }
+    usage->entries = (unsigned long long)map->table->entry_count * entry_size;
+    usage->overhead += array_size - usage->entries;
+    }
+
+/*-------------------------------------------------------------
+Count each entry's own blocks. Data in value segments is
+counted with its segment below.
+-------------------------------------------------------------*/
+iterator.bucket = 0;
+iterator.entry = HMAP_INVALID_REF;
+entry = next_entry( map, &iterator );
+while( entry != HMAP_INVALID_POINTER )
+    {
+    if( map->table->engine != HMAP_ENGINE_DENSE
+     && map->table->engine != HMAP_ENGINE_CHAINED )
+        {
+        usage->entries += get_memory_size( map, entry, entry_size );
+        }
+
+    if( entry->key.size > HMAP_INLINE_SIZE )
+        {
+        usage->keys += get_memory_size( map, get_blob_bytes( map, &entry->key ), entry->key.size );
+        }
+
+    if( entry->data.size > HMAP_INLINE_SIZE
+     && ( entry->flags & HMAP_ENTRY_SPILLED ) == 0 )
+        {
+        if( map->segments == HMAP_INVALID_POINTER )
+            {
+            usage->values += get_memory_size( map, get_blob_bytes( map, &entry->data ), entry->data.size );
+            }
+        else
+            {
+            header = (hmap_value_header_type *)get_blob_bytes( map, &entry->data ) - 1;
+            if( header->segment == HMAP_SEGMENT_NONE )
+                {
+                usage->values += get_memory_size( map, header, header->size );
+                }
+            }
+        }
+
+    entry = next_entry( map, &iterator );
+    }
+
+/*-------------------------------------------------------------
+Count the shared key prefixes and their table.
+-------------------------------------------------------------*/
+if( map->table->prefixes_len > 0 )
+    {
+    prefixes = ref_to_ptr( map, map->table->prefixes );
+    usage->overhead += get_memory_size( map, prefixes, (unsigned long long)map->table->prefixes_len * sizeof(*prefixes) );
+    for( i = 0; i < map->table->prefixes_len; i++ )
+        {
+        for( prefix_ref = prefixes[ i ]; prefix_ref != HMAP_INVALID_REF; prefix_ref = prefix->next )
+            {
+            prefix = ref_to_ptr( map, prefix_ref );
+            usage->keys += get_memory_size( map, prefix, sizeof(*prefix) + prefix->size );
+            }
+        }
+    }
+
+/*-------------------------------------------------------------
+Count the insertion order array.
+-------------------------------------------------------------*/
+if( map->table->order_capacity > 0 )
+    {
+    usage->overhead += get_memory_size( map, ref_to_ptr( map, map->table->order ),
+                                        (unsigned long long)map->table->order_capacity * sizeof(hmap_ref_type) );
+    }
+
+/*-------------------------------------------------------------
+Count the live data of the value segments. Their dead and
+unused bytes are overhead.
+-------------------------------------------------------------*/
+if( map->segments != HMAP_INVALID_POINTER )
+    {
+    usage->overhead += get_malloc_size( map, map->segments, sizeof(*map->segments) );
+    if( map->segments->list != HMAP_INVALID_POINTER )
+        {
+        usage->overhead += get_malloc_size( map, map->segments->list,
+                                            (unsigned long long)map->segments->capacity * sizeof(*segment) );
+        }
+    for( i = 0; i < map->segments->count; i++ )
+        {
+        segment = &map->segments->list[ i ];
+        if( segment->bytes != HMAP_INVALID_POINTER )
+            {
+            usage->values += segment->live;
+            usage->overhead += get_memory_size( map, segment->bytes, map->segments->segment_size ) - segment->live;
+            }
+        }
+    }
+
+/*-------------------------------------------------------------
+Count the region header, the log and the spill state.
+-------------------------------------------------------------*/
+if( map->region != HMAP_INVALID_POINTER )
+    {
+    usage->overhead += sizeof(*map->region);
+    }
+
+if( map->log != HMAP_INVALID_POINTER )
+    {
+    usage->overhead += get_malloc_size( map, map->log, sizeof(*map->log) )
+                     + get_malloc_size( map, map->log->buffer, map->log->buffer_size );
+    }
+
+if( map->spill != HMAP_INVALID_POINTER )
+    {
+    usage->overhead += get_malloc_size( map, map->spill, sizeof(*map->spill) );
+    if( map->spill->buffer != HMAP_INVALID_POINTER )
+        {
+        usage->overhead += get_malloc_size( map, map->spill->buffer, map->spill->buffer_capacity );
+        }
+    }
+
+unlock_map( map, HMAP_BOOL_FALSE );
+
+usage->total = usage->buckets + usage->entries + usage->keys + usage->values + usage->overhead;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_get_memory_usage() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_get_segment_size
+ *
+ *  Description:
+ *      Get the number of bytes held in the map's value segments and
+ *      how many of them are live data. The rest is reclaimed by
+ *      HMAP_compact_values.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_get_segment_size
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned long long* segment_size,/* out: bytes of value segments    */
+    unsigned long long* live_size   /* out: bytes of live data in them  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+hmap_map_type         * map;
+hmap_segments_type    * segments;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj          == HMAP_INVALID_POINTER
+ || segment_size == HMAP_INVALID_POINTER
+ || live_size    == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Verify the map keeps its data in segments.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+segments = map->segments;
+if( segments == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+Add up the segments in use.
+-------------------------------------------------------------*/
+*segment_size = 0;
+*live_size = 0;
+for( i = 0; i < segments->count; i++ )
+    {
+    if( segments->list[ i ].bytes != HMAP_INVALID_POINTER )
+        {
+        *segment_size += segments->segment_size;
+        *live_size += segments->list[ i ].live;
+        }
+    }
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_get_segment_size() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_get_size
+ *
+ *  Description:
+ *      Get the total memory allocated to the hash map, counted as
+ *      the bytes requested. HMAP_get_memory_usage breaks it down and
+ *      counts what the allocator set aside.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_get_size
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned int      * size        /* out: total size of map (bytes)   */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entry;
+hmap_map_type         * map;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj  == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    } 
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Get the private hash map data.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+
+/*-------------------------------------------------------------
+Get the size of the hash map.
+-------------------------------------------------------------*/
+*size = map->table->size;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_get_size() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_get_spill_size
+ *
+ *  Description:
+ *      Get the number of bytes written to the map's spill files and
+ *      how many of them are still in use. The rest is reclaimed by
+ *      HMAP_spill_compact.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_get_spill_size
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned long long* file_size,  /* out: bytes written to spill files*/
+    unsigned long long* live_size   /* out: spilled bytes still in use  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_map_type         * map;
+hmap_spill_type       * spill;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj       == HMAP_INVALID_POINTER
+ || file_size == HMAP_INVALID_POINTER
+ || live_size == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Verify the map spills.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+spill = map->spill;
+if( spill == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+Add up both files.
+-------------------------------------------------------------*/
+*file_size = spill->file_size[ 0 ] + spill->file_size[ 1 ];
+*live_size = spill->live_size[ 0 ] + spill->live_size[ 1 ];
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_get_spill_size() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_get_values
+ *
+ *  Description:
+ *      Get an iterator over the value list of a key in a multimap. The
+ *      values are not copied; HMAP_next_value returns them in place, in
+ *      the order they were added.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_get_values
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_values_type  * values      /* out: iterator over values        */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entry;
+unsigned char         * list;
+hmap_map_type         * map;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj    == HMAP_INVALID_POINTER
+ || key    == HMAP_INVALID_POINTER
+ || values == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+if( map->table->multimap == HMAP_BOOL_FALSE )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+lock_map( map, HMAP_BOOL_FALSE );
+
+/*-------------------------------------------------------------
+Get the entry associated with the key.
+-------------------------------------------------------------*/
+entry = lookup_entry( map, key, map->hash( key ) );
+if( entry == HMAP_INVALID_POINTER )
+    {
+    unlock_map( map, HMAP_BOOL_FALSE );
+    return( HMAP_STATUS_KEY_NOT_IN_MAP );
+    }
+
+/*-------------------------------------------------------------
+Point the iterator at the packed values.
+-------------------------------------------------------------*/
+list = get_blob_bytes( map, &entry->data );
+values->count = decode_u32( &list[ 0 ] );
+values->next = &list[ HMAP_VALUES_HEADER_SIZE ];
+values->end = &list[ decode_u32( &list[ 4 ] ) ];
+
+unlock_map( map, HMAP_BOOL_FALSE );
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_get_values() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_intern
+ *
+ *  Description:
+ *      Intern a string: get the ID and the interned copy of the string,
+ *      adding the string to the table if it is new. Interned strings
+ *      are stored in append-only arenas with a terminating zero byte
+ *      after them, and keep their address until the table is
+ *      destroyed.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_intern
+    (
+    HMAP_intern_obj_type
+                      * obj,        /* interning table object           */
+    HMAP_anon_type
+                const * string,     /* string to intern                 */
+    HMAP_intern_id_type
+                      * id,         /* out: ID of string                */
+    HMAP_anon_type    * interned    /* out: interned string, or NULL    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char         * bytes;
+HMAP_hash_val_type      hash;
+unsigned int            i;
+hmap_intern_type      * intern;
+hmap_intern_slot_type * slot;
+hmap_intern_string_type
+                      * strings;
+HMAP_anon_type          stored;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj    == HMAP_INVALID_POINTER
+ || string == HMAP_INVALID_POINTER
+ || id     == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables. The index is kept at most half full so
+probe sequences stay short; it is grown before probing so a
+new string can take the slot the probe ends on.
+-------------------------------------------------------------*/
+intern = (hmap_intern_type *)obj->data;
+if( ( intern->count + 1ull ) * 2 > intern->slots_len
+ && !grow_intern_slots( intern ) )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+
+/*-------------------------------------------------------------
+Probe for the string.
+-------------------------------------------------------------*/
+hash = intern->hash( string );
+i = hash & ( intern->slots_len - 1 );
+slot = &intern->slots[ i ];
+while( slot->id != 0 )
+    {
+    if( slot->hash == hash )
+        {
+        stored.ptr = intern->strings[ slot->id - 1 ].bytes;
+        stored.size = intern->strings[ slot->id - 1 ].size;
+        if( intern->equal( &stored, string ) )
+            {
+            *id = slot->id - 1;
+            if( interned != HMAP_INVALID_POINTER )
+                {
+                *interned = stored;
+                }
+            return( HMAP_STATUS_SUCCESS );
+            }
+        }
+    i = ( i + 1 ) & ( intern->slots_len - 1 );
+    slot = &intern->slots[ i ];
+    }
+
+/*-------------------------------------------------------------
+Make room for the new string's ID.
+-------------------------------------------------------------*/
+if( intern->count == intern->strings_len )
+    {
+    strings = intern->malloc( ( intern->strings_len * 2ull + HMAP_INTERN_SLOTS_MIN ) * sizeof(*strings) );
+    if( strings == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
+    for( i = 0; i < intern->count; i++ )
+        {
+        strings[ i ] = intern->strings[ i ];
+        }
+    if( intern->strings != HMAP_INVALID_POINTER )
+        {
+        intern->free( intern->strings );
+        }
+    intern->strings = strings;
+    intern->strings_len = intern->strings_len * 2 + HMAP_INTERN_SLOTS_MIN;
+    }
+
+/*-------------------------------------------------------------
+Copy the string to an arena.
+-------------------------------------------------------------*/
+bytes = alloc_intern_bytes( intern, string->size + 1ull );
+if( bytes == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+stored.ptr = bytes;
+copy_anon_data( &stored, string );
+bytes[ string->size ] = 0;
+
+/*-------------------------------------------------------------
+Give the string the next ID and index it.
+-------------------------------------------------------------*/
+intern->strings[ intern->count ].bytes = bytes;
+intern->strings[ intern->count ].size = string->size;
+intern->strings[ intern->count ].hash = hash;
+intern->count++;
+
+slot->hash = hash;
+slot->id = intern->count;
+
+*id = intern->count - 1;
+if( interned != HMAP_INVALID_POINTER )
+    {
+    *interned = stored;
+    }
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_intern() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_intern_create
+ *
+ *  Description:
+ *      Create a new string interning table. The definition's map size
+ *      is the number of strings to make room for up front, and its
+ *      hash and memory hooks are used as for a hash map. Interning
+ *      tables can not be placed in a shared region or logged.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_intern_create
+    (
+    HMAP_def_type     * hmap_def,   /* table definition                 */
+    HMAP_intern_obj_type
+                      * out_obj     /* out: interning table object      */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+hmap_intern_type      * intern;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER
+-------------------------------------------------------------*/
+if( hmap_def == HMAP_INVALID_POINTER
+ || out_obj  == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify the definition.
+-------------------------------------------------------------*/
+if( hmap_def->malloc    == HMAP_INVALID_POINTER
+ || hmap_def->free      == HMAP_INVALID_POINTER
+ || hmap_def->region    != HMAP_INVALID_POINTER
+ || hmap_def->log       != HMAP_INVALID_POINTER
+ || hmap_def->map_size  >  0x40000000u
+ || ( hmap_def->hash_type == HMAP_HASH_FUNC_CUSTOM
+   && hmap_def->hash      == HMAP_INVALID_POINTER )
+ || ( hmap_def->hash_type != HMAP_HASH_FUNC_CUSTOM
+   && hmap_def->equal     != HMAP_INVALID_POINTER ) )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+out_obj->data = HMAP_INVALID_POINTER;
+
+/*-------------------------------------------------------------
+Allocate the table.
+-------------------------------------------------------------*/
+intern = hmap_def->malloc( sizeof(*intern) );
+if( intern == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+intern->malloc = hmap_def->malloc;
+intern->free = hmap_def->free;
+intern->hash = select_sdbm( get_cpu_features() );
+if( hmap_def->hash_type == HMAP_HASH_FUNC_CUSTOM )
+    {
+    intern->hash = hmap_def->hash;
+    }
+intern->equal = anon_data_match;
+if( hmap_def->equal != HMAP_INVALID_POINTER )
+    {
+    intern->equal = hmap_def->equal;
+    }
+intern->strings = HMAP_INVALID_POINTER;
+intern->strings_len = 0;
+intern->count = 0;
+intern->arena = HMAP_INVALID_POINTER;
+
+/*-------------------------------------------------------------
+Allocate the empty index, a power of two at least twice the
+expected number of strings.
+-------------------------------------------------------------*/
+intern->slots_len = HMAP_INTERN_SLOTS_MIN;
+while( intern->slots_len < hmap_def->map_size * 2 )
+    {
+    intern->slots_len *= 2;
+    }
+
+intern->slots = intern->malloc( (unsigned long long)intern->slots_len * sizeof(*intern->slots) );
+if( intern->slots == HMAP_INVALID_POINTER )
+    {
+    intern->free( intern );
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+for( i = 0; i < intern->slots_len; i++ )
+    {
+    intern->slots[ i ].id = 0;
+    }
+
+/*-------------------------------------------------------------
+Construct the public object.
+-------------------------------------------------------------*/
+out_obj->data = intern;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_intern_create() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_intern_destroy
+ *
+ *  Description:
+ *      Destroy a string interning table and all its interned strings.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_intern_destroy
+    (
+    HMAP_intern_obj_type
+                      * obj         /* interning table object           */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_arena_type       * arena;
+hmap_intern_type      * intern;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER
+-------------------------------------------------------------*/
+if( obj == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Free the arenas, the strings and the index.
+-------------------------------------------------------------*/
+intern = (hmap_intern_type *)obj->data;
+while( intern->arena != HMAP_INVALID_POINTER )
+    {
+    arena = intern->arena;
+    intern->arena = arena->next;
+    intern->free( arena );
+    }
+
+if( intern->strings != HMAP_INVALID_POINTER )
+    {
+    intern->free( intern->strings );
+    }
+intern->free( intern->slots );
+
+/*-------------------------------------------------------------
+Free the table.
+-------------------------------------------------------------*/
+intern->free( intern );
+obj->data = HMAP_INVALID_POINTER;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_intern_destroy() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_intern_get_count
+ *
+ *  Description:
+ *      Get the number of interned strings. IDs run from 0 to one less
+ *      than this count.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_intern_get_count
+    (
+    HMAP_intern_obj_type
+                      * obj,        /* interning table object           */
+    unsigned int      * count       /* out: number of interned strings  */
+    )
+{
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj   == HMAP_INVALID_POINTER
+ || count == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+*count = ( (hmap_intern_type *)obj->data )->count;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_intern_get_count() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_intern_get_string
+ *
+ *  Description:
+ *      Get the interned string with the given ID. The string is not
+ *      copied; string receives the address of the interned bytes.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_intern_get_string
+    (
+    HMAP_intern_obj_type
+                      * obj,        /* interning table object           */
+    HMAP_intern_id_type id,         /* ID of string                     */
+    HMAP_anon_type    * string      /* out: interned string             */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_intern_type      * intern;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj    == HMAP_INVALID_POINTER
+ || string == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Look the ID up.
+-------------------------------------------------------------*/
+intern = (hmap_intern_type *)obj->data;
+if( id >= intern->count )
+    {
+    return( HMAP_STATUS_KEY_NOT_IN_MAP );
+    }
+
+string->ptr = intern->strings[ id ].bytes;
+string->size = intern->strings[ id ].size;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_intern_get_string() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_key_in_map
+ *
+ *  Description:
+ *      Returns true if the key exists in the given map.
+ *
+ ************************************************************************/
+HMAP_bool_t8 HMAP_key_in_map
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    const HMAP_anon_type    
+                      * key         /* hash map entry key               */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entry;
+hmap_map_type         * map;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj  == HMAP_INVALID_POINTER 
+ || key  == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_BOOL_FALSE );
+    } 
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Get the private hash map data.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+
+/*-------------------------------------------------------------
+Get the entry associated with the key.
+-------------------------------------------------------------*/
+lock_map( map, HMAP_BOOL_FALSE );
+entry = lookup_entry( map, key, map->hash( key ) );
+unlock_map( map, HMAP_BOOL_FALSE );
+
+/*-------------------------------------------------------------
+Verify a valid entry was found.
+-------------------------------------------------------------*/
+return( entry != HMAP_INVALID_POINTER );
+
+}   /* HMAP_key_in_map() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_load
+ *
+ *  Description:
+ *      Create a hash map from a snapshot written by HMAP_save. The
+ *      table is sized for the snapshot's entry count. Blocks are read in
+ *      groups, each group is decompressed as one parallel job, and the
+ *      entries are then inserted in order. With the snapshot's submit
+ *      and wait hooks, the next group is read while one is inserted.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_load
+    (
+    HMAP_def_type     * hmap_def,   /* hash map definition              */
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to load                 */
+    HMAP_obj_type     * out_obj     /* out: hash map object             */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            block_count;
+unsigned int            current;
+HMAP_def_type           def;
+unsigned int            entry_count;
+unsigned char           header[ HMAP_SNAPSHOT_HEADER_SIZE ];
+unsigned int            i;
+hmap_snapshot_index_type
+                      * index;
+hmap_map_type         * map;
+unsigned int            next_block;
+HMAP_status_t8          status;
+hmap_snapshot_wave_type
+                      * wave;
+hmap_snapshot_wave_type
+                      * waves[ 2 ];
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( hmap_def == HMAP_INVALID_POINTER
+ || snapshot == HMAP_INVALID_POINTER
+ || out_obj  == HMAP_INVALID_POINTER
+ || snapshot->read == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+if( hmap_def->malloc == HMAP_INVALID_POINTER
+ || hmap_def->free   == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+out_obj->data = HMAP_INVALID_POINTER;
+def = *hmap_def;
+
+/*-------------------------------------------------------------
+Verify the header. The snapshot must have been written with
+the same hash algorithm, as the entries carry their hashes.
+-------------------------------------------------------------*/
+if( !read_snapshot( snapshot, 0, header, sizeof( header ) ) )
+    {
+    return( HMAP_STATUS_IO_ERROR );
+    }
+
+if( decode_u32( header ) != HMAP_SNAPSHOT_MAGIC
+ || header[ 4 ] != HMAP_SNAPSHOT_VERSION )
+    {
+    return( HMAP_STATUS_CORRUPT_DATA );
+    }
+
+if( header[ 5 ] != def.hash_type )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+Read the block index.
+-------------------------------------------------------------*/
+status = read_snapshot_index( snapshot, def.malloc, def.free, &index, &block_count, &entry_count );
+if( status != HMAP_STATUS_SUCCESS )
+    {
+    return( status );
+    }
+
+/*-------------------------------------------------------------
+Create the map with a bucket per entry.
+-------------------------------------------------------------*/
+if( def.map_size < entry_count )
+    {
+    def.map_size = entry_count;
+    }
+
+status = HMAP_create( &def, out_obj );
+if( status != HMAP_STATUS_SUCCESS )
+    {
+    def.free( index );
+    return( status );
+    }
+map = (hmap_map_type *)out_obj->data;
+
+waves[ 0 ] = create_snapshot_wave( map );
+waves[ 1 ] = waves[ 0 ];
+if( waves[ 0 ] != HMAP_INVALID_POINTER
+ && snapshot->submit != HMAP_INVALID_POINTER
+ && snapshot->wait   != HMAP_INVALID_POINTER )
+    {
+    waves[ 1 ] = create_snapshot_wave( map );
+    if( waves[ 1 ] == HMAP_INVALID_POINTER )
+        {
+        destroy_snapshot_wave( map, waves[ 0 ] );
+        waves[ 0 ] = HMAP_INVALID_POINTER;
+        }
+    }
+
+if( waves[ 0 ] == HMAP_INVALID_POINTER )
+    {
+    def.free( index );
+    HMAP_destroy( out_obj );
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+
+/*-------------------------------------------------------------
+Load the blocks a wave at a time. With submit and wait, the
+next wave is read into the other wave's buffers while this one
+is decompressed and inserted.
+-------------------------------------------------------------*/
+next_block = 0;
+current = 0;
+status = read_snapshot_wave( map, snapshot, waves[ 0 ], 0, index, block_count, &next_block );
+while( status == HMAP_STATUS_SUCCESS
+    && waves[ current ]->count > 0 )
+    {
+    wave = waves[ current ];
+    if( waves[ 1 ] != waves[ 0 ] )
+        {
+        status = read_snapshot_wave( map, snapshot, waves[ 1 - current ], ( 1 - current ) * HMAP_SNAPSHOT_WAVE,
+                                     index, block_count, &next_block );
+        }
+
+    /*---------------------------------------------------------
+    Decompress the wave once it has arrived, then insert its
+    entries.
+    ---------------------------------------------------------*/
+    if( status == HMAP_STATUS_SUCCESS )
+        {
+        status = wait_snapshot_wave( snapshot, wave, current * HMAP_SNAPSHOT_WAVE );
+        }
+
+    if( status == HMAP_STATUS_SUCCESS )
+        {
+        run_snapshot_wave( snapshot, wave, decompress_task );
+        }
+
+    for( i = 0; i < wave->count && status == HMAP_STATUS_SUCCESS; i++ )
+        {
+        status = wave->blocks[ i ].status;
+        if( status == HMAP_STATUS_SUCCESS )
+            {
+            status = load_snapshot_block( map, &wave->blocks[ i ] );
+            }
+        }
+
+    /*---------------------------------------------------------
+    Move on to the wave being read, or read the next one into
+    this wave.
+    ---------------------------------------------------------*/
+    if( waves[ 1 ] != waves[ 0 ] )
+        {
+        current = 1 - current;
+        }
+    else if( status == HMAP_STATUS_SUCCESS )
+        {
+        status = read_snapshot_wave( map, snapshot, wave, 0, index, block_count, &next_block );
+        }
+    }
+
+/*-------------------------------------------------------------
+Clean up, waiting for reads still in flight after an error and
+discarding a partially loaded map.
+-------------------------------------------------------------*/
+for( i = 0; i < 2; i++ )
+    {
+    wait_snapshot_wave( snapshot, waves[ i ], i * HMAP_SNAPSHOT_WAVE );
+    }
+
+destroy_snapshot_wave( map, waves[ 0 ] );
+if( waves[ 1 ] != waves[ 0 ] )
+    {
+    destroy_snapshot_wave( map, waves[ 1 ] );
+    }
+def.free( index );
+
+if( status != HMAP_STATUS_SUCCESS )
+    {
+    HMAP_destroy( out_obj );
+    }
+
+return( status );
+
+}   /* HMAP_load() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_log_commit
+ *
+ *  Description:
+ *      Write all buffered log records and sync the log, regardless of
+ *      the log's sync policy. A failed log can not be committed.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_log_commit
+    (
+    HMAP_obj_type     * obj         /* hash map object                  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_map_type         * map;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Resolve the map structure.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+
+/*-------------------------------------------------------------
+Maps without a log have nothing to commit.
+-------------------------------------------------------------*/
+if( map->log == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_SUCCESS );
+    }
+
+/*-------------------------------------------------------------
+Write and sync the current group.
+-------------------------------------------------------------*/
+if( map->log->failed
+ || !flush_log( map->log, HMAP_BOOL_TRUE ) )
+    {
+    return( HMAP_STATUS_IO_ERROR );
+    }
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_log_commit() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_next_value
+ *
+ *  Description:
+ *      Get the next value from an iterator returned by HMAP_get_values.
+ *      value receives the address of the value in the map. Returns
+ *      HMAP_BOOL_FALSE when there are no more values.
+ *
+ ************************************************************************/
+HMAP_bool_t8 HMAP_next_value
+    (
+    HMAP_values_type  * values,     /* iterator over values             */
+    HMAP_anon_type    * value       /* out: next value                  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            size;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( values == HMAP_INVALID_POINTER
+ || value  == HMAP_INVALID_POINTER
+ || values->next >= values->end )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Each value is its size, as a varint, followed by its bytes.
+-------------------------------------------------------------*/
+size = decode_varint( values->next, (unsigned int)( values->end - values->next ), &value->size );
+value->ptr = (void *)( values->next + size );
+values->next += size + value->size;
+
+return( HMAP_BOOL_TRUE );
+
+}   /* HMAP_next_value() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_remove_entry
+ *
+ *  Description:
+ *      Remove the entry for the given key from the map.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_remove_entry
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    const HMAP_anon_type    
+                      * key         /* hashmap entry key                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+HMAP_hash_val_type      key_hash;
+hmap_map_type         * map;
+HMAP_status_t8          status;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj  == HMAP_INVALID_POINTER 
+ || key  == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    } 
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Resolve the map structure.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+status = HMAP_STATUS_SUCCESS;
+lock_map( map, HMAP_BOOL_TRUE );
+
+/*-------------------------------------------------------------
+Remove the matching entry from the map and log the removal if
+there was one.
+-------------------------------------------------------------*/
+key_hash = map->hash( key );
+if( remove_entry( map, key, key_hash )
+ && map->log != HMAP_INVALID_POINTER )
+    {
+    status = log_mutation( map, HMAP_LOG_RECORD_REMOVE, key_hash, key, HMAP_INVALID_POINTER );
+    }
+
+unlock_map( map, HMAP_BOOL_TRUE );
+return( status );
+
+}   /* HMAP_remove_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_remove_value
+ *
+ *  Description:
+ *      Remove the first value equal to the given one from the value
+ *      list of a key in a multimap. The key's entry is removed with its
+ *      last value.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_remove_value
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_anon_type
+                const * value       /* value to remove                  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            count;
+hmap_entry_type       * entry;
+unsigned int            i;
+HMAP_hash_val_type      key_hash;
+unsigned int            length;
+unsigned char         * list;
+hmap_map_type         * map;
+unsigned int            position;
+unsigned int            record_size;
+unsigned int            size;
+HMAP_anon_type          stored;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj   == HMAP_INVALID_POINTER
+ || key   == HMAP_INVALID_POINTER
+ || value == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+if( map->table->multimap == HMAP_BOOL_FALSE )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+lock_map( map, HMAP_BOOL_TRUE );
+
+/*-------------------------------------------------------------
+Get the entry associated with the key.
+-------------------------------------------------------------*/
+key_hash = map->hash( key );
+entry = get_entry_by_key( map, key, key_hash );
+if( entry == HMAP_INVALID_POINTER )
+    {
+    unlock_map( map, HMAP_BOOL_TRUE );
+    return( HMAP_STATUS_KEY_NOT_IN_MAP );
+    }
+
+/*-------------------------------------------------------------
+Find the value.
+-------------------------------------------------------------*/
+list = get_blob_bytes( map, &entry->data );
+count = decode_u32( &list[ 0 ] );
+length = decode_u32( &list[ 4 ] );
+position = HMAP_VALUES_HEADER_SIZE;
+record_size = 0;
+while( position < length )
+    {
+    size = decode_varint( &list[ position ], length - position, &stored.size );
+    stored.ptr = &list[ position + size ];
+    record_size = size + stored.size;
+    if( anon_data_match( &stored, value ) )
+        {
+        break;
+        }
+    position += record_size;
+    }
+
+if( position >= length )
+    {
+    unlock_map( map, HMAP_BOOL_TRUE );
+    return( HMAP_STATUS_KEY_NOT_IN_MAP );
+    }
+
+/*-------------------------------------------------------------
+Remove the key with its last value, or close the gap left by
+the value.
+-------------------------------------------------------------*/
+if( count == 1 )
+    {
+    remove_entry( map, key, key_hash );
+    }
+else
+    {
+    preserve_entry( map, entry );
+    for( i = position; i + record_size < length; i++ )
+        {
+        list[ i ] = list[ i + record_size ];
+        }
+    encode_u32( &list[ 0 ], count - 1 );
+    encode_u32( &list[ 4 ], length - record_size );
+    }
+
+unlock_map( map, HMAP_BOOL_TRUE );
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_remove_value() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_replay
+ *
+ *  Description:
+ *      Create a hash map from a mutation log. The log is read twice:
+ *      first to size the table for the number of keys it can hold,
+ *      then to apply its records. Reading stops at the first torn or
+ *      corrupt record, as left by a crash, and log_size receives the
+ *      size of the valid portion of the log. If the definition has a
+ *      log, it is attached once the map is rebuilt, so the log can be
+ *      truncated to log_size and appended to.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_replay
+    (
+    HMAP_def_type     * hmap_def,   /* hash map definition              */
+    void              * context,    /* caller's log stream              */
+    HMAP_read_fptr      read,       /* log reader                       */
+    HMAP_obj_type     * out_obj,    /* out: hash map object             */
+    unsigned long long* log_size    /* out: size of valid log, or NULL  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+HMAP_anon_type          data;
+HMAP_def_type           def;
+HMAP_anon_type          key;
+HMAP_hash_val_type      key_hash;
+hmap_map_type         * map;
+unsigned int            pass;
+hmap_log_reader_type    reader;
+unsigned char           record_type;
+unsigned int            set_count;
+HMAP_status_t8          status;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( hmap_def == HMAP_INVALID_POINTER
+ || read     == HMAP_INVALID_POINTER
+ || out_obj  == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables. The map is built without a log so the
+replayed records are not logged again.
+-------------------------------------------------------------*/
+def = *hmap_def;
+def.log = HMAP_INVALID_POINTER;
+out_obj->data = HMAP_INVALID_POINTER;
+map = HMAP_INVALID_POINTER;
+set_count = 0;
+status = HMAP_STATUS_SUCCESS;
+
+if( def.malloc == HMAP_INVALID_POINTER
+ || def.free   == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+Pass 0 counts the set records, an upper bound on the number
+of keys, and creates the map with a bucket per key. Pass 1
+applies the records.
+-------------------------------------------------------------*/
+for( pass = 0; pass < 2 && status == HMAP_STATUS_SUCCESS; pass++ )
+    {
+    reader.context = context;
+    reader.read = read;
+    reader.malloc = def.malloc;
+    reader.free = def.free;
+    reader.offset = 0;
+    reader.valid_size = 0;
+    reader.buffer = HMAP_INVALID_POINTER;
+    reader.buffer_size = 0;
+    reader.length = 0;
+    reader.position = 0;
+    reader.status = HMAP_STATUS_SUCCESS;
+
+    while( status == HMAP_STATUS_SUCCESS
+        && read_log_record( &reader, &record_type, &key_hash, &key, &data ) )
+        {
+        switch( record_type )
+            {
+            case HMAP_LOG_RECORD_HEADER:
+                /*---------------------------------------------
+                The log must have been written with the same
+                hash algorithm, as the records carry hashes.
+                ---------------------------------------------*/
+                if( key_hash != def.hash_type )
+                    {
+                    status = HMAP_STATUS_INVALID_DEF;
+                    }
+                break;
+
+            case HMAP_LOG_RECORD_SET:
+                if( pass == 0 )
+                    {
+                    set_count++;
+                    }
+                else
+                    {
+                    status = set_entry_data( map, &key, key_hash, &data );
+                    }
+                break;
+
+            case HMAP_LOG_RECORD_REMOVE:
+                if( pass != 0 )
+                    {
+                    remove_entry( map, &key, key_hash );
+                    }
+                break;
+
+            default:
+                break;
+            }
+        }
+
+    if( reader.status != HMAP_STATUS_SUCCESS )
+        {
+        status = reader.status;
+        }
+    if( reader.buffer != HMAP_INVALID_POINTER )
+        {
+        reader.free( reader.buffer );
+        }
+
+    /*---------------------------------------------------------
+    Create the map, sized for the keys found in the log.
+    ---------------------------------------------------------*/
+    if( pass == 0
+     && status == HMAP_STATUS_SUCCESS )
+        {
+        if( def.map_size < set_count )
+            {
+            def.map_size = set_count;
+            }
+        status = HMAP_create( &def, out_obj );
+        map = (hmap_map_type *)out_obj->data;
+        }
+    }
+
+/*-------------------------------------------------------------
+Attach the definition's log to the rebuilt map.
+-------------------------------------------------------------*/
+if( status == HMAP_STATUS_SUCCESS
+ && hmap_def->log != HMAP_INVALID_POINTER )
+    {
+    status = create_log( map, hmap_def->log );
+    }
+
+/*-------------------------------------------------------------
+Discard a partially rebuilt map.
+-------------------------------------------------------------*/
+if( status != HMAP_STATUS_SUCCESS )
+    {
+    if( map != HMAP_INVALID_POINTER )
+        {
+        HMAP_destroy( out_obj );
+        }
+    return( status );
+    }
+
+if( log_size != HMAP_INVALID_POINTER )
+    {
+    *log_size = reader.valid_size;
+    }
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_replay() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_save
+ *
+ *  Description:
+ *      Write a snapshot of the map. Entries are packed into blocks of
+ *      about the snapshot's block size; each group of blocks is
+ *      compressed as one parallel job and written in order, followed
+ *      by the block index and a trailer locating it.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_save
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_snapshot_def_type
+                      * snapshot    /* snapshot to write                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_snapshot_block_type
+                      * block;
+unsigned int            block_size;
+hmap_entry_type       * entry;
+unsigned char           header[ HMAP_SNAPSHOT_HEADER_SIZE ];
+hmap_snapshot_index_type
+                      * index;
+unsigned int            index_capacity;
+unsigned int            index_count;
+hmap_iterator_type      iterator;
+hmap_map_type         * map;
+unsigned long long      offset;
+HMAP_status_t8          status;
+hmap_snapshot_wave_type
+                      * wave;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj      == HMAP_INVALID_POINTER
+ || snapshot == HMAP_INVALID_POINTER
+ || snapshot->write == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+block_size = snapshot->block_size;
+if( block_size == 0 )
+    {
+    block_size = HMAP_SNAPSHOT_BLOCK_SIZE;
+    }
+index = HMAP_INVALID_POINTER;
+index_capacity = 0;
+index_count = 0;
+status = HMAP_STATUS_SUCCESS;
+
+wave = create_snapshot_wave( map );
+if( wave == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+
+lock_map( map, HMAP_BOOL_FALSE );
+
+/*-------------------------------------------------------------
+Write the header.
+-------------------------------------------------------------*/
+encode_u32( header, HMAP_SNAPSHOT_MAGIC );
+header[ 4 ] = HMAP_SNAPSHOT_VERSION;
+header[ 5 ] = map->table->hash_type;
+header[ 6 ] = 0;
+header[ 7 ] = 0;
+offset = sizeof( header );
+if( !snapshot->write( snapshot->context, header, sizeof( header ) ) )
+    {
+    status = HMAP_STATUS_IO_ERROR;
+    }
+
+/*-------------------------------------------------------------
+Pack the entries into blocks, saving each full wave.
+-------------------------------------------------------------*/
+iterator.bucket = 0;
+iterator.entry = HMAP_INVALID_REF;
+entry = next_entry( map, &iterator );
+while( entry != HMAP_INVALID_POINTER
+    && status == HMAP_STATUS_SUCCESS )
+    {
+    block = &wave->blocks[ wave->count ];
+    if( !pack_snapshot_entry( map, block, entry ) )
+        {
+        status = HMAP_STATUS_OUT_OF_MEMORY;
+        break;
+        }
+
+    if( block->index.raw_size >= block_size )
+        {
+        wave->count++;
+        if( wave->count == HMAP_SNAPSHOT_WAVE )
+            {
+            status = save_snapshot_wave( map, snapshot, wave, &index, &index_capacity, &index_count, &offset );
+            }
+        }
+
+    entry = next_entry( map, &iterator );
+    }
+
+/*-------------------------------------------------------------
+Save the last, partial wave.
+-------------------------------------------------------------*/
+if( status == HMAP_STATUS_SUCCESS )
+    {
+    if( wave->blocks[ wave->count ].index.entry_count > 0 )
+        {
+        wave->count++;
+        }
+    status = save_snapshot_wave( map, snapshot, wave, &index, &index_capacity, &index_count, &offset );
+    }
+
+unlock_map( map, HMAP_BOOL_FALSE );
+
+/*-------------------------------------------------------------
+Write the block index and trailer.
+-------------------------------------------------------------*/
+if( status == HMAP_STATUS_SUCCESS )
+    {
+    status = save_snapshot_index( map, snapshot, index, index_count, offset );
+    }
+
+/*-------------------------------------------------------------
+Clean up.
+-------------------------------------------------------------*/
+destroy_snapshot_wave( map, wave );
+if( index != HMAP_INVALID_POINTER )
+    {
+    map->free( index );
+    }
+
+return( status );
+
+}   /* HMAP_save() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_save_async
+ *
+ *  Description:
+ *      Start saving a snapshot of the map as it is now, without
+ *      stopping changes to it. The work is done by calls to
+ *      HMAP_save_step, which report the result to the snapshot's done
+ *      hook. Until then, an entry is packed before it is first changed,
+ *      removed or moved, so the snapshot holds the entries as they
+ *      were when the save started. Entries packed that way may be out
+ *      of insertion order. Shared maps can not be saved this way.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_save_async
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_snapshot_def_type
+                      * snapshot    /* snapshot to write                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char           header[ HMAP_SNAPSHOT_HEADER_SIZE ];
+hmap_map_type         * map;
+hmap_save_type        * save;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj      == HMAP_INVALID_POINTER
+ || snapshot == HMAP_INVALID_POINTER
+ || snapshot->write == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Other processes can not pack the entries they change, so only
+heap maps are saved in steps, one save at a time.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+if( map->region != HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+if( map->save != HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_BUSY );
+    }
+
+/*-------------------------------------------------------------
+Allocate the save.
+-------------------------------------------------------------*/
+save = map->malloc( sizeof(*save) );
+if( save == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+
+save->wave = create_snapshot_wave( map );
+if( save->wave == HMAP_INVALID_POINTER )
+    {
+    map->free( save );
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+
+save->snapshot = snapshot;
+save->index = HMAP_INVALID_POINTER;
+save->index_capacity = 0;
+save->index_count = 0;
+save->block_size = snapshot->block_size;
+if( save->block_size == 0 )
+    {
+    save->block_size = HMAP_SNAPSHOT_BLOCK_SIZE;
+    }
+save->iterator.bucket = 0;
+save->iterator.entry = HMAP_INVALID_REF;
+save->status = HMAP_STATUS_SUCCESS;
+
+/*-------------------------------------------------------------
+Write the header.
+-------------------------------------------------------------*/
+encode_u32( header, HMAP_SNAPSHOT_MAGIC );
+header[ 4 ] = HMAP_SNAPSHOT_VERSION;
+header[ 5 ] = map->table->hash_type;
+header[ 6 ] = 0;
+header[ 7 ] = 0;
+save->offset = sizeof( header );
+if( !snapshot->write( snapshot->context, header, sizeof( header ) ) )
+    {
+    destroy_snapshot_wave( map, save->wave );
+    map->free( save );
+    return( HMAP_STATUS_IO_ERROR );
+    }
+
+/*-------------------------------------------------------------
+Start a new epoch, so every entry now in the map is yet to be
+packed.
+-------------------------------------------------------------*/
+map->table->save_epoch++;
+map->save = save;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_save_async() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_save_step
+ *
+ *  Description:
+ *      Do the next part of the save started by HMAP_save_async: write
+ *      the blocks filled since the last step, then pack up to budget
+ *      more entries. The step that finishes the save, or fails it,
+ *      reports the result to the snapshot's done hook. Call between
+ *      other uses of the map until the save is done.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_save_step
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned int        budget      /* num entries to scan              */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            count;
+hmap_entry_type       * entry;
+HMAP_bool_t8            finished;
+hmap_map_type         * map;
+hmap_save_type        * save;
+HMAP_status_t8          status;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Verify a save is in progress.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+save = map->save;
+if( save == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Write the blocks filled since the last step.
+-------------------------------------------------------------*/
+if( save->status == HMAP_STATUS_SUCCESS )
+    {
+    flush_save( map, HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Pack the next entries of the scan. Buckets of chained maps are
+finished within the step, as the entries of an unfinished one
+could be removed before the next.
+-------------------------------------------------------------*/
+count = 0;
+finished = HMAP_BOOL_FALSE;
+while( save->status == HMAP_STATUS_SUCCESS
+    && !finished
+    && ( count < budget
+      || save->iterator.entry != HMAP_INVALID_REF ) )
+    {
+    entry = next_entry( map, &save->iterator );
+    if( entry == HMAP_INVALID_POINTER )
+        {
+        finished = HMAP_BOOL_TRUE;
+        }
+    else
+        {
+        preserve_entry( map, entry );
+        count++;
+        }
+    }
+
+/*-------------------------------------------------------------
+Keep going until the scan is done, then write the rest of the
+blocks, the index and the trailer.
+-------------------------------------------------------------*/
+if( save->status == HMAP_STATUS_SUCCESS
+ && !finished )
+    {
+    return( HMAP_STATUS_SUCCESS );
+    }
+
+if( save->status == HMAP_STATUS_SUCCESS )
+    {
+    flush_save( map, HMAP_BOOL_TRUE );
+    }
+
+if( save->status == HMAP_STATUS_SUCCESS )
+    {
+    save->status = save_snapshot_index( map, save->snapshot, save->index, save->index_count, save->offset );
+    }
+
+status = save->status;
+end_save( map, status );
+
+return( status );
+
+}   /* HMAP_save_step() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_set_data
+ *
+ *  Description:
+ *      Set the data associated with the key. If an entry for the key does
+ *      not already exist, an entry will be created.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_set_data
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    const HMAP_anon_type    
+                      * key,        /* hashmap entry key                */
+    const HMAP_anon_type    
+                      * data        /* entry data                       */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+HMAP_hash_val_type      key_hash;
+hmap_map_type         * map;
+HMAP_status_t8          status;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj  == HMAP_INVALID_POINTER 
+ || key  == HMAP_INVALID_POINTER
+ || data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    } 
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Initialize variables. Multimap values are set with
+HMAP_add_value.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+if( map->table->multimap != HMAP_BOOL_FALSE )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+lock_map( map, HMAP_BOOL_TRUE );
+
+/*-------------------------------------------------------------
+Set the entry data and log the mutation.
+-------------------------------------------------------------*/
+key_hash = map->hash( key );
+status = set_entry_data( map, key, key_hash, data );
+if( status == HMAP_STATUS_SUCCESS
+ && map->log != HMAP_INVALID_POINTER )
+    {
+    status = log_mutation( map, HMAP_LOG_RECORD_SET, key_hash, key, data );
+    }
+
+unlock_map( map, HMAP_BOOL_TRUE );
+return( status );
+
+}   /* HMAP_set_data() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_spill_compact
+ *
+ *  Description:
+ *      Start moving the live spilled data to a new spill file, which
+ *      also takes over the memory limit. From now on data is spilled
+ *      to the new file. The data still in the old file is moved by
+ *      calls to HMAP_spill_compact_step, after which the old file is
+ *      no longer read and may be deleted.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_spill_compact
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_spill_def_type
+                      * spill_def   /* new spill file                   */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_map_type         * map;
+hmap_spill_type       * spill;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj       == HMAP_INVALID_POINTER
+ || spill_def == HMAP_INVALID_POINTER
+ || spill_def->write == HMAP_INVALID_POINTER
+ || spill_def->read  == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Verify the map spills, one compaction at a time.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+spill = map->spill;
+if( spill == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+if( spill->compacting )
+    {
+    return( HMAP_STATUS_BUSY );
+    }
+
+/*-------------------------------------------------------------
+Switch to the new file. The other file slot is free, as the
+last compaction emptied it.
+-------------------------------------------------------------*/
+spill->current = 1 - spill->current;
+spill->files[ spill->current ] = *spill_def;
+spill->file_size[ spill->current ] = 0;
+spill->live_size[ spill->current ] = 0;
+spill->failed = HMAP_BOOL_FALSE;
+spill->compacting = HMAP_BOOL_TRUE;
+spill->iterator.bucket = 0;
+spill->iterator.entry = HMAP_INVALID_REF;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_spill_compact() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      HMAP_spill_compact_step
+ *
+ *  Description:
+ *      Move the data of the next entries still spilled to the old
+ *      file into the new one, scanning up to budget entries. done is
+ *      set once no data is left in the old file. The scan starts
+ *      over if it ends with data left, as entries may have been
+ *      rearranged behind it.
+ *
+ ************************************************************************/
+HMAP_status_t8 HMAP_spill_compact_step
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned int        budget,     /* num entries to scan              */
+    HMAP_bool_t8      * done        /* out: old spill file is unused    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+void                  * bytes;
+unsigned int            count;
+hmap_entry_type       * entry;
+hmap_map_type         * map;
+unsigned int            old;
+hmap_spill_type       * spill;
+
+/*-------------------------------------------------------------
+Verify inputs are not HMAP_INVALID_POINTER.
+-------------------------------------------------------------*/
+if( obj  == HMAP_INVALID_POINTER
+ || done == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_ARG );
+    }
+
+/*-------------------------------------------------------------
+Verify interface object has been successfully initialized.
+-------------------------------------------------------------*/
+if( obj->data == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    }
+
+/*-------------------------------------------------------------
+Verify the map spills.
+-------------------------------------------------------------*/
+map = (hmap_map_type *)obj->data;
+spill = map->spill;
+if( spill == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+*done = HMAP_BOOL_FALSE;
+if( spill->failed )
+    {
+    return( HMAP_STATUS_IO_ERROR );
+    }
+
+/*-------------------------------------------------------------
+Move the data of the next entries. Buckets of chained maps are
+finished within the step, as the entries of an unfinished one
+could be removed before the next.
+-------------------------------------------------------------*/
+old = 1 - spill->current;
+count = 0;
+while( spill->compacting
+    && spill->live_size[ old ] > 0
+    && ( count < budget
+      || spill->iterator.entry != HMAP_INVALID_REF ) )
+    {
+    count++;
+    entry = next_entry( map, &spill->iterator );
+    if( entry == HMAP_INVALID_POINTER )
+        {
+        spill->iterator.bucket = 0;
+        continue;
+        }
+
+    if( ( entry->flags & HMAP_ENTRY_SPILLED ) == 0
+     || get_spill_file( entry ) != old )
+        {
+        continue;
+        }
+
+    bytes = get_entry_data( map, entry );
+    if( bytes == HMAP_INVALID_POINTER )
+        {
+        spill->iterator.entry = HMAP_INVALID_REF;
+        return( HMAP_STATUS_IO_ERROR );
+        }
+
+    if( !append_spill( map, entry, bytes ) )
+        {
+        spill->iterator.entry = HMAP_INVALID_REF;
+        return( HMAP_STATUS_IO_ERROR );
+        }
+    spill->live_size[ old ] -= entry->data.size;
+    }
+
+/*-------------------------------------------------------------
+The old file is done with once none of its data is in use.
+-------------------------------------------------------------*/
+if( spill->live_size[ old ] == 0 )
+    {
+    spill->file_size[ old ] = 0;
+    spill->compacting = HMAP_BOOL_FALSE;
+    spill->iterator.entry = HMAP_INVALID_REF;
+    *done = HMAP_BOOL_TRUE;
+    }
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* HMAP_spill_compact_step() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      acquire_prefix
+ *
+ *  Description:
+ *      Get a reference to the shared prefix holding the given bytes,
+ *      adding the prefix if the map does not have it yet, and count
+ *      the new user of the prefix.
+ *
+ ************************************************************************/
+static HMAP_status_t8 acquire_prefix
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * bytes,      /* prefix bytes                     */
+    hmap_ref_type     * out_ref     /* out: reference to prefix         */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_ref_type         * buckets;
+HMAP_hash_val_type      hash;
+unsigned int            i;
+hmap_ref_type           next;
+hmap_prefix_type      * prefix;
+HMAP_anon_type          prefix_bytes;
+hmap_ref_type           prefix_ref;
+unsigned int            prefixes_len;
+hmap_ref_type         * resized;
+
+/*-------------------------------------------------------------
+Look for the prefix in its bucket.
+-------------------------------------------------------------*/
+hash = map->hash( bytes );
+buckets = ref_to_ptr( map, map->table->prefixes );
+if( map->table->prefixes_len > 0 )
+    {
+    prefix_ref = buckets[ hash % map->table->prefixes_len ];
+    while( prefix_ref != HMAP_INVALID_REF )
+        {
+        prefix = ref_to_ptr( map, prefix_ref );
+        prefix_bytes.ptr = prefix + 1;
+        prefix_bytes.size = prefix->size;
+        if( prefix->hash == hash
+         && map->match( &prefix_bytes, bytes ) )
+            {
+            prefix->refs++;
+            *out_ref = prefix_ref;
+            return( HMAP_STATUS_SUCCESS );
+            }
+        prefix_ref = prefix->next;
+        }
+    }
+
+/*-------------------------------------------------------------
+Keep the prefix table at no more than one prefix per bucket,
+doubling it and moving the prefixes over when it fills up.
+-------------------------------------------------------------*/
+if( map->table->prefix_count >= map->table->prefixes_len )
+    {
+    prefixes_len = map->table->prefixes_len * 2;
+    if( prefixes_len < HMAP_PREFIX_TABLE_MIN )
+        {
+        prefixes_len = HMAP_PREFIX_TABLE_MIN;
+        }
+
+    if( !reserve_memory( map, HMAP_INVALID_POINTER,
+                         sizeof(*resized) * (unsigned long long)( prefixes_len - map->table->prefixes_len ) ) )
+        {
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
+    resized = alloc_memory( map, (unsigned long long)prefixes_len * sizeof(*resized) );
+    if( resized == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
+    for( i = 0; i < prefixes_len; i++ )
+        {
+        resized[ i ] = HMAP_INVALID_REF;
+        }
+
+    for( i = 0; i < map->table->prefixes_len; i++ )
+        {
+        prefix_ref = buckets[ i ];
+        while( prefix_ref != HMAP_INVALID_REF )
+            {
+            prefix = ref_to_ptr( map, prefix_ref );
+            next = prefix->next;
+            prefix->next = resized[ prefix->hash % prefixes_len ];
+            resized[ prefix->hash % prefixes_len ] = prefix_ref;
+            prefix_ref = next;
+            }
+        }
+
+    if( map->table->prefixes_len > 0 )
+        {
+        free_memory( map, buckets );
+        }
+    map->table->size -= sizeof(*buckets) * map->table->prefixes_len;
+    map->table->size += sizeof(*buckets) * prefixes_len;
+    map->table->prefixes = ptr_to_ref( map, resized );
+    map->table->prefixes_len = prefixes_len;
+    buckets = resized;
+    }
+
+/*-------------------------------------------------------------
+Add the new prefix to its bucket.
+-------------------------------------------------------------*/
+if( !reserve_memory( map, HMAP_INVALID_POINTER, sizeof(*prefix) + bytes->size ) )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+prefix = alloc_memory( map, sizeof(*prefix) + bytes->size );
+if( prefix == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+prefix_bytes.ptr = prefix + 1;
+copy_anon_data( &prefix_bytes, bytes );
+prefix->hash = hash;
+prefix->refs = 1;
+prefix->size = bytes->size;
+prefix->next = buckets[ hash % map->table->prefixes_len ];
+buckets[ hash % map->table->prefixes_len ] = ptr_to_ref( map, prefix );
+
+map->table->prefix_count++;
+map->table->size += sizeof(*prefix) + bytes->size;
+
+*out_ref = ptr_to_ref( map, prefix );
+return( HMAP_STATUS_SUCCESS );
+
+}   /* acquire_prefix() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      alloc_blob
+ *
+ *  Description:
+ *      Define an uninitialized block of size bytes, allocating it from
+ *      the map if it is too large to be stored inline. Returns
+ *      HMAP_BOOL_FALSE if memory for the block could not be allocated.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 alloc_blob
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_blob_type    * blob,       /* out: block                       */
+    unsigned int        size        /* num bytes in block               */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+void                  * bytes;
+
+/*-------------------------------------------------------------
+Small blocks need no memory of their own.
+-------------------------------------------------------------*/
+if( size <= HMAP_INLINE_SIZE )
+    {
+    blob->size = size;
+    return( HMAP_BOOL_TRUE );
+    }
+
+/*-------------------------------------------------------------
+Allocate larger blocks from the map. The block is left as is
+if the allocation fails.
+-------------------------------------------------------------*/
+bytes = alloc_memory( map, size );
+if( bytes == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+blob->storage.ref = ptr_to_ref( map, bytes );
+blob->size = size;
+
+return( HMAP_BOOL_TRUE );
+
+}   /* alloc_blob() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      alloc_data_blob
+ *
+ *  Description:
+ *      Allocate a block for entry data. Maps with value segments
+ *      append it to the current segment, or give it an allocation of
+ *      its own if it would take more than a quarter of a segment.
+ *      Returns HMAP_BOOL_FALSE if memory could not be allocated,
+ *      leaving the block as is.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 alloc_data_blob
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_blob_type    * blob,       /* out: block                       */
+    unsigned int        size        /* num bytes in block               */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_value_header_type* header;
+unsigned long long      needed;
+
+/*-------------------------------------------------------------
+Without segments, and for inline blocks, this is any block.
+-------------------------------------------------------------*/
+if( map->segments == HMAP_INVALID_POINTER
+ || size <= HMAP_INLINE_SIZE )
+    {
+    return( alloc_blob( map, blob, size ) );
+    }
+
+/*-------------------------------------------------------------
+Place the block after its header.
+-------------------------------------------------------------*/
+needed = ( sizeof(*header) + (unsigned long long)size + HMAP_SEGMENT_ALIGN - 1 )
+       & ~(unsigned long long)( HMAP_SEGMENT_ALIGN - 1 );
+if( needed > map->segments->segment_size / 4 )
+    {
+    header = alloc_memory( map, needed );
+    if( header == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    header->segment = HMAP_SEGMENT_NONE;
+    header->size = (unsigned int)needed;
+    }
+else
+    {
+    header = append_segment( map, (unsigned int)needed );
+    if( header == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    }
+
+blob->storage.ref = ptr_to_ref( map, header + 1 );
+blob->size = size;
+
+return( HMAP_BOOL_TRUE );
+
+}   /* alloc_data_blob() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      alloc_dense_entry
+ *
+ *  Description:
+ *      Take the next record of a dense map's entry array for a new
+ *      entry, resizing the array if it is full. Returns
+ *      HMAP_INVALID_POINTER if memory could not be allocated.
+ *
+ ************************************************************************/
+static hmap_entry_type * alloc_dense_entry
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entries;
+
+/*-------------------------------------------------------------
+Make room for the record.
+-------------------------------------------------------------*/
+if( map->table->entries_len == map->table->entries_capacity
+ && !resize_dense( map ) )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+/*-------------------------------------------------------------
+Hand out the record. Its bytes are counted in the entry's size
+from now on rather than as unused capacity.
+-------------------------------------------------------------*/
+entries = ref_to_ptr( map, map->table->entries );
+map->table->size -= sizeof(*entries);
+
+return( &entries[ map->table->entries_len++ ] );
+
+}   /* alloc_dense_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      alloc_intern_bytes
+ *
+ *  Description:
+ *      Allocate bytes for an interned string from the table's arenas.
+ *      Strings too large to share an arena get an arena of their own.
+ *      Returns HMAP_INVALID_POINTER if memory could not be allocated.
+ *
+ ************************************************************************/
+static unsigned char * alloc_intern_bytes
+    (
+    hmap_intern_type  * intern,     /* interning table private data     */
+    unsigned long long  size        /* num bytes to allocate            */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_arena_type       * arena;
+unsigned long long      arena_size;
+
+/*-------------------------------------------------------------
+Use the current arena if the bytes fit.
+-------------------------------------------------------------*/
+arena = intern->arena;
+if( arena != HMAP_INVALID_POINTER
+ && arena->size - arena->used >= size )
+    {
+    arena->used += (unsigned int)size;
+    return( (unsigned char *)( arena + 1 ) + arena->used - size );
+    }
+
+/*-------------------------------------------------------------
+Allocate a new arena.
+-------------------------------------------------------------*/
+arena_size = HMAP_INTERN_ARENA_SIZE;
+if( size > HMAP_INTERN_ARENA_SIZE / 4 )
+    {
+    arena_size = size;
+    }
+if( arena_size > 0xFFFFFFFFu )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+arena = intern->malloc( sizeof(*arena) + arena_size );
+if( arena == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+arena->size = (unsigned int)arena_size;
+arena->used = (unsigned int)size;
+
+/*-------------------------------------------------------------
+A large string's own arena goes behind the current one, which
+keeps filling.
+-------------------------------------------------------------*/
+if( arena_size == size
+ && intern->arena != HMAP_INVALID_POINTER )
+    {
+    arena->next = intern->arena->next;
+    intern->arena->next = arena;
+    }
+else
+    {
+    arena->next = intern->arena;
+    intern->arena = arena;
+    }
+
+return( (unsigned char *)( arena + 1 ) );
+
+}   /* alloc_intern_bytes() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      alloc_memory
+ *
+ *  Description:
+ *      Allocate memory for the map. Returns HMAP_INVALID_POINTER if the
+ *      memory could not be allocated.
+ *
+ ************************************************************************/
+static void * alloc_memory
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned long long  size        /* num bytes to allocate            */
+    )
+{
+/*-------------------------------------------------------------
+Shared maps allocate from their region, all other maps use
+the provided allocator.
+-------------------------------------------------------------*/
+if( map->region != HMAP_INVALID_POINTER )
+    {
+    return( region_alloc( map, size ) );
+    }
+
+return( map->malloc( size ) );
+
+}   /* alloc_memory() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      alloc_slab_entry
+ *
+ *  Description:
+ *      Take a record of a chained map's entry slabs for a new entry,
+ *      reusing a freed record if there is one and allocating the next
+ *      slab when the last is full. Returns HMAP_INVALID_POINTER if
+ *      memory could not be allocated or every link is in use.
+ *
+ ************************************************************************/
+static hmap_entry_type * alloc_slab_entry
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entry;
+unsigned int            slab;
+void                  * slab_ptr;
+
+/*-------------------------------------------------------------
+Reuse the most recently freed record.
+-------------------------------------------------------------*/
+if( map->table->slab_free != HMAP_INVALID_LINK )
+    {
+    entry = link_to_ptr( map, map->table->slab_free );
+    map->table->slab_free = entry->next;
+    return( entry );
+    }
+
+/*-------------------------------------------------------------
+Allocate the slab of the next record if it is the first of its
+slab.
+-------------------------------------------------------------*/
+slab = get_slab( map->table->slab_len );
+if( slab >= HMAP_SLAB_COUNT )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+if( map->table->slabs[ slab ] == HMAP_INVALID_REF )
+    {
+    slab_ptr = alloc_memory( map, ( (unsigned long long)HMAP_SLAB_MIN << slab ) * get_record_size( map ) );
+    if( slab_ptr == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_INVALID_POINTER );
+        }
+    map->table->slabs[ slab ] = ptr_to_ref( map, slab_ptr );
+    }
+
+/*-------------------------------------------------------------
+Hand out the record.
+-------------------------------------------------------------*/
+map->table->slab_len++;
+
+return( link_to_ptr( map, map->table->slab_len ) );
+
+}   /* alloc_slab_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      anon_data_match
+ *
+ *  Description:
+ *      Returns true if the specified memory blocks match.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 anon_data_match
+    (
+    HMAP_anon_type    
+                const * data_1,     /* anonymous data to be compared    */
+    HMAP_anon_type    
+                const * data_2      /* anonymous data to be compared    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+HMAP_bool_t8            match;
+
+/*-------------------------------------------------------------
+First, check if the sizes match.
+-------------------------------------------------------------*/
+if( data_1->size != data_2->size )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Check if the data is a byte-for-byte match.
+-------------------------------------------------------------*/
+for( i = 0; i < data_1->size; i++ )
+    {
+    if( ( (char *)( data_1->ptr ) )[ i ] != ( (char *)( data_2->ptr ) )[ i ] )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    }
+
+return( HMAP_BOOL_TRUE );
+
+}   /* anon_data_match() */
+
+
+#if defined( HMAP_X86 )
+/*************************************************************************
+ *
+ *  Procedure:
+ *      anon_data_match_avx2
+ *
+ *  Description:
+ *      AVX2 kernel of anon_data_match, comparing 32 bytes at a time.
+ *
+ ************************************************************************/
+static HMAP_TARGET_AVX2 HMAP_bool_t8 anon_data_match_avx2
+    (
+    HMAP_anon_type
+                const * data_1,     /* anonymous data to be compared    */
+    HMAP_anon_type
+                const * data_2      /* anonymous data to be compared    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char const   * bytes_1;
+unsigned char const   * bytes_2;
+unsigned int            i;
+
+/*-------------------------------------------------------------
+First, check if the sizes match.
+-------------------------------------------------------------*/
+if( data_1->size != data_2->size )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Compare whole vectors, then the remaining bytes.
+-------------------------------------------------------------*/
+bytes_1 = data_1->ptr;
+bytes_2 = data_2->ptr;
+for( i = 0; i + 32 <= data_1->size; i += 32 )
+    {
+    if( (unsigned int)_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_loadu_si256( (__m256i const *)&bytes_1[ i ] ),
+                                                                _mm256_loadu_si256( (__m256i const *)&bytes_2[ i ] ) ) ) != 0xFFFFFFFFu )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    }
+
+for( ; i < data_1->size; i++ )
+    {
+    if( bytes_1[ i ] != bytes_2[ i ] )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    }
+
+return( HMAP_BOOL_TRUE );
+
+}   /* anon_data_match_avx2() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      anon_data_match_sse2
+ *
+ *  Description:
+ *      SSE2 kernel of anon_data_match, comparing 16 bytes at a time.
+ *
+ ************************************************************************/
+static HMAP_TARGET_SSE2 HMAP_bool_t8 anon_data_match_sse2
+    (
+    HMAP_anon_type
+                const * data_1,     /* anonymous data to be compared    */
+    HMAP_anon_type
+                const * data_2      /* anonymous data to be compared    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char const   * bytes_1;
+unsigned char const   * bytes_2;
+unsigned int            i;
+
+/*-------------------------------------------------------------
+First, check if the sizes match.
+-------------------------------------------------------------*/
+if( data_1->size != data_2->size )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Compare whole vectors, then the remaining bytes.
+-------------------------------------------------------------*/
+bytes_1 = data_1->ptr;
+bytes_2 = data_2->ptr;
+for( i = 0; i + 16 <= data_1->size; i += 16 )
+    {
+    if( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (__m128i const *)&bytes_1[ i ] ),
+                                           _mm_loadu_si128( (__m128i const *)&bytes_2[ i ] ) ) ) != 0xFFFF )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    }
+
+for( ; i < data_1->size; i++ )
+    {
+    if( bytes_1[ i ] != bytes_2[ i ] )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    }
+
+return( HMAP_BOOL_TRUE );
+
+}   /* anon_data_match_sse2() */
+#endif
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      append_log
+ *
+ *  Description:
+ *      Append bytes to the log buffer, writing the buffer out whenever
+ *      it fills. Blocks larger than the buffer are written directly.
+ *      Returns HMAP_BOOL_FALSE if a write failed, after which the log
+ *      is failed.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 append_log
+    (
+    hmap_log_type     * log,        /* mutation log                     */
+    void        const * bytes,      /* bytes to append                  */
+    unsigned int        size        /* num bytes to append              */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            chunk;
+unsigned int            i;
+unsigned char const   * source;
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+source = (unsigned char const *)bytes;
+
+/*-------------------------------------------------------------
+Copy the bytes into the buffer, writing it out when full.
+-------------------------------------------------------------*/
+while( size > 0 )
+    {
+    if( log->length == log->buffer_size )
+        {
+        if( !log->write( log->context, log->buffer, log->length ) )
+            {
+            log->failed = HMAP_BOOL_TRUE;
+            return( HMAP_BOOL_FALSE );
+            }
+        log->length = 0;
+        }
+
+    /*---------------------------------------------------------
+    Write blocks that would not fit in an empty buffer straight
+    to the log.
+    ---------------------------------------------------------*/
+    if( log->length == 0
+     && size >= log->buffer_size )
+        {
+        if( !log->write( log->context, source, size ) )
+            {
+            log->failed = HMAP_BOOL_TRUE;
+            return( HMAP_BOOL_FALSE );
+            }
+        return( HMAP_BOOL_TRUE );
+        }
+
+    chunk = log->buffer_size - log->length;
+    if( chunk > size )
+        {
+        chunk = size;
+        }
+    for( i = 0; i < chunk; i++ )
+        {
+        log->buffer[ log->length + i ] = source[ i ];
+        }
+    log->length += chunk;
+    source += chunk;
+    size -= chunk;
+    }
+
+return( HMAP_BOOL_TRUE );
+
+}   /* append_log() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      append_order
+ *
+ *  Description:
+ *      Add a new entry to the end of an ordered map's insertion order,
+ *      making room in a full order array. Returns HMAP_BOOL_FALSE if
+ *      memory could not be allocated.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 append_order
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* new entry                        */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_ref_type         * order;
+
+/*-------------------------------------------------------------
+Make room in a full array.
+-------------------------------------------------------------*/
+if( map->table->order_len == map->table->order_capacity
+ && !resize_order( map ) )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Append the entry.
+-------------------------------------------------------------*/
+order = ref_to_ptr( map, map->table->order );
+( (hmap_ordered_entry_type *)entry )->order = map->table->order_len;
+order[ map->table->order_len++ ] = ptr_to_ref( map, entry );
+
+return( HMAP_BOOL_TRUE );
+
+}   /* append_order() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      append_segment
+ *
+ *  Description:
+ *      Take size bytes at the end of the current value segment,
+ *      starting a new segment if it is full, and write their header.
+ *      Returns HMAP_INVALID_POINTER if a new segment could not be
+ *      allocated.
+ *
+ ************************************************************************/
+static hmap_value_header_type * append_segment
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned int        size        /* num bytes with header, aligned   */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_value_header_type* header;
+hmap_segment_type     * segment;
+hmap_segments_type    * segments;
+
+/*-------------------------------------------------------------
+Start a new segment if the current one is full.
+-------------------------------------------------------------*/
+segments = map->segments;
+if( segments->current == HMAP_SEGMENT_NONE
+ || segments->list[ segments->current ].used + size > segments->segment_size )
+    {
+    if( !open_segment( map ) )
+        {
+        return( HMAP_INVALID_POINTER );
+        }
+    }
+
+/*-------------------------------------------------------------
+Take the bytes.
+-------------------------------------------------------------*/
+segment = &segments->list[ segments->current ];
+header = (hmap_value_header_type *)&segment->bytes[ segment->used ];
+header->segment = segments->current;
+header->size = size;
+segment->used += size;
+segment->live += size;
+
+return( header );
+
+}   /* append_segment() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      append_spill
+ *
+ *  Description:
+ *      Append an entry's data to the current spill file and point the
+ *      entry at it. The caller frees wherever the data was before.
+ *      Returns HMAP_BOOL_FALSE if the write failed, after which the
+ *      file is no longer written.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 append_spill
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry,      /* entry being spilled              */
+    void        const * bytes       /* entry data                       */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+HMAP_spill_def_type   * file;
+hmap_spill_type       * spill;
+
+/*-------------------------------------------------------------
+Append the data.
+-------------------------------------------------------------*/
+spill = map->spill;
+file = &spill->files[ spill->current ];
+if( !file->write( file->context, bytes, entry->data.size ) )
+    {
+    spill->failed = HMAP_BOOL_TRUE;
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Point the entry at the data in the file.
+-------------------------------------------------------------*/
+entry->data.storage.ref = spill->file_size[ spill->current ];
+entry->flags |= HMAP_ENTRY_SPILLED;
+entry->flags &= ~HMAP_ENTRY_SPILL_FILE;
+if( spill->current != 0 )
+    {
+    entry->flags |= HMAP_ENTRY_SPILL_FILE;
+    }
+
+spill->file_size[ spill->current ] += entry->data.size;
+spill->live_size[ spill->current ] += entry->data.size;
+
+return( HMAP_BOOL_TRUE );
+
+}   /* append_spill() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      append_value
+ *
+ *  Description:
+ *      Append a value to an entry's value list. A full list is moved to
+ *      a block at least twice its size, so the cost of moving values is
+ *      amortized over the appends.
+ *
+ ************************************************************************/
+static HMAP_status_t8 append_value
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry,      /* multimap entry                   */
+    HMAP_anon_type
+                const * value       /* value to append                  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_blob_type          data_blob;
+HMAP_anon_type          destination;
+unsigned int            length;
+unsigned char         * list;
+unsigned long long      needed;
+unsigned long long      size;
+HMAP_anon_type          source;
+
+/*-------------------------------------------------------------
+Initialize variables, keeping the old list for a save in
+progress.
+-------------------------------------------------------------*/
+preserve_entry( map, entry );
+list = get_blob_bytes( map, &entry->data );
+length = decode_u32( &list[ 4 ] );
+needed = (unsigned long long)length + HMAP_VARINT_MAX + value->size;
+if( needed > 0xFFFFFFFFu )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+
+/*-------------------------------------------------------------
+Grow the list if the value does not fit.
+-------------------------------------------------------------*/
+if( needed > entry->data.size )
+    {
+    size = (unsigned long long)entry->data.size * 2;
+    if( size < needed )
+        {
+        size = needed;
+        }
+    if( size > 0xFFFFFFFFu )
+        {
+        size = needed;
+        }
+
+    if( !alloc_blob( map, &data_blob, (unsigned int)size ) )
+        {
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
+
+    destination.ptr = get_blob_bytes( map, &data_blob );
+    source.ptr = list;
+    source.size = length;
+    copy_anon_data( &destination, &source );
+
+    map->table->data_size += data_blob.size - entry->data.size;
+    map->table->size += data_blob.size - entry->data.size;
+    entry->size += data_blob.size - entry->data.size;
+
+    free_blob( map, &entry->data );
+    entry->data = data_blob;
+    list = destination.ptr;
+    }
+
+/*-------------------------------------------------------------
+Append the value's size and bytes.
+-------------------------------------------------------------*/
+length += encode_varint( &list[ length ], value->size );
+destination.ptr = &list[ length ];
+copy_anon_data( &destination, value );
+length += value->size;
+
+encode_u32( &list[ 0 ], decode_u32( &list[ 0 ] ) + 1 );
+encode_u32( &list[ 4 ], length );
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* append_value() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      clear_cuckoo_buckets
+ *
+ *  Description:
+ *      Empty every slot of a cuckoo table.
+ *
+ ************************************************************************/
+static void clear_cuckoo_buckets
+    (
+    hmap_cuckoo_bucket_type
+                      * buckets,    /* table to clear                   */
+    unsigned int        buckets_len /* num buckets                      */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+unsigned int            slot;
+
+/*-------------------------------------------------------------
+A zero tag marks an empty slot.
+-------------------------------------------------------------*/
+for( i = 0; i < buckets_len; i++ )
+    {
+    for( slot = 0; slot < HMAP_CUCKOO_WAYS; slot++ )
+        {
+        buckets[ i ].tags[ slot ] = 0;
+        buckets[ i ].entries[ slot ] = HMAP_INVALID_REF;
+        }
+    }
+
+}   /* clear_cuckoo_buckets() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      clear_hopscotch_slots
+ *
+ *  Description:
+ *      Empty every slot of a hopscotch table.
+ *
+ ************************************************************************/
+static void clear_hopscotch_slots
+    (
+    hmap_hopscotch_slot_type
+                      * slots,      /* table to clear                   */
+    unsigned int        slots_len   /* num slots                        */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+
+/*-------------------------------------------------------------
+Clear the slots and their neighborhoods.
+-------------------------------------------------------------*/
+for( i = 0; i < slots_len; i++ )
+    {
+    slots[ i ].entry = HMAP_INVALID_REF;
+    slots[ i ].hash = 0;
+    slots[ i ].hop = 0;
+    }
+
+}   /* clear_hopscotch_slots() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      close_segment
+ *
+ *  Description:
+ *      Free a value segment none of whose data is live, leaving its
+ *      index free for a new segment.
+ *
+ ************************************************************************/
+static void close_segment
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned int        index       /* index of segment                 */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_segment_type     * segment;
+
+/*-------------------------------------------------------------
+Free the segment.
+-------------------------------------------------------------*/
+segment = &map->segments->list[ index ];
+free_memory( map, segment->bytes );
+segment->bytes = HMAP_INVALID_POINTER;
+segment->used = 0;
+segment->live = 0;
+if( segment->evacuating )
+    {
+    segment->evacuating = HMAP_BOOL_FALSE;
+    map->segments->evacuating--;
+    }
+
+}   /* close_segment() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      compare_key_parts
+ *
+ *  Description:
+ *      Order two keys, each given as its prefix and the rest of it,
+ *      shorter keys first and then byte by byte. Returns less than,
+ *      equal to or greater than zero as the first key orders before,
+ *      with or after the second.
+ *
+ ************************************************************************/
+static int compare_key_parts
+    (
+    HMAP_anon_type
+                const * parts_1,    /* key as prefix and rest           */
+    HMAP_anon_type
+                const * parts_2     /* key as prefix and rest           */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char           byte_1;
+unsigned char           byte_2;
+unsigned int            i;
+unsigned int            offset_1;
+unsigned int            offset_2;
+unsigned int            part_1;
+unsigned int            part_2;
+unsigned int            size;
+
+/*-------------------------------------------------------------
+Shorter keys come first.
+-------------------------------------------------------------*/
+size = parts_1[ 0 ].size + parts_1[ 1 ].size;
+if( size != parts_2[ 0 ].size + parts_2[ 1 ].size )
+    {
+    return( size < parts_2[ 0 ].size + parts_2[ 1 ].size ? -1 : 1 );
+    }
+
+/*-------------------------------------------------------------
+Compare the keys byte by byte across their parts.
+-------------------------------------------------------------*/
+part_1 = 0;
+part_2 = 0;
+offset_1 = 0;
+offset_2 = 0;
+for( i = 0; i < size; i++ )
+    {
+    while( offset_1 == parts_1[ part_1 ].size )
+        {
+        part_1++;
+        offset_1 = 0;
+        }
+    while( offset_2 == parts_2[ part_2 ].size )
+        {
+        part_2++;
+        offset_2 = 0;
+        }
+
+    byte_1 = ( (unsigned char *)parts_1[ part_1 ].ptr )[ offset_1++ ];
+    byte_2 = ( (unsigned char *)parts_2[ part_2 ].ptr )[ offset_2++ ];
+    if( byte_1 != byte_2 )
+        {
+        return( byte_1 < byte_2 ? -1 : 1 );
+        }
+    }
+
+return( 0 );
+
+}   /* compare_key_parts() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      compare_sorted_slot
+ *
+ *  Description:
+ *      Order a sorted bucket's slot against a key, by hash and then,
+ *      unless the map has a custom key equality, by key. Without key
+ *      parts only the hashes are compared. Returns less than, equal to
+ *      or greater than zero as the slot orders before, with or after
+ *      the key.
+ *
+ ************************************************************************/
+static int compare_sorted_slot
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_sorted_slot_type
+                      * slot,       /* slot of a sorted bucket          */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    HMAP_anon_type
+                const * key_parts   /* key as prefix and rest, or NULL  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+HMAP_anon_type          slot_parts[ 2 ];
+
+if( slot->key_hash != key_hash )
+    {
+    return( slot->key_hash < key_hash ? -1 : 1 );
+    }
+
+if( key_parts == HMAP_INVALID_POINTER
+ || map->equal != HMAP_INVALID_POINTER )
+    {
+    return( 0 );
+    }
+
+get_entry_key_parts( map, link_to_ptr( map, slot->link ), slot_parts );
+return( compare_key_parts( slot_parts, key_parts ) );
+
+}   /* compare_sorted_slot() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      compress_block
+ *
+ *  Description:
+ *      Compress a block with a byte oriented LZ77 codec in the style of
+ *      LZ4. The output is a series of sequences, each a token (literal
+ *      length and match length nibbles), extra literal length bytes,
+ *      the literals, a 16 bit match offset and extra match length
+ *      bytes. The final sequence has literals only. Returns the
+ *      compressed size, or 0 if the output would not fit in
+ *      destination_size.
+ *
+ ************************************************************************/
+static unsigned int compress_block
+    (
+    unsigned char const
+                      * source,     /* bytes to compress                */
+    unsigned int        source_size,/* num bytes to compress            */
+    unsigned char     * destination,/* out: compressed bytes            */
+    unsigned int        destination_size
+                                    /* capacity of destination          */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            anchor;
+unsigned int            candidate;
+unsigned int            hash;
+unsigned int            length;
+unsigned int            limit;
+unsigned int            position;
+unsigned int            size;
+unsigned int            table[ 1 << HMAP_LZ_HASH_BITS ];
+
+/*-------------------------------------------------------------
+Initialize variables. The table holds the last position + 1
+of each hashed 4 byte sequence.
+-------------------------------------------------------------*/
+for( position = 0; position < ( 1 << HMAP_LZ_HASH_BITS ); position++ )
+    {
+    table[ position ] = 0;
+    }
+anchor = 0;
+position = 0;
+size = 0;
+limit = 0;
+if( source_size > HMAP_LZ_END_LITERALS )
+    {
+    limit = source_size - HMAP_LZ_END_LITERALS;
+    }
+
+/*-------------------------------------------------------------
+Find matches for the sequence at each position. The last few
+bytes are always literals.
+-------------------------------------------------------------*/
+while( position + HMAP_LZ_MIN_MATCH <= limit )
+    {
+    hash = ( decode_u32( &source[ position ] ) * 2654435761u ) >> ( 32 - HMAP_LZ_HASH_BITS );
+    candidate = table[ hash ];
+    table[ hash ] = position + 1;
+
+    if( candidate == 0
+     || position - ( candidate - 1 ) > HMAP_LZ_MAX_OFFSET
+     || decode_u32( &source[ candidate - 1 ] ) != decode_u32( &source[ position ] ) )
+        {
+        position++;
+        continue;
+        }
+
+    /*---------------------------------------------------------
+    Extend the match and emit it with the preceding literals.
+    ---------------------------------------------------------*/
+    candidate--;
+    length = HMAP_LZ_MIN_MATCH;
+    while( position + length < limit
+        && source[ candidate + length ] == source[ position + length ] )
+        {
+        length++;
+        }
+
+    if( !emit_lz_sequence( destination, destination_size, &size, &source[ anchor ],
+                           position - anchor, position - candidate, length ) )
+        {
+        return( 0 );
+        }
+
+    position += length;
+    anchor = position;
+    }
+
+/*-------------------------------------------------------------
+Emit the remaining literals.
+-------------------------------------------------------------*/
+if( !emit_lz_sequence( destination, destination_size, &size, &source[ anchor ],
+                       source_size - anchor, 0, 0 ) )
+    {
+    return( 0 );
+    }
+
+return( size );
+
+}   /* compress_block() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      compress_task
+ *
+ *  Description:
+ *      Parallel task compressing one block of a snapshot wave. Blocks
+ *      that do not compress are stored as is.
+ *
+ ************************************************************************/
+static void compress_task
+    (
+    void              * argument,   /* snapshot wave                    */
+    unsigned int        index       /* index of block in wave           */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_snapshot_block_type
+                      * block;
+
+/*-------------------------------------------------------------
+Checksum and compress the raw block.
+-------------------------------------------------------------*/
+block = &( (hmap_snapshot_wave_type *)argument )->blocks[ index ];
+block->index.checksum = compute_checksum( HMAP_CHECKSUM_SEED, block->raw, block->index.raw_size );
+block->index.stored_size = compress_block( block->raw, block->index.raw_size,
+                                           block->stored, block->index.raw_size - 1 );
+block->entries = block->stored;
+if( block->index.stored_size == 0 )
+    {
+    block->index.stored_size = block->index.raw_size;
+    block->entries = block->raw;
+    }
+block->status = HMAP_STATUS_SUCCESS;
+
+}   /* compress_task() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      compute_checksum
+ *
+ *  Description:
+ *      Continue a 32 bit FNV-1a checksum over the given bytes.
+ *
+ ************************************************************************/
+static unsigned int compute_checksum
+    (
+    unsigned int        checksum,   /* checksum of preceding bytes      */
+    void        const * bytes,      /* bytes to checksum                */
+    unsigned int        size        /* num bytes                        */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+
+/*-------------------------------------------------------------
+checksum = ( checksum ^ byte ) * 16777619
+-------------------------------------------------------------*/
+for( i = 0; i < size; i++ )
+    {
+    checksum = ( checksum ^ ( (unsigned char const *)bytes )[ i ] ) * 16777619u;
+    }
+
+return( checksum );
+
+}   /* compute_checksum() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      copy_anon_data
+ *
+ *  Description:
+ *      Copy anonymous data from a source to tha destination.
+ *
+ ************************************************************************/
+static void copy_anon_data
+    (
+    HMAP_anon_type    * destination,/* copy source data here            */
+    HMAP_anon_type    
+                const * source      /* source of data to be copied      */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+
+/*-------------------------------------------------------------
+Copy the source data to the destination.
+-------------------------------------------------------------*/
+destination->size = source->size;
+for( i = 0; i < source->size; i++ )
+    {
+    ( (char *)( destination->ptr ) )[ i ] = ( (char *)( source->ptr ) )[ i ];
+    }
+
+}   /* copy_anon_data() */
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      copy_entry_key
+ *
+ *  Description:
+ *      Copy an entry's key, rebuilding it from its shared prefix in
+ *      prefix mode. The destination must hold the key's size.
+ *
+ ************************************************************************/
+static void copy_entry_key
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry,      /* entry holding the key            */
+    unsigned char     * destination /* out: key bytes                   */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+HMAP_anon_type          key_bytes;
+hmap_prefix_type      * prefix;
+unsigned int            prefix_size;
+HMAP_anon_type          source;
+
+/*-------------------------------------------------------------
+Keys stored in full are copied as is.
+-------------------------------------------------------------*/
+key_bytes.ptr = destination;
+source.ptr = get_blob_bytes( map, &entry->key );
+source.size = entry->key.size;
+if( map->table->key_mode != HMAP_KEY_MODE_PREFIX )
+    {
+    copy_anon_data( &key_bytes, &source );
+    return;
+    }
+
+/*-------------------------------------------------------------
+Copy the prefix, if any, then the rest of the key.
+-------------------------------------------------------------*/
+prefix_size = 0;
+if( *(hmap_ref_type *)source.ptr != HMAP_INVALID_REF )
+    {
+    prefix = ref_to_ptr( map, *(hmap_ref_type *)source.ptr );
+    prefix_size = prefix->size;
+    source.ptr = prefix + 1;
+    source.size = prefix_size;
+    copy_anon_data( &key_bytes, &source );
+    }
+
+key_bytes.ptr = destination + prefix_size;
+source.ptr = (hmap_ref_type *)get_blob_bytes( map, &entry->key ) + 1;
+source.size = entry->key.size - sizeof( hmap_ref_type );
+copy_anon_data( &key_bytes, &source );
+
+}   /* copy_entry_key() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      count_cuckoo_hash
+ *
+ *  Description:
+ *      Count the entries of a cuckoo map with the given hash. They all
+ *      share the same two buckets however large the table grows.
+ *
+ ************************************************************************/
+static unsigned int count_cuckoo_hash
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            bucket_index;
+hmap_cuckoo_bucket_type
+                      * buckets;
+unsigned int            count;
+hmap_entry_type       * entry;
+unsigned int            probe;
+unsigned int            slot;
+unsigned char           tag;
+
+/*-------------------------------------------------------------
+Check the slots of both buckets whose tag matches.
+-------------------------------------------------------------*/
+buckets = ref_to_ptr( map, map->table->buckets );
+tag = get_cuckoo_tag( key_hash );
+bucket_index = key_hash & ( map->table->buckets_len - 1 );
+count = 0;
+for( probe = 0; probe < 2; probe++ )
+    {
+    for( slot = 0; slot < HMAP_CUCKOO_WAYS; slot++ )
+        {
+        if( buckets[ bucket_index ].tags[ slot ] == tag )
+            {
+            entry = ref_to_ptr( map, buckets[ bucket_index ].entries[ slot ] );
+            if( entry->key_hash == key_hash )
+                {
+                count++;
+                }
+            }
+        }
+    bucket_index = get_cuckoo_bucket( map->table->buckets_len, bucket_index, tag );
+    }
+
+return( count );
+
+}   /* count_cuckoo_hash() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      count_hopscotch_hash
+ *
+ *  Description:
+ *      Count the entries of a hopscotch map with the given hash. They
+ *      all share the same home slot however large the table grows.
+ *
+ ************************************************************************/
+static unsigned int count_hopscotch_hash
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            count;
+unsigned int            home;
+unsigned int            i;
+hmap_hopscotch_slot_type
+                      * slots;
+
+/*-------------------------------------------------------------
+Check the slots flagged in the home slot's neighborhood.
+-------------------------------------------------------------*/
+slots = ref_to_ptr( map, map->table->buckets );
+home = get_hopscotch_home( key_hash, map->table->buckets_len );
+count = 0;
+for( i = 0; i < HMAP_HOPSCOTCH_RANGE; i++ )
+    {
+    if( ( slots[ home ].hop & ( 1u << i ) ) != 0
+     && slots[ ( home + i ) & ( map->table->buckets_len - 1 ) ].hash == key_hash )
+        {
+        count++;
+        }
+    }
+
+return( count );
+
+}   /* count_hopscotch_hash() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      create_entry
+ *
+ *  Description:
+ *      Allocate and define a new map entry. Returns HMAP_INVALID_POINTER
+ *      if memory for the entry could not be allocated.
+ *
+ ************************************************************************/
+static hmap_entry_type * create_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type    
+                const * key,        /* entry key                        */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    HMAP_anon_type    
+                const * data        /* entry data                       */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entry;
+HMAP_anon_type          entry_key;
+unsigned int            entry_size;
+hmap_ref_type           prefix_ref;
+HMAP_anon_type          prefix_bytes;
+unsigned long long      reserved;
+HMAP_anon_type          stored_key;
+
+/*-------------------------------------------------------------
+Make room in a full entry or order array first. Its growth is
+checked against the map's size limit on its own, as the bytes
+of the entry are only counted once it is defined.
+-------------------------------------------------------------*/
+if( map->table->engine == HMAP_ENGINE_DENSE
+ && map->table->entries_len == map->table->entries_capacity
+ && !resize_dense( map ) )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+if( map->table->ordered != HMAP_BOOL_FALSE
+ && map->table->order_len == map->table->order_capacity
+ && !resize_order( map ) )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+/*-------------------------------------------------------------
+In prefix mode the key is stored as a reference to its shared
+prefix followed by the rest of the key.
+-------------------------------------------------------------*/
+stored_key = *key;
+prefix_ref = HMAP_INVALID_REF;
+if( map->table->key_mode == HMAP_KEY_MODE_PREFIX )
+    {
+    prefix_bytes.ptr = key->ptr;
+    prefix_bytes.size = get_prefix_size( map, key );
+    if( prefix_bytes.size > 0
+     && acquire_prefix( map, &prefix_bytes, &prefix_ref ) != HMAP_STATUS_SUCCESS )
+        {
+        return( HMAP_INVALID_POINTER );
+        }
+    stored_key.ptr = (unsigned char *)key->ptr + prefix_bytes.size;
+    stored_key.size = key->size - prefix_bytes.size;
+    }
+
+/*-------------------------------------------------------------
+Allocate the entry, then its data and its key unless they are
+small enough to be stored inline, if the map's size limit
+allows. Dense maps take the entry from their entry array,
+whose records are already counted, and chained maps from their
+slabs. Entries of ordered maps are also added to the order
+array.
+-------------------------------------------------------------*/
+entry_key.size = stored_key.size;
+if( map->table->key_mode == HMAP_KEY_MODE_PREFIX )
+    {
+    entry_key.size += sizeof( prefix_ref );
+    }
+
+entry_size = get_record_size( map );
+reserved = (unsigned long long)entry_key.size + data->size;
+if( map->table->engine != HMAP_ENGINE_DENSE )
+    {
+    reserved += entry_size;
+    }
+
+if( !reserve_memory( map, HMAP_INVALID_POINTER, reserved ) )
+    {
+    if( prefix_ref != HMAP_INVALID_REF )
+        {
+        release_prefix( map, prefix_ref );
+        }
+    return( HMAP_INVALID_POINTER );
+    }
+
+if( map->table->engine == HMAP_ENGINE_DENSE )
+    {
+    entry = alloc_dense_entry( map );
+    }
+else if( map->table->engine == HMAP_ENGINE_CHAINED )
+    {
+    entry = alloc_slab_entry( map );
+    }
+else
+    {
+    entry = alloc_memory( map, entry_size );
+    }
+if( entry == HMAP_INVALID_POINTER )
+    {
+    if( prefix_ref != HMAP_INVALID_REF )
+        {
+        release_prefix( map, prefix_ref );
+        }
+    return( HMAP_INVALID_POINTER );
+    }
+
+entry->data.size = 0;
+entry->key.size = 0;
+if( !alloc_data_blob( map, &entry->data, data->size )
+ || !alloc_blob( map, &entry->key, entry_key.size )
+ || ( map->table->ordered != HMAP_BOOL_FALSE
+   && !append_order( map, entry ) ) )
+    {
+    free_data_blob( map, &entry->data );
+    free_blob( map, &entry->key );
+    free_entry( map, entry );
+    if( prefix_ref != HMAP_INVALID_REF )
+        {
+        release_prefix( map, prefix_ref );
+        }
+    return( HMAP_INVALID_POINTER );
+    }
+
+/*-------------------------------------------------------------
+Define the new map entry.
+-------------------------------------------------------------*/
+entry->key_hash = key_hash;
+entry->next = HMAP_INVALID_LINK;
+entry->size = entry->data.size + entry->key.size + entry_size;
+entry->epoch = map->table->save_epoch;
+entry->flags = HMAP_ENTRY_REFERENCED;
+entry_key.ptr = get_blob_bytes( map, &entry->key );
+if( map->table->key_mode == HMAP_KEY_MODE_PREFIX )
+    {
+    *(hmap_ref_type *)entry_key.ptr = prefix_ref;
+    entry_key.ptr = (hmap_ref_type *)entry_key.ptr + 1;
+    }
+copy_anon_data( &entry_key, &stored_key );
+
+/*-------------------------------------------------------------
+Update map entry count and size data.
+-------------------------------------------------------------*/
+map->table->entry_count++;
+map->table->data_size += data->size;
+map->table->key_size += entry->key.size;
+map->table->size += entry->size;
+
+return( entry );
+
+}   /* create_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      create_log
+ *
+ *  Description:
+ *      Attach a mutation log to the map and append the log header,
+ *      which records the map's hash algorithm.
+ *
+ ************************************************************************/
+static HMAP_status_t8 create_log
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_log_def_type * log_def     /* mutation log definition          */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char           header[ HMAP_LOG_HEADER_SIZE ];
+hmap_log_type         * log;
+
+/*-------------------------------------------------------------
+Verify the log definition. Multimaps can not be logged, as the
+log only records whole data blocks.
+-------------------------------------------------------------*/
+if( log_def->write       == HMAP_INVALID_POINTER
+ || log_def->sync_policy >= HMAP_LOG_SYNC_COUNT
+ || map->table->multimap != HMAP_BOOL_FALSE )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+Allocate the log and its buffer.
+-------------------------------------------------------------*/
+log = map->malloc( sizeof(*log) );
+if( log == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+
+log->buffer_size = log_def->buffer_size;
+if( log->buffer_size == 0 )
+    {
+    log->buffer_size = HMAP_LOG_BUFFER_SIZE;
+    }
+
+log->buffer = map->malloc( log->buffer_size );
+if( log->buffer == HMAP_INVALID_POINTER )
+    {
+    map->free( log );
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+
+/*-------------------------------------------------------------
+Define the log.
+-------------------------------------------------------------*/
+log->context = log_def->context;
+log->write = log_def->write;
+log->sync = log_def->sync;
+log->sync_policy = log_def->sync_policy;
+log->group_size = log_def->group_size;
+if( log->group_size == 0 )
+    {
+    log->group_size = HMAP_LOG_GROUP_SIZE;
+    }
+log->group_count = 0;
+log->length = 0;
+log->failed = HMAP_BOOL_FALSE;
+map->log = log;
+
+/*-------------------------------------------------------------
+Begin the log with a header. It is written with the first
+group.
+-------------------------------------------------------------*/
+header[ 0 ] = HMAP_LOG_RECORD_HEADER;
+encode_u32( &header[ 1 ], HMAP_LOG_MAGIC );
+header[ 5 ] = HMAP_LOG_VERSION;
+header[ 6 ] = map->table->hash_type;
+encode_u32( &header[ 7 ], compute_checksum( HMAP_CHECKSUM_SEED, header, 7 ) );
+
+if( !append_log( log, header, sizeof( header ) ) )
+    {
+    return( HMAP_STATUS_IO_ERROR );
+    }
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* create_log() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      create_segments
+ *
+ *  Description:
+ *      Set the map up to keep its data in value segments of the given
+ *      size, rounded up to HMAP_SEGMENT_MIN. Segments are allocated as
+ *      data is added.
+ *
+ ************************************************************************/
+static HMAP_status_t8 create_segments
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned int        segment_size/* bytes per segment                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_segments_type    * segments;
+
+/*-------------------------------------------------------------
+Shared maps allocate from their region's size classes, and
+multimap value lists are grown in place, so neither use
+segments.
+-------------------------------------------------------------*/
+if( map->region          != HMAP_INVALID_POINTER
+ || map->table->multimap != HMAP_BOOL_FALSE )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+Allocate and define the segment list.
+-------------------------------------------------------------*/
+segments = map->malloc( sizeof(*segments) );
+if( segments == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+
+segments->list = HMAP_INVALID_POINTER;
+segments->count = 0;
+segments->capacity = 0;
+segments->segment_size = segment_size;
+if( segments->segment_size < HMAP_SEGMENT_MIN )
+    {
+    segments->segment_size = HMAP_SEGMENT_MIN;
+    }
+segments->current = HMAP_SEGMENT_NONE;
+segments->evacuating = 0;
+segments->iterator.bucket = 0;
+segments->iterator.entry = HMAP_INVALID_REF;
+map->segments = segments;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* create_segments() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      create_snapshot_wave
+ *
+ *  Description:
+ *      Allocate an empty wave of snapshot blocks.
+ *
+ ************************************************************************/
+static hmap_snapshot_wave_type * create_snapshot_wave
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+hmap_snapshot_wave_type
+                      * wave;
+
+/*-------------------------------------------------------------
+Allocate the wave. Block buffers are allocated as needed.
+-------------------------------------------------------------*/
+wave = map->malloc( sizeof(*wave) );
+if( wave == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+wave->count = 0;
+wave->reading = HMAP_BOOL_FALSE;
+for( i = 0; i < HMAP_SNAPSHOT_WAVE; i++ )
+    {
+    wave->blocks[ i ].raw = HMAP_INVALID_POINTER;
+    wave->blocks[ i ].raw_capacity = 0;
+    wave->blocks[ i ].stored = HMAP_INVALID_POINTER;
+    wave->blocks[ i ].stored_capacity = 0;
+    wave->blocks[ i ].index.raw_size = 0;
+    wave->blocks[ i ].index.entry_count = 0;
+    }
+
+return( wave );
+
+}   /* create_snapshot_wave() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      create_spill
+ *
+ *  Description:
+ *      Attach spill files to the map, starting with the defined file.
+ *
+ ************************************************************************/
+static HMAP_status_t8 create_spill
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_spill_def_type
+                      * spill_def   /* spill file definition            */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_spill_type       * spill;
+
+/*-------------------------------------------------------------
+Verify the spill definition. Shared maps can not spill, as
+every process would need the file, and multimap value lists
+are changed in place.
+-------------------------------------------------------------*/
+if( spill_def->write       == HMAP_INVALID_POINTER
+ || spill_def->read        == HMAP_INVALID_POINTER
+ || map->region            != HMAP_INVALID_POINTER
+ || map->table->multimap   != HMAP_BOOL_FALSE )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
+
+/*-------------------------------------------------------------
+Allocate and define the spill files.
+-------------------------------------------------------------*/
+spill = map->malloc( sizeof(*spill) );
+if( spill == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+
+spill->files[ 0 ] = *spill_def;
+spill->files[ 1 ] = *spill_def;
+spill->file_size[ 0 ] = 0;
+spill->file_size[ 1 ] = 0;
+spill->live_size[ 0 ] = 0;
+spill->live_size[ 1 ] = 0;
+spill->current = 0;
+spill->compacting = HMAP_BOOL_FALSE;
+spill->failed = HMAP_BOOL_FALSE;
+spill->hand.bucket = 0;
+spill->hand.entry = HMAP_INVALID_REF;
+spill->iterator.bucket = 0;
+spill->iterator.entry = HMAP_INVALID_REF;
+spill->buffer = HMAP_INVALID_POINTER;
+spill->buffer_capacity = 0;
+map->spill = spill;
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* create_spill() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      decode_u32
+ *
+ *  Description:
+ *      Decode a little endian 32 bit value.
+ *
+ ************************************************************************/
+static unsigned int decode_u32
+    (
+    unsigned char const
+                      * bytes       /* encoded value                    */
+    )
+{
+return( (unsigned int)bytes[ 0 ]
+     | ( (unsigned int)bytes[ 1 ] << 8 )
+     | ( (unsigned int)bytes[ 2 ] << 16 )
+     | ( (unsigned int)bytes[ 3 ] << 24 ) );
+
+}   /* decode_u32() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      decode_varint
+ *
+ *  Description:
+ *      Decode a variable length value (7 bits per byte, low bits first).
+ *      Returns the number of bytes decoded, or 0 if the encoding is
+ *      incomplete or too long.
+ *
+ ************************************************************************/
+static unsigned int decode_varint
+    (
+    unsigned char const
+                      * bytes,      /* encoded value                    */
+    unsigned int        size,       /* num bytes available              */
+    unsigned int      * value       /* out: decoded value               */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+
+/*-------------------------------------------------------------
+Accumulate 7 bits per byte until a byte without the
+continuation bit.
+-------------------------------------------------------------*/
+*value = 0;
+for( i = 0; i < size && i < HMAP_VARINT_MAX; i++ )
+    {
+    *value |= (unsigned int)( bytes[ i ] & 0x7F ) << ( 7 * i );
+    if( ( bytes[ i ] & 0x80 ) == 0 )
+        {
+        return( i + 1 );
+        }
+    }
+
+return( 0 );
+
+}   /* decode_varint() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      decompress_block
+ *
+ *  Description:
+ *      Decompress a block written by compress_block. The input is not
+ *      trusted; every length and offset is bounds checked. Returns the
+ *      decompressed size, or 0 if the input is malformed or does not
+ *      fit in destination_size.
+ *
+ ************************************************************************/
+static unsigned int decompress_block
+    (
+    unsigned char const
+                      * source,     /* compressed bytes                 */
+    unsigned int        source_size,/* num compressed bytes             */
+    unsigned char     * destination,/* out: decompressed bytes          */
+    unsigned int        destination_size
+                                    /* capacity of destination          */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            input;
+unsigned int            length;
+unsigned int            offset;
+unsigned int            output;
+unsigned char           token;
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+input = 0;
+output = 0;
+
+/*-------------------------------------------------------------
+Decode sequences until the input is consumed.
+-------------------------------------------------------------*/
+while( input < source_size )
+    {
+    /*---------------------------------------------------------
+    Copy the literals.
+    ---------------------------------------------------------*/
+    token = source[ input++ ];
+    if( !read_lz_length( source, source_size, &input, token >> 4, &length )
+     || length > source_size - input
+     || length > destination_size - output )
+        {
+        return( 0 );
+        }
+    while( length-- > 0 )
+        {
+        destination[ output++ ] = source[ input++ ];
+        }
+
+    /*---------------------------------------------------------
+    The final sequence has no match.
+    ---------------------------------------------------------*/
+    if( input == source_size )
+        {
+        break;
+        }
+
+    /*---------------------------------------------------------
+    Copy the match. It may overlap the bytes being written, so
+    copy a byte at a time.
+    ---------------------------------------------------------*/
+    if( source_size - input < 2 )
+        {
+        return( 0 );
+        }
+    offset = (unsigned int)source[ input ] | ( (unsigned int)source[ input + 1 ] << 8 );
+    input += 2;
+
+    if( !read_lz_length( source, source_size, &input, token & 0x0F, &length ) )
+        {
+        return( 0 );
+        }
+    length += HMAP_LZ_MIN_MATCH;
+
+    if( offset == 0
+     || offset > output
+     || length > destination_size - output )
+        {
+        return( 0 );
+        }
+    while( length-- > 0 )
+        {
+        destination[ output ] = destination[ output - offset ];
+        output++;
+        }
+    }
+
+return( output );
+
+}   /* decompress_block() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      decompress_task
+ *
+ *  Description:
+ *      Parallel task decompressing and verifying one block of a
+ *      snapshot wave.
+ *
+ ************************************************************************/
+static void decompress_task
+    (
+    void              * argument,   /* snapshot wave                    */
+    unsigned int        index       /* index of block in wave           */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_snapshot_block_type
+                      * block;
+
+/*-------------------------------------------------------------
+Blocks stored as is need no decompression.
+-------------------------------------------------------------*/
+block = &( (hmap_snapshot_wave_type *)argument )->blocks[ index ];
+block->status = HMAP_STATUS_CORRUPT_DATA;
+block->entries = block->stored;
+if( block->index.stored_size != block->index.raw_size )
+    {
+    block->entries = block->raw;
+    if( block->index.stored_size > block->index.raw_size
+     || decompress_block( block->stored, block->index.stored_size,
+                          block->raw, block->index.raw_size ) != block->index.raw_size )
+        {
+        return;
+        }
+    }
+
+/*-------------------------------------------------------------
+Verify the block.
+-------------------------------------------------------------*/
+if( compute_checksum( HMAP_CHECKSUM_SEED, block->entries, block->index.raw_size ) == block->index.checksum )
+    {
+    block->status = HMAP_STATUS_SUCCESS;
+    }
+
+}   /* decompress_task() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      destroy_entry
+ *
+ *  Description:
+ *      Deallocate entry memory.
+ *
+ ************************************************************************/
+static void destroy_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to destroy                 */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_ref_type           prefix_ref;
+
+/*-------------------------------------------------------------
+Update map entry count and size data.
+-------------------------------------------------------------*/
+map->table->entry_count--;
+map->table->data_size -= entry->data.size;
+map->table->key_size -= entry->key.size;
+map->table->size -= entry->size;
+
+/*-------------------------------------------------------------
+Release the key's shared prefix.
+-------------------------------------------------------------*/
+if( map->table->key_mode == HMAP_KEY_MODE_PREFIX )
+    {
+    prefix_ref = *(hmap_ref_type *)get_blob_bytes( map, &entry->key );
+    if( prefix_ref != HMAP_INVALID_REF )
+        {
+        release_prefix( map, prefix_ref );
+        }
+    }
+
+/*-------------------------------------------------------------
+Remove the entry from the insertion order.
+-------------------------------------------------------------*/
+if( map->table->ordered != HMAP_BOOL_FALSE )
+    {
+    remove_order( map, entry );
+    }
+
+/*-------------------------------------------------------------
+Free the entry memory.
+-------------------------------------------------------------*/
+release_entry_data( map, entry );
+free_blob( map, &entry->key );
+free_entry( map, entry );
+
+}   /* destroy_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      destroy_snapshot_wave
+ *
+ *  Description:
+ *      Free a wave of snapshot blocks and its buffers.
+ *
+ ************************************************************************/
+static void destroy_snapshot_wave
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_snapshot_wave_type
+                      * wave        /* wave to free                     */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+
+/*-------------------------------------------------------------
+Free the block buffers, then the wave.
+-------------------------------------------------------------*/
+for( i = 0; i < HMAP_SNAPSHOT_WAVE; i++ )
+    {
+    if( wave->blocks[ i ].raw != HMAP_INVALID_POINTER )
+        {
+        map->free( wave->blocks[ i ].raw );
+        }
+    if( wave->blocks[ i ].stored != HMAP_INVALID_POINTER )
+        {
+        map->free( wave->blocks[ i ].stored );
+        }
+    }
+
+map->free( wave );
+
+}   /* destroy_snapshot_wave() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      emit_lz_sequence
+ *
+ *  Description:
+ *      Append a sequence of literals and an optional match (match
+ *      length 0) to compressed output. Returns HMAP_BOOL_FALSE if the
+ *      sequence does not fit.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 emit_lz_sequence
+    (
+    unsigned char     * destination,/* compressed output                */
+    unsigned int        destination_size,
+                                    /* capacity of destination          */
+    unsigned int      * size,       /* in/out: size of output           */
+    unsigned char const
+                      * literals,   /* literal bytes                    */
+    unsigned int        literal_count,
+                                    /* num literal bytes                */
+    unsigned int        offset,     /* match offset                     */
+    unsigned int        match_length/* match length, or 0               */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+unsigned int            length;
+unsigned char         * output;
+unsigned long long      worst_size;
+
+/*-------------------------------------------------------------
+Verify the worst case encoding fits.
+-------------------------------------------------------------*/
+worst_size = 1ull + literal_count / 255 + 1 + literal_count + 2 + match_length / 255 + 1;
+if( worst_size > destination_size - *size )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+output = &destination[ *size ];
+
+/*-------------------------------------------------------------
+Token with both length nibbles, 15 meaning more length bytes
+follow.
+-------------------------------------------------------------*/
+length = ( match_length > 0 ) ? match_length - HMAP_LZ_MIN_MATCH : 0;
+*output++ = (unsigned char)( ( ( literal_count < 15 ? literal_count : 15 ) << 4 )
+                           | ( length < 15 ? length : 15 ) );
+
+/*-------------------------------------------------------------
+Extra literal length and literals.
+-------------------------------------------------------------*/
+if( literal_count >= 15 )
+    {
+    for( i = literal_count - 15; i >= 255; i -= 255 )
+        {
+        *output++ = 255;
+        }
+    *output++ = (unsigned char)i;
+    }
+for( i = 0; i < literal_count; i++ )
+    {
+    *output++ = literals[ i ];
+    }
+
+/*-------------------------------------------------------------
+Match offset and extra match length.
+-------------------------------------------------------------*/
+if( match_length > 0 )
+    {
+    *output++ = (unsigned char)offset;
+    *output++ = (unsigned char)( offset >> 8 );
+    if( length >= 15 )
+        {
+        for( i = length - 15; i >= 255; i -= 255 )
+            {
+            *output++ = 255;
+            }
+        *output++ = (unsigned char)i;
+        }
+    }
+
+*size = (unsigned int)( output - destination );
+return( HMAP_BOOL_TRUE );
+
+}   /* emit_lz_sequence() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      encode_u32
+ *
+ *  Description:
+ *      Encode a 32 bit value in little endian byte order.
+ *
+ ************************************************************************/
+static void encode_u32
+    (
+    unsigned char     * bytes,      /* out: encoded value               */
+    unsigned int        value       /* value to encode                  */
+    )
+{
+bytes[ 0 ] = (unsigned char)( value );
+bytes[ 1 ] = (unsigned char)( value >> 8 );
+bytes[ 2 ] = (unsigned char)( value >> 16 );
+bytes[ 3 ] = (unsigned char)( value >> 24 );
+
+}   /* encode_u32() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      encode_varint
+ *
+ *  Description:
+ *      Encode a value in 7 bits per byte, low bits first. Returns the
+ *      number of bytes written, at most HMAP_VARINT_MAX.
+ *
+ ************************************************************************/
+static unsigned int encode_varint
+    (
+    unsigned char     * bytes,      /* out: encoded value               */
+    unsigned int        value       /* value to encode                  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+
+/*-------------------------------------------------------------
+Emit 7 bits at a time, setting the continuation bit on all but
+the last byte.
+-------------------------------------------------------------*/
+i = 0;
+while( value >= 0x80 )
+    {
+    bytes[ i++ ] = (unsigned char)( value | 0x80 );
+    value >>= 7;
+    }
+bytes[ i++ ] = (unsigned char)value;
+
+return( i );
+
+}   /* encode_varint() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      end_save
+ *
+ *  Description:
+ *      Report the result of a save to the snapshot's done hook and
+ *      free it.
+ *
+ ************************************************************************/
+static void end_save
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_status_t8      status      /* result of the save               */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_save_type        * save;
+
+/*-------------------------------------------------------------
+Detach the save from the map before reporting, so the done hook
+may start the next one.
+-------------------------------------------------------------*/
+save = map->save;
+map->save = HMAP_INVALID_POINTER;
+
+destroy_snapshot_wave( map, save->wave );
+if( save->index != HMAP_INVALID_POINTER )
+    {
+    map->free( save->index );
+    }
+
+if( save->snapshot->done != HMAP_INVALID_POINTER )
+    {
+    save->snapshot->done( save->snapshot->context, status );
+    }
+map->free( save );
+
+}   /* end_save() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      entry_key_match
+ *
+ *  Description:
+ *      Returns true if the entry's key matches the given key. Keys in
+ *      prefix mode are matched piecewise against the shared prefix and
+ *      the stored rest of the key, without rebuilding the key.
+ *      Without a custom key equality, keys of different sizes are
+ *      ruled out before calling the comparison kernel.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 entry_key_match
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry,      /* entry to compare                 */
+    HMAP_anon_type
+                const * key         /* key to compare                   */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+HMAP_anon_type          entry_key;
+HMAP_anon_type          key_part;
+hmap_prefix_type      * prefix;
+unsigned int            prefix_size;
+
+/*-------------------------------------------------------------
+Keys stored in full are compared directly.
+-------------------------------------------------------------*/
+entry_key.ptr = get_blob_bytes( map, &entry->key );
+entry_key.size = entry->key.size;
+if( map->table->key_mode != HMAP_KEY_MODE_PREFIX )
+    {
+    if( map->equal != HMAP_INVALID_POINTER )
+        {
+        return( map->equal( &entry_key, key ) );
+        }
+    return( entry_key.size == key->size
+         && map->match( &entry_key, key ) );
+    }
+
+/*-------------------------------------------------------------
+Compare the ends of the keys first, as keys sharing a prefix
+differ there.
+-------------------------------------------------------------*/
+prefix = HMAP_INVALID_POINTER;
+prefix_size = 0;
+if( *(hmap_ref_type *)entry_key.ptr != HMAP_INVALID_REF )
+    {
+    prefix = ref_to_ptr( map, *(hmap_ref_type *)entry_key.ptr );
+    prefix_size = prefix->size;
+    }
+
+entry_key.ptr = (hmap_ref_type *)entry_key.ptr + 1;
+entry_key.size = entry->key.size - sizeof( hmap_ref_type );
+if( key->size != entry_key.size + prefix_size )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+key_part.ptr = (unsigned char *)key->ptr + prefix_size;
+key_part.size = entry_key.size;
+if( !map->match( &entry_key, &key_part ) )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Then compare the prefix.
+-------------------------------------------------------------*/
+if( prefix != HMAP_INVALID_POINTER )
+    {
+    entry_key.ptr = prefix + 1;
+    entry_key.size = prefix_size;
+    key_part.ptr = key->ptr;
+    key_part.size = prefix_size;
+    return( map->match( &entry_key, &key_part ) );
+    }
+
+return( HMAP_BOOL_TRUE );
+
+}   /* entry_key_match() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      fetch_entry_data
+ *
+ *  Description:
+ *      Get a pointer to an entry's data for a lookup, marking the
+ *      entry as read if the map spills. Spilled data is read back into memory, which
+ *      may spill other entries, or into the spill buffer if there is
+ *      no memory for it. Returns HMAP_INVALID_POINTER if the data
+ *      could not be read.
+ *
+ ************************************************************************/
+static void * fetch_entry_data
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry being read                 */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_blob_type          data_blob;
+HMAP_spill_def_type   * file;
+
+/*-------------------------------------------------------------
+Mark the entry read for the clock hand of a spilling map. Only
+spilling maps are marked, as shared maps are read by many
+processes at once and never spill. Data in memory is read in
+place.
+-------------------------------------------------------------*/
+if( map->spill != HMAP_INVALID_POINTER )
+    {
+    entry->flags |= HMAP_ENTRY_REFERENCED;
+    }
+
+if( ( entry->flags & HMAP_ENTRY_SPILLED ) == 0 )
+    {
+    return( get_blob_bytes( map, &entry->data ) );
+    }
+
+/*-------------------------------------------------------------
+Bring the data back into memory, then make room for it.
+-------------------------------------------------------------*/
+if( !alloc_data_blob( map, &data_blob, entry->data.size ) )
+    {
+    return( get_entry_data( map, entry ) );
+    }
+
+file = &map->spill->files[ get_spill_file( entry ) ];
+if( !read_spill( file, entry->data.storage.ref, get_blob_bytes( map, &data_blob ), data_blob.size ) )
+    {
+    free_data_blob( map, &data_blob );
+    return( HMAP_INVALID_POINTER );
+    }
+
+release_entry_data( map, entry );
+entry->data = data_blob;
+spill_cold_data( map, entry, 0 );
+
+return( get_blob_bytes( map, &entry->data ) );
+
+}   /* fetch_entry_data() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      fill_log_reader
+ *
+ *  Description:
+ *      Make at least size bytes available at the reader's position,
+ *      reading more of the log as needed. Returns the number of bytes
+ *      available, which is less than size only at the end of the log
+ *      or on error.
+ *
+ ************************************************************************/
+static unsigned int fill_log_reader
+    (
+    hmap_log_reader_type
+                      * reader,     /* log reader                       */
+    unsigned int        size        /* num bytes needed                 */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char         * buffer;
+unsigned int            buffer_size;
+unsigned int            i;
+unsigned int            read_size;
+
+/*-------------------------------------------------------------
+Nothing to do if the bytes are already buffered.
+-------------------------------------------------------------*/
+if( reader->length - reader->position >= size )
+    {
+    return( size );
+    }
+
+/*-------------------------------------------------------------
+Move the unread bytes to the start of the buffer.
+-------------------------------------------------------------*/
+for( i = reader->position; i < reader->length; i++ )
+    {
+    reader->buffer[ i - reader->position ] = reader->buffer[ i ];
+    }
+reader->offset += reader->position;
+reader->length -= reader->position;
+reader->position = 0;
+
+/*-------------------------------------------------------------
+Grow the buffer if the request does not fit.
+-------------------------------------------------------------*/
+if( size > reader->buffer_size )
+    {
+    buffer_size = HMAP_LOG_BUFFER_SIZE;
+    while( buffer_size < size )
+        {
+        buffer_size *= 2;
+        }
+
+    buffer = reader->malloc( buffer_size );
+    if( buffer == HMAP_INVALID_POINTER )
+        {
+        reader->status = HMAP_STATUS_OUT_OF_MEMORY;
+        return( 0 );
+        }
+
+    for( i = 0; i < reader->length; i++ )
+        {
+        buffer[ i ] = reader->buffer[ i ];
+        }
+    if( reader->buffer != HMAP_INVALID_POINTER )
+        {
+        reader->free( reader->buffer );
+        }
+    reader->buffer = buffer;
+    reader->buffer_size = buffer_size;
+    }
+
+/*-------------------------------------------------------------
+Read until the request is satisfied or the log ends.
+-------------------------------------------------------------*/
+while( reader->length < size )
+    {
+    if( !reader->read( reader->context, reader->offset + reader->length,
+                       &reader->buffer[ reader->length ],
+                       reader->buffer_size - reader->length, &read_size ) )
+        {
+        reader->status = HMAP_STATUS_IO_ERROR;
+        return( 0 );
+        }
+
+    if( read_size == 0 )
+        {
+        break;
+        }
+    reader->length += read_size;
+    }
+
+return( reader->length < size ? reader->length : size );
+
+}   /* fill_log_reader() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      find_cuckoo_entry
+ *
+ *  Description:
+ *      Get a pointer to the entry associated with this key in a cuckoo
+ *      map. Only the key's two buckets are searched, and only entries
+ *      whose tag matches are compared. Returns HMAP_INVALID_POINTER if
+ *      the key does not exist in the hash map.
+ *
+ ************************************************************************/
+static hmap_entry_type * find_cuckoo_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_cuckoo_bucket_type
+                      * bucket;
+hmap_cuckoo_bucket_type
+                      * buckets;
+unsigned int            bucket_index;
+hmap_entry_type       * entry;
+unsigned int            i;
+unsigned int            probe;
+unsigned char           tag;
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+buckets = ref_to_ptr( map, map->table->buckets );
+tag = get_cuckoo_tag( key_hash );
+bucket_index = key_hash & ( map->table->buckets_len - 1 );
+
+/*-------------------------------------------------------------
+Search the key's first bucket, then its second.
+-------------------------------------------------------------*/
+for( probe = 0; probe < 2; probe++ )
+    {
+    bucket = &buckets[ bucket_index ];
+    for( i = 0; i < HMAP_CUCKOO_WAYS; i++ )
+        {
+        if( bucket->tags[ i ] == tag )
+            {
+            entry = ref_to_ptr( map, bucket->entries[ i ] );
+            if( entry->key_hash == key_hash
+             && entry_key_match( map, entry, key ) )
+                {
+                return( entry );
+                }
+            }
+        }
+    bucket_index = get_cuckoo_bucket( map->table->buckets_len, bucket_index, tag );
+    }
+
+return( HMAP_INVALID_POINTER );
+
+}   /* find_cuckoo_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      find_dense_entry
+ *
+ *  Description:
+ *      Get a pointer to the entry associated with this key in a dense
+ *      map. Returns HMAP_INVALID_POINTER if the key does not exist in
+ *      the hash map.
+ *
+ ************************************************************************/
+static hmap_entry_type * find_dense_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entries;
+hmap_entry_type       * entry;
+unsigned int            index;
+unsigned int            slot;
+
+/*-------------------------------------------------------------
+Nothing has been added to an empty index table.
+-------------------------------------------------------------*/
+if( map->table->buckets_len == 0 )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+/*-------------------------------------------------------------
+Probe from the key's slot up to the first empty slot. Slots of
+removed entries are passed over like those of other keys.
+-------------------------------------------------------------*/
+entries = ref_to_ptr( map, map->table->entries );
+slot = key_hash & ( map->table->buckets_len - 1 );
+index = get_dense_index( map, slot );
+while( index != 0 )
+    {
+    entry = &entries[ index - 1 ];
+    if( entry->size     != 0
+     && entry->key_hash == key_hash
+     && entry_key_match( map, entry, key ) )
+        {
+        return( entry );
+        }
+    slot = ( slot + 1 ) & ( map->table->buckets_len - 1 );
+    index = get_dense_index( map, slot );
+    }
+
+return( HMAP_INVALID_POINTER );
+
+}   /* find_dense_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      find_hopscotch_entry
+ *
+ *  Description:
+ *      Get a pointer to the entry associated with this key in a
+ *      hopscotch map. Only the slots of the key's neighborhood that
+ *      hold entries belonging to it are compared. Returns
+ *      HMAP_INVALID_POINTER if the key does not exist in the hash map.
+ *
+ ************************************************************************/
+static hmap_entry_type * find_hopscotch_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entry;
+unsigned int            home;
+unsigned int            hop;
+unsigned int            i;
+hmap_hopscotch_slot_type
+                      * slot;
+hmap_hopscotch_slot_type
+                      * slots;
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+slots = ref_to_ptr( map, map->table->buckets );
+home = get_hopscotch_home( key_hash, map->table->buckets_len );
+hop = slots[ home ].hop;
+
+/*-------------------------------------------------------------
+Compare the entries of the home slot's neighborhood.
+-------------------------------------------------------------*/
+for( i = 0; hop != 0; i++, hop >>= 1 )
+    {
+    slot = &slots[ ( home + i ) & ( map->table->buckets_len - 1 ) ];
+    if( ( hop & 1 ) != 0
+     && slot->hash == key_hash )
+        {
+        entry = ref_to_ptr( map, slot->entry );
+        if( entry_key_match( map, entry, key ) )
+            {
+            return( entry );
+            }
+        }
+    }
+
+return( HMAP_INVALID_POINTER );
+
+}   /* find_hopscotch_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      flush_log
+ *
+ *  Description:
+ *      Write the buffered log records, optionally syncing the log to
+ *      end the current group. Returns HMAP_BOOL_FALSE on I/O error,
+ *      after which the log is failed.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 flush_log
+    (
+    hmap_log_type     * log,        /* mutation log                     */
+    HMAP_bool_t8        sync        /* sync the log after writing       */
+    )
+{
+/*-------------------------------------------------------------
+Write the buffer.
+-------------------------------------------------------------*/
+if( log->length > 0 )
+    {
+    if( !log->write( log->context, log->buffer, log->length ) )
+        {
+        log->failed = HMAP_BOOL_TRUE;
+        return( HMAP_BOOL_FALSE );
+        }
+    log->length = 0;
+    }
+
+/*-------------------------------------------------------------
+Sync the log, ending the group.
+-------------------------------------------------------------*/
+if( sync )
+    {
+    log->group_count = 0;
+    if( log->sync != HMAP_INVALID_POINTER
+     && !log->sync( log->context ) )
+        {
+        log->failed = HMAP_BOOL_TRUE;
+        return( HMAP_BOOL_FALSE );
+        }
+    }
+
+return( HMAP_BOOL_TRUE );
+
+}   /* flush_log() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      flush_save
+ *
+ *  Description:
+ *      Write the full blocks of a save, or all of its blocks at the
+ *      end of the save. The block being filled is moved to the front
+ *      of the wave.
+ *
+ ************************************************************************/
+static void flush_save
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_bool_t8        last        /* write the partial block too      */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_snapshot_block_type
+                        block;
+unsigned int            count;
+hmap_save_type        * save;
+hmap_snapshot_wave_type
+                      * wave;
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+save = map->save;
+wave = save->wave;
+if( last
+ && wave->blocks[ wave->count ].index.entry_count > 0 )
+    {
+    wave->count++;
+    }
+
+if( wave->count == 0 )
+    {
+    return;
+    }
+
+/*-------------------------------------------------------------
+Write the blocks, then swap the block being filled into the
+first, now empty, place.
+-------------------------------------------------------------*/
+count = wave->count;
+save->status = save_snapshot_wave( map, save->snapshot, wave, &save->index, &save->index_capacity,
+                                   &save->index_count, &save->offset );
+if( count < HMAP_SNAPSHOT_WAVE )
+    {
+    block = wave->blocks[ 0 ];
+    wave->blocks[ 0 ] = wave->blocks[ count ];
+    wave->blocks[ count ] = block;
+    }
+
+}   /* flush_save() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      free_blob
+ *
+ *  Description:
+ *      Free the memory of a block that is not stored inline.
+ *
+ ************************************************************************/
+static void free_blob
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_blob_type    * blob        /* block to free                    */
+    )
+{
+if( blob->size > HMAP_INLINE_SIZE )
+    {
+    free_memory( map, ref_to_ptr( map, blob->storage.ref ) );
+    }
+
+}   /* free_blob() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      free_data_blob
+ *
+ *  Description:
+ *      Free a block allocated with alloc_data_blob. A block in a value
+ *      segment is only counted as dead, and the segment freed when
+ *      none of its data is live.
+ *
+ ************************************************************************/
+static void free_data_blob
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_blob_type    * blob        /* block to free                    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_value_header_type* header;
+hmap_segment_type     * segment;
+
+/*-------------------------------------------------------------
+Without segments, and for inline blocks, this is any block.
+-------------------------------------------------------------*/
+if( map->segments == HMAP_INVALID_POINTER
+ || blob->size <= HMAP_INLINE_SIZE )
+    {
+    free_blob( map, blob );
+    return;
+    }
+
+/*-------------------------------------------------------------
+Free a block of its own, or take it off its segment's live
+bytes. The current segment is kept for the blocks to come.
+-------------------------------------------------------------*/
+header = (hmap_value_header_type *)get_blob_bytes( map, blob ) - 1;
+if( header->segment == HMAP_SEGMENT_NONE )
+    {
+    free_memory( map, header );
+    return;
+    }
+
+segment = &map->segments->list[ header->segment ];
+segment->live -= header->size;
+if( segment->live == 0
+ && header->segment != map->segments->current )
+    {
+    close_segment( map, header->segment );
+    }
+
+}   /* free_data_blob() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      free_entry
+ *
+ *  Description:
+ *      Free the memory of an entry. A dense map's record is marked
+ *      removed instead and reclaimed when the array is next resized.
+ *      A chained map's record is kept for the next entry.
+ *
+ ************************************************************************/
+static void free_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to free                    */
+    )
+{
+if( map->table->engine == HMAP_ENGINE_DENSE )
+    {
+    entry->size = 0;
+    map->table->size += sizeof(*entry);
+    return;
+    }
+
+if( map->table->engine == HMAP_ENGINE_CHAINED )
+    {
+    entry->next = map->table->slab_free;
+    map->table->slab_free = ptr_to_link( map, entry );
+    return;
+    }
+
+free_memory( map, entry );
+
+}   /* free_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      free_memory
+ *
+ *  Description:
+ *      Free memory allocated with alloc_memory. Freeing
+ *      HMAP_INVALID_POINTER has no effect.
+ *
+ ************************************************************************/
+static void free_memory
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    void              * memory      /* memory block to free             */
+    )
+{
+/*-------------------------------------------------------------
+Nothing to free.
+-------------------------------------------------------------*/
+if( memory == HMAP_INVALID_POINTER )
+    {
+    return;
+    }
+
+/*-------------------------------------------------------------
+Return the memory to where it was allocated from.
+-------------------------------------------------------------*/
+if( map->region != HMAP_INVALID_POINTER )
+    {
+    region_free( map, memory );
+    }
+else
+    {
+    map->free( memory );
+    }
+
+}   /* free_memory() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      free_sorted_bucket
+ *
+ *  Description:
+ *      Free the index of a sorted bucket, which is left as an unsorted
+ *      chain of the same entries.
+ *
+ ************************************************************************/
+static void free_sorted_bucket
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of a key in bucket    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_sorted_type      * sorted;
+hmap_ref_type         * sorted_ref;
+
+sorted_ref = (hmap_ref_type *)ref_to_ptr( map, map->table->sorted )
+           + key_hash % map->table->buckets_len;
+sorted = ref_to_ptr( map, *sorted_ref );
+
+map->table->size -= sizeof(*sorted) + sorted->capacity * sizeof( hmap_sorted_slot_type );
+free_memory( map, sorted );
+*sorted_ref = HMAP_INVALID_REF;
+
+}   /* free_sorted_bucket() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_blob_bytes
+ *
+ *  Description:
+ *      Get a pointer to the bytes of a block, wherever they are
+ *      stored.
+ *
+ ************************************************************************/
+static void * get_blob_bytes
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_blob_type    * blob        /* block of bytes                   */
+    )
+{
+if( blob->size <= HMAP_INLINE_SIZE )
+    {
+    return( blob->storage.bytes );
+    }
+
+return( ref_to_ptr( map, blob->storage.ref ) );
+
+}   /* get_blob_bytes() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_bucket_by_hash
+ *
+ *  Description:
+ *      Get a pointer to the map bucket associated with this hash value.
+ *
+ ************************************************************************/
+static hmap_link_type * get_bucket_by_hash
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_link_type        * buckets;
+unsigned int            index;
+
+/*-------------------------------------------------------------
+Convert the key's hash to its bucket index.
+-------------------------------------------------------------*/
+index = key_hash % map->table->buckets_len;
+
+/*-------------------------------------------------------------
+Return the bucket.
+-------------------------------------------------------------*/
+buckets = ref_to_ptr( map, map->table->buckets );
+return( &buckets[ index ] );
+
+}   /* get_bucket_by_hash() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_cpu_features
+ *
+ *  Description:
+ *      Get the HMAP_CPU_* features of the processor this process runs
+ *      on, as reported by cpuid and enabled by the operating system.
+ *      Returns 0 on processors without SIMD kernels.
+ *
+ ************************************************************************/
+static unsigned int get_cpu_features
+    (
+    void
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            features;
+
+/*-------------------------------------------------------------
+Ask the compiler's cpuid support, which also checks that the
+operating system saves the wider registers.
+-------------------------------------------------------------*/
+features = 0;
+#if defined( HMAP_X86 )
+__builtin_cpu_init();
+if( __builtin_cpu_supports( "sse2" ) )
+    {
+    features |= HMAP_CPU_SSE2;
+    }
+if( __builtin_cpu_supports( "sse4.2" ) )
+    {
+    features |= HMAP_CPU_SSE42;
+    }
+if( __builtin_cpu_supports( "avx2" ) )
+    {
+    features |= HMAP_CPU_AVX2;
+    }
+if( __builtin_cpu_supports( "avx512f" ) )
+    {
+    features |= HMAP_CPU_AVX512;
+    }
+#endif
+
+return( features );
+
+}   /* get_cpu_features() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_cuckoo_bucket
+ *
+ *  Description:
+ *      Get the other bucket of an entry in a cuckoo map, given one of
+ *      its buckets and its tag. The mapping is its own inverse, so an
+ *      entry can be moved between its buckets without reading its
+ *      hash.
+ *
+ ************************************************************************/
+static unsigned int get_cuckoo_bucket
+    (
+    unsigned int        buckets_len,/* num buckets, power of 2          */
+    unsigned int        bucket_index,
+                                    /* one bucket of the entry          */
+    unsigned char       tag         /* tag of the entry                 */
+    )
+{
+return( ( bucket_index ^ ( tag * HMAP_CUCKOO_TAG_MIX ) ) & ( buckets_len - 1 ) );
+
+}   /* get_cuckoo_bucket() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_cuckoo_tag
+ *
+ *  Description:
+ *      Get the tag of a hash value in a cuckoo map: its top byte, made
+ *      nonzero as a zero tag marks an empty slot.
+ *
+ ************************************************************************/
+static unsigned char get_cuckoo_tag
+    (
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    )
+{
+if( ( key_hash >> 24 ) == 0 )
+    {
+    return( 1 );
+    }
+
+return( (unsigned char)( key_hash >> 24 ) );
+
+}   /* get_cuckoo_tag() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_dense_index
+ *
+ *  Description:
+ *      Get a slot of a dense map's index table: the entry's position
+ *      in the entry array plus one, or 0 if the slot is empty.
+ *
+ ************************************************************************/
+static unsigned int get_dense_index
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned int        slot        /* slot in index table              */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+void                  * indexes;
+
+/*-------------------------------------------------------------
+Read the slot at the table's index width.
+-------------------------------------------------------------*/
+indexes = ref_to_ptr( map, map->table->buckets );
+switch( map->table->index_size )
+    {
+    case 1:
+        return( ( (unsigned char *)indexes )[ slot ] );
+
+    case 2:
+        return( ( (unsigned short *)indexes )[ slot ] );
+
+    default:
+        return( ( (unsigned int *)indexes )[ slot ] );
+    }
+
+}   /* get_dense_index() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_entry_by_key
+ *
+ *  Description:
+ *      Get a pointer to the entry associated with this key. Returns
+ *      HMAP_INVALID_POINTER if the key does not exist in the hash map.
+ *
+ ************************************************************************/
+static hmap_entry_type * get_entry_by_key
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type    
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            depth;
+hmap_link_type        * link;
+
+/*-------------------------------------------------------------
+Dense, cuckoo and hopscotch maps have their own searches.
+-------------------------------------------------------------*/
+if( map->table->engine == HMAP_ENGINE_DENSE )
+    {
+    return( find_dense_entry( map, key, key_hash ) );
+    }
+
+if( map->table->engine == HMAP_ENGINE_CUCKOO )
+    {
+    return( find_cuckoo_entry( map, key, key_hash ) );
+    }
+
+if( map->table->engine == HMAP_ENGINE_HOPSCOTCH )
+    {
+    return( find_hopscotch_entry( map, key, key_hash ) );
+    }
+
+/*-------------------------------------------------------------
+Follow the link to the matching entry in the key's bucket.
+Returns an invalid pointer if no entry was found.
+-------------------------------------------------------------*/
+link = get_entry_link( map, key, key_hash, &depth );
+if( *link == HMAP_INVALID_LINK )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+return( link_to_ptr( map, *link ) );
+
+}   /* get_entry_by_key() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_entry_data
+ *
+ *  Description:
+ *      Get a pointer to an entry's data without bringing it back into
+ *      memory, for scans of the whole map. Spilled data is read into
+ *      the spill buffer, and is valid until the next read. Returns
+ *      HMAP_INVALID_POINTER if the data could not be read.
+ *
+ ************************************************************************/
+static void * get_entry_data
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to read                    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_spill_type       * spill;
+
+/*-------------------------------------------------------------
+Data in memory is read in place.
+-------------------------------------------------------------*/
+if( ( entry->flags & HMAP_ENTRY_SPILLED ) == 0 )
+    {
+    return( get_blob_bytes( map, &entry->data ) );
+    }
+
+/*-------------------------------------------------------------
+Read spilled data into the spill buffer.
+-------------------------------------------------------------*/
+spill = map->spill;
+if( !grow_buffer( map, &spill->buffer, &spill->buffer_capacity, 0, entry->data.size )
+ || !read_spill( &spill->files[ get_spill_file( entry ) ], entry->data.storage.ref,
+                 spill->buffer, entry->data.size ) )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+return( spill->buffer );
+
+}   /* get_entry_data() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_entry_key_parts
+ *
+ *  Description:
+ *      Get an entry's key as its shared prefix, empty outside prefix
+ *      mode, and the rest of it, without rebuilding the key.
+ *
+ ************************************************************************/
+static void get_entry_key_parts
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry,      /* entry holding the key            */
+    HMAP_anon_type    * parts       /* out: key's prefix and rest       */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_prefix_type      * prefix;
+
+parts[ 0 ].ptr = HMAP_INVALID_POINTER;
+parts[ 0 ].size = 0;
+parts[ 1 ].ptr = get_blob_bytes( map, &entry->key );
+parts[ 1 ].size = entry->key.size;
+
+/*-------------------------------------------------------------
+Prefix mode keys start with a reference to their prefix.
+-------------------------------------------------------------*/
+if( map->table->key_mode == HMAP_KEY_MODE_PREFIX )
+    {
+    if( *(hmap_ref_type *)parts[ 1 ].ptr != HMAP_INVALID_REF )
+        {
+        prefix = ref_to_ptr( map, *(hmap_ref_type *)parts[ 1 ].ptr );
+        parts[ 0 ].ptr = prefix + 1;
+        parts[ 0 ].size = prefix->size;
+        }
+    parts[ 1 ].ptr = (hmap_ref_type *)parts[ 1 ].ptr + 1;
+    parts[ 1 ].size -= sizeof( hmap_ref_type );
+    }
+
+}   /* get_entry_key_parts() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_entry_link
+ *
+ *  Description:
+ *      Get the link to the entry for the given key in a chained map's
+ *      bucket: the bucket head or the next link of the entry before
+ *      it. The link is HMAP_INVALID_LINK at the end of the bucket if
+ *      no entry was found. Sorted buckets are searched by their index,
+ *      by hash and then by key unless the map has a custom key
+ *      equality.
+ *
+ ************************************************************************/
+static hmap_link_type * get_entry_link
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type    
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    unsigned int      * depth       /* out: num links followed          */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_entry_type       * entry;
+HMAP_anon_type          key_parts[ 2 ];
+hmap_link_type        * link;
+unsigned int            position;
+hmap_sorted_slot_type * slots;
+hmap_sorted_type      * sorted;
+
+/*-------------------------------------------------------------
+Binary search a sorted bucket's index for the key. Entries with
+the key's hash are only ordered by key, and so searched one by
+one, in maps with a custom key equality. The link to the entry
+found is the next link of the one before, and the link to none
+is the next link of the last.
+-------------------------------------------------------------*/
+link = get_bucket_by_hash( map, key_hash );
+sorted = get_sorted_bucket( map, key_hash );
+if( sorted != HMAP_INVALID_POINTER )
+    {
+    slots = (hmap_sorted_slot_type *)( sorted + 1 );
+    key_parts[ 0 ].ptr = HMAP_INVALID_POINTER;
+    key_parts[ 0 ].size = 0;
+    key_parts[ 1 ] = *key;
+    *depth = sorted->count;
+    for( position = get_sorted_position( map, sorted, key_hash, key_parts );
+         position < sorted->count && slots[ position ].key_hash == key_hash;
+         position++ )
+        {
+        if( entry_key_match( map, link_to_ptr( map, slots[ position ].link ), key ) )
+            {
+            *depth = position;
+            break;
+            }
+        if( map->equal == HMAP_INVALID_POINTER )
+            {
+            break;
+            }
+        }
+
+    if( *depth > 0 )
+        {
+        link = &link_to_ptr( map, slots[ *depth - 1 ].link )->next;
+        }
+    return( link );
+    }
+
+/*-------------------------------------------------------------
+Walk the key's bucket for an entry with a matching hash and
+key.
+-------------------------------------------------------------*/
+*depth = 0;
+while( *link != HMAP_INVALID_LINK )
+    {
+    entry = link_to_ptr( map, *link );
+    if( entry->key_hash == key_hash
+     && entry_key_match( map, entry, key ) )
+        {
+        break;
+        }
+    link = &entry->next;
+    ( *depth )++;
+    }
+
+return( link );
+
+}   /* get_entry_link() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_hopscotch_home
+ *
+ *  Description:
+ *      Get the home slot of a hash value in a hopscotch table. The
+ *      hash is mixed first, as keys that differ only in their last
+ *      bytes share the low bits of simple hashes such as sdbm, and
+ *      more than a neighborhood of them would never fit.
+ *
+ ************************************************************************/
+static unsigned int get_hopscotch_home
+    (
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    unsigned int        slots_len   /* num slots, power of 2            */
+    )
+{
+key_hash ^= key_hash >> 16;
+key_hash *= HMAP_HOPSCOTCH_MIX;
+key_hash ^= key_hash >> 13;
+
+return( key_hash & ( slots_len - 1 ) );
+
+}   /* get_hopscotch_home() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_key_size
+ *
+ *  Description:
+ *      Get the size of an entry's key. In prefix mode this includes
+ *      the shared prefix rather than the reference to it.
+ *
+ ************************************************************************/
+static unsigned int get_key_size
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry holding the key            */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_ref_type           prefix_ref;
+unsigned int            size;
+
+/*-------------------------------------------------------------
+Keys stored in full are their own size.
+-------------------------------------------------------------*/
+if( map->table->key_mode != HMAP_KEY_MODE_PREFIX )
+    {
+    return( entry->key.size );
+    }
+
+/*-------------------------------------------------------------
+Swap the prefix reference for the prefix.
+-------------------------------------------------------------*/
+size = entry->key.size - sizeof( prefix_ref );
+prefix_ref = *(hmap_ref_type *)get_blob_bytes( map, &entry->key );
+if( prefix_ref != HMAP_INVALID_REF )
+    {
+    size += ( (hmap_prefix_type *)ref_to_ptr( map, prefix_ref ) )->size;
+    }
+
+return( size );
+
+}   /* get_key_size() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_malloc_size
+ *
+ *  Description:
+ *      Get the bytes set aside for a block allocated with the map's
+ *      malloc: the usable size if the map has a usable_size hook,
+ *      otherwise the size requested.
+ *
+ ************************************************************************/
+static unsigned long long get_malloc_size
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    void              * memory,     /* allocated block                  */
+    unsigned long long  size        /* num bytes requested              */
+    )
+{
+if( map->usable_size != HMAP_INVALID_POINTER )
+    {
+    return( map->usable_size( memory ) );
+    }
+
+return( size );
+
+}   /* get_malloc_size() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_memory_in_use
+ *
+ *  Description:
+ *      Get the bytes the map holds in memory, counted as
+ *      HMAP_get_size counts them, less the data spilled to a file.
+ *
+ ************************************************************************/
+static unsigned long long get_memory_in_use
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    )
+{
+if( map->spill != HMAP_INVALID_POINTER )
+    {
+    return( map->table->size - map->spill->live_size[ 0 ] - map->spill->live_size[ 1 ] );
+    }
+
+return( map->table->size );
+
+}   /* get_memory_in_use() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_memory_size
+ *
+ *  Description:
+ *      Get the bytes set aside for a block allocated with
+ *      alloc_memory. A shared map's block takes its whole size class,
+ *      header included.
+ *
+ ************************************************************************/
+static unsigned long long get_memory_size
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    void              * memory,     /* allocated block                  */
+    unsigned long long  size        /* num bytes requested              */
+    )
+{
+if( map->region != HMAP_INVALID_POINTER )
+    {
+    return( (unsigned long long)1 << ( (hmap_block_type *)memory - 1 )->size_class );
+    }
+
+return( get_malloc_size( map, memory, size ) );
+
+}   /* get_memory_size() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_prefix_size
+ *
+ *  Description:
+ *      Get the size of the part of a key to share as a prefix in prefix
+ *      mode: the key up to and including its last separator. Returns 0
+ *      if the key has no prefix long enough to be worth sharing.
+ *
+ ************************************************************************/
+static unsigned int get_prefix_size
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key         /* hash map entry key               */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            size;
+
+/*-------------------------------------------------------------
+Find the last separator.
+-------------------------------------------------------------*/
+for( size = key->size; size >= HMAP_PREFIX_MIN; size-- )
+    {
+    if( ( (unsigned char *)key->ptr )[ size - 1 ] == map->table->key_separator )
+        {
+        return( size );
+        }
+    }
+
+return( 0 );
+
+}   /* get_prefix_size() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_record_size
+ *
+ *  Description:
+ *      Get the size of the map's entries. Entries of ordered maps
+ *      also know their place in the order array.
+ *
+ ************************************************************************/
+static unsigned int get_record_size
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    )
+{
+if( map->table->ordered != HMAP_BOOL_FALSE )
+    {
+    return( sizeof( hmap_ordered_entry_type ) );
+    }
+
+return( sizeof( hmap_entry_type ) );
+
+}   /* get_record_size() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_slab
+ *
+ *  Description:
+ *      Get the slab holding a record. Slab n holds HMAP_SLAB_MIN << n
+ *      records, numbered on from those of the slabs before it.
+ *
+ ************************************************************************/
+static unsigned int get_slab
+    (
+    unsigned int        record      /* record number                    */
+    )
+{
+return( 31 - (unsigned int)__builtin_clz( record / HMAP_SLAB_MIN + 1 ) );
+
+}   /* get_slab() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_sorted_bucket
+ *
+ *  Description:
+ *      Get the index of the bucket associated with this hash value, or
+ *      HMAP_INVALID_POINTER if the bucket is not sorted.
+ *
+ ************************************************************************/
+static hmap_sorted_type * get_sorted_bucket
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of a key in bucket    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_ref_type           sorted_ref;
+
+/*-------------------------------------------------------------
+Maps without sorted buckets have no table of them.
+-------------------------------------------------------------*/
+if( map->table->sorted == HMAP_INVALID_REF )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+sorted_ref = ( (hmap_ref_type *)ref_to_ptr( map, map->table->sorted ) )
+                 [ key_hash % map->table->buckets_len ];
+if( sorted_ref == HMAP_INVALID_REF )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+return( ref_to_ptr( map, sorted_ref ) );
+
+}   /* get_sorted_bucket() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_sorted_position
+ *
+ *  Description:
+ *      Binary search a sorted bucket's index for the first slot that
+ *      does not order before the given hash and key.
+ *
+ ************************************************************************/
+static unsigned int get_sorted_position
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_sorted_type  * sorted,     /* index of a sorted bucket         */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    HMAP_anon_type
+                const * key_parts   /* key as prefix and rest, or NULL  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            high;
+unsigned int            low;
+unsigned int            middle;
+hmap_sorted_slot_type * slots;
+
+slots = (hmap_sorted_slot_type *)( sorted + 1 );
+low = 0;
+high = sorted->count;
+while( low < high )
+    {
+    middle = low + ( high - low ) / 2;
+    if( compare_sorted_slot( map, &slots[ middle ], key_hash, key_parts ) < 0 )
+        {
+        low = middle + 1;
+        }
+    else
+        {
+        high = middle;
+        }
+    }
+
+return( low );
+
+}   /* get_sorted_position() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      get_spill_file
+ *
+ *  Description:
+ *      Get the index of the spill file holding a spilled entry's data.
+ *
+ ************************************************************************/
+static unsigned int get_spill_file
+    (
+    hmap_entry_type   * entry       /* spilled entry                    */
+    )
+{
+if( ( entry->flags & HMAP_ENTRY_SPILL_FILE ) != 0 )
+    {
+    return( 1 );
+    }
+
+return( 0 );
+
+}   /* get_spill_file() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      grow_buffer
+ *
+ *  Description:
+ *      Make a local buffer hold at least size bytes, keeping its first
+ *      length bytes. Returns HMAP_BOOL_FALSE if it could not be grown.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 grow_buffer
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned char    ** buffer,     /* in/out: buffer                   */
+    unsigned int      * capacity,   /* in/out: size of buffer           */
+    unsigned int        length,     /* num bytes to keep                */
+    unsigned int        size        /* num bytes needed                 */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+unsigned char         * grown;
+unsigned long long      grown_size;
+
+/*-------------------------------------------------------------
+Nothing to do if the buffer is large enough.
+-------------------------------------------------------------*/
+if( *capacity >= size
+ && *buffer   != HMAP_INVALID_POINTER )
+    {
+    return( HMAP_BOOL_TRUE );
+    }
+
+/*-------------------------------------------------------------
+Grow geometrically so repeated growth is amortized.
+-------------------------------------------------------------*/
+grown_size = (unsigned long long)*capacity * 2;
+if( grown_size < size )
+    {
+    grown_size = size;
+    }
+if( grown_size > 0xFFFFFFFFu )
+    {
+    grown_size = size;
+    }
+
+grown = map->malloc( grown_size == 0 ? 1 : grown_size );
+if( grown == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+for( i = 0; i < length; i++ )
+    {
+    grown[ i ] = ( *buffer )[ i ];
+    }
+if( *buffer != HMAP_INVALID_POINTER )
+    {
+    map->free( *buffer );
+    }
+
+*buffer = grown;
+*capacity = (unsigned int)grown_size;
+return( HMAP_BOOL_TRUE );
+
+}   /* grow_buffer() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      grow_intern_slots
+ *
+ *  Description:
+ *      Double the size of an interning table's index. Returns
+ *      HMAP_BOOL_FALSE if memory could not be allocated.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 grow_intern_slots
+    (
+    hmap_intern_type  * intern      /* interning table private data     */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+unsigned int            j;
+hmap_intern_slot_type * slots;
+unsigned int            slots_len;
+
+/*-------------------------------------------------------------
+Allocate the empty index.
+-------------------------------------------------------------*/
+if( intern->slots_len > 0x40000000u )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+slots_len = intern->slots_len * 2;
+
+slots = intern->malloc( (unsigned long long)slots_len * sizeof(*slots) );
+if( slots == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+for( i = 0; i < slots_len; i++ )
+    {
+    slots[ i ].id = 0;
+    }
+
+/*-------------------------------------------------------------
+Move the IDs over using their stored hashes.
+-------------------------------------------------------------*/
+for( i = 0; i < intern->slots_len; i++ )
+    {
+    if( intern->slots[ i ].id != 0 )
+        {
+        j = intern->slots[ i ].hash & ( slots_len - 1 );
+        while( slots[ j ].id != 0 )
+            {
+            j = ( j + 1 ) & ( slots_len - 1 );
+            }
+        slots[ j ] = intern->slots[ i ];
+        }
+    }
+
+intern->free( intern->slots );
+intern->slots = slots;
+intern->slots_len = slots_len;
+
+return( HMAP_BOOL_TRUE );
+
+}   /* grow_intern_slots() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      hash_keys
+ *
+ *  Description:
+ *      Hash a batch of keys with the map's batch kernel, or one at a
+ *      time with its hashing function if it has none.
+ *
+ ************************************************************************/
+static void hash_keys
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * keys,       /* keys to hash                     */
+    unsigned int        count,      /* num keys                         */
+    HMAP_hash_val_type
+                      * hashes      /* out: hash value per key          */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+
+/*-------------------------------------------------------------
+Use the batch kernel if there is one. Custom hashing functions
+hash one key at a time.
+-------------------------------------------------------------*/
+if( map->hash_batch != HMAP_INVALID_POINTER )
+    {
+    map->hash_batch( keys, count, hashes );
+    return;
+    }
+
+for( i = 0; i < count; i++ )
+    {
+    hashes[ i ] = map->hash( &keys[ i ] );
+    }
+
+}   /* hash_keys() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      hash_sdbm
+ *
+ *  Description:
+ *      The default hash function implements the SDBM algorithm
+ *
+ ************************************************************************/
+static HMAP_hash_val_type hash_sdbm
+    (
+    const HMAP_anon_type
+                      * key         /* hash map entry key               */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+HMAP_hash_val_type      hash;
+unsigned int            i;
+unsigned char         * key_bytes;
+
+/*-------------------------------------------------------------
+Initalize variables
+-------------------------------------------------------------*/
+hash = 0;
+key_bytes = (unsigned char *)( key->ptr );
+
+/*-------------------------------------------------------------
+Hash the key
+-------------------------------------------------------------*/
+for( i = 0; i < key->size; i++ )
+    {
+    /*---------------------------------------------------------
+    hash = ( hash * 65599 ) + byte
+    ---------------------------------------------------------*/
+    hash = (hash << 16) + (hash << 6) - hash + key_bytes[ i ];
+    }
+
+return( hash );
+
+}   /* hash_sdbm() */
+
+
+#if defined( HMAP_X86 )
+/*************************************************************************
+ *
+ *  Procedure:
+ *      hash_sdbm_avx2
+ *
+ *  Description:
+ *      AVX2 kernel of hash_sdbm, giving the same hash. Eight lanes
+ *      each hash every eighth byte, stepping by 65599^8, and are then
+ *      weighted by their distance from the end of the last block.
+ *
+ ************************************************************************/
+static HMAP_TARGET_AVX2 HMAP_hash_val_type hash_sdbm_avx2
+    (
+    const HMAP_anon_type
+                      * key         /* hash map entry key               */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+__m256i                 hash_lanes;
+__m128i                 hash_sum;
+HMAP_hash_val_type      hash;
+unsigned int            i;
+unsigned char const   * key_bytes;
+__m256i                 step;
+
+/*-------------------------------------------------------------
+Initalize variables
+-------------------------------------------------------------*/
+key_bytes = key->ptr;
+hash_lanes = _mm256_setzero_si256();
+step = _mm256_set1_epi32( (int)hmap_sdbm_powers[ HMAP_SDBM_POWERS - 1 - 8 ] );
+
+/*-------------------------------------------------------------
+Hash whole blocks in the lanes.
+-------------------------------------------------------------*/
+for( i = 0; i + 8 <= key->size; i += 8 )
+    {
+    hash_lanes = _mm256_add_epi32( _mm256_mullo_epi32( hash_lanes, step ),
+                                   _mm256_cvtepu8_epi32( _mm_loadl_epi64( (__m128i const *)&key_bytes[ i ] ) ) );
+    }
+
+/*-------------------------------------------------------------
+Weight and sum the lanes.
+-------------------------------------------------------------*/
+hash_lanes = _mm256_mullo_epi32( hash_lanes, _mm256_loadu_si256( (__m256i const *)&hmap_sdbm_powers[ HMAP_SDBM_POWERS - 8 ] ) );
+hash_sum = _mm_add_epi32( _mm256_castsi256_si128( hash_lanes ), _mm256_extracti128_si256( hash_lanes, 1 ) );
+hash_sum = _mm_add_epi32( hash_sum, _mm_shuffle_epi32( hash_sum, 0x4E ) );
+hash_sum = _mm_add_epi32( hash_sum, _mm_shuffle_epi32( hash_sum, 0xB1 ) );
+hash = (HMAP_hash_val_type)_mm_cvtsi128_si32( hash_sum );
+
+/*-------------------------------------------------------------
+Hash the remaining bytes one at a time.
+-------------------------------------------------------------*/
+for( ; i < key->size; i++ )
+    {
+    hash = (hash << 16) + (hash << 6) - hash + key_bytes[ i ];
+    }
+
+return( hash );
+
+}   /* hash_sdbm_avx2() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      hash_sdbm_avx512
+ *
+ *  Description:
+ *      AVX-512 kernel of hash_sdbm, giving the same hash with sixteen
+ *      lanes.
+ *
+ ************************************************************************/
+static HMAP_TARGET_AVX512 HMAP_hash_val_type hash_sdbm_avx512
+    (
+    const HMAP_anon_type
+                      * key         /* hash map entry key               */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+__m256i                 hash_half;
+__m512i                 hash_lanes;
+__m128i                 hash_sum;
+HMAP_hash_val_type      hash;
+unsigned int            i;
+unsigned char const   * key_bytes;
+__m512i                 step;
+
+/*-------------------------------------------------------------
+Initalize variables
+-------------------------------------------------------------*/
+key_bytes = key->ptr;
+hash_lanes = _mm512_setzero_si512();
+step = _mm512_set1_epi32( (int)hmap_sdbm_powers[ HMAP_SDBM_POWERS - 1 - 16 ] );
+
+/*-------------------------------------------------------------
+Hash whole blocks in the lanes.
+-------------------------------------------------------------*/
+for( i = 0; i + 16 <= key->size; i += 16 )
+    {
+    hash_lanes = _mm512_add_epi32( _mm512_mullo_epi32( hash_lanes, step ),
+                                   _mm512_cvtepu8_epi32( _mm_loadu_si128( (__m128i const *)&key_bytes[ i ] ) ) );
+    }
+
+/*-------------------------------------------------------------
+Weight and sum the lanes.
+-------------------------------------------------------------*/
+hash_lanes = _mm512_mullo_epi32( hash_lanes, _mm512_loadu_si512( &hmap_sdbm_powers[ HMAP_SDBM_POWERS - 16 ] ) );
+hash_half = _mm256_add_epi32( _mm512_castsi512_si256( hash_lanes ), _mm512_extracti64x4_epi64( hash_lanes, 1 ) );
+hash_sum = _mm_add_epi32( _mm256_castsi256_si128( hash_half ), _mm256_extracti128_si256( hash_half, 1 ) );
+hash_sum = _mm_add_epi32( hash_sum, _mm_shuffle_epi32( hash_sum, 0x4E ) );
+hash_sum = _mm_add_epi32( hash_sum, _mm_shuffle_epi32( hash_sum, 0xB1 ) );
+hash = (HMAP_hash_val_type)_mm_cvtsi128_si32( hash_sum );
+
+/*-------------------------------------------------------------
+Hash the remaining bytes one at a time.
+-------------------------------------------------------------*/
+for( ; i < key->size; i++ )
+    {
+    hash = (hash << 16) + (hash << 6) - hash + key_bytes[ i ];
+    }
+
+return( hash );
+
+}   /* hash_sdbm_avx512() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      hash_sdbm_batch_avx2
+ *
+ *  Description:
+ *      AVX2 batch kernel of the SDBM hash. Groups of eight keys of the
+ *      same size are hashed together, one key per lane, four bytes of
+ *      each key at a time. Other keys are hashed one at a time.
+ *
+ ************************************************************************/
+static HMAP_TARGET_AVX2 void hash_sdbm_batch_avx2
+    (
+    HMAP_anon_type
+                const * keys,       /* keys to hash                     */
+    unsigned int        count,      /* num keys                         */
+    HMAP_hash_val_type
+                      * hashes      /* out: hash value per key          */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+__m256i                 block;
+unsigned int            first;
+__m256i                 hash_lanes;
+unsigned int            i;
+unsigned char const   * key_bytes[ 8 ];
+unsigned int            lane;
+__m256i                 mask;
+__m256i                 powers[ 5 ];
+unsigned int            size;
+unsigned int            words[ 8 ];
+
+/*-------------------------------------------------------------
+Initalize variables
+-------------------------------------------------------------*/
+mask = _mm256_set1_epi32( 0xFF );
+for( i = 0; i < 5; i++ )
+    {
+    powers[ i ] = _mm256_set1_epi32( (int)hmap_sdbm_powers[ HMAP_SDBM_POWERS - 1 - i ] );
+    }
+
+/*-------------------------------------------------------------
+Hash each group of keys.
+-------------------------------------------------------------*/
+for( first = 0; first + 8 <= count; first += 8 )
+    {
+    size = keys[ first ].size;
+    for( lane = 0; lane < 8; lane++ )
+        {
+        key_bytes[ lane ] = keys[ first + lane ].ptr;
+        if( keys[ first + lane ].size != size )
+            {
+            break;
+            }
+        }
+
+    if( lane < 8 )
+        {
+        for( lane = 0; lane < 8; lane++ )
+            {
+            hashes[ first + lane ] = hash_sdbm_avx2( &keys[ first + lane ] );
+            }
+        continue;
+        }
+
+    /*---------------------------------------------------------
+    Hash whole words of the keys, then their remaining bytes.
+    ---------------------------------------------------------*/
+    hash_lanes = _mm256_setzero_si256();
+    for( i = 0; i + 4 <= size; i += 4 )
+        {
+        for( lane = 0; lane < 8; lane++ )
+            {
+            words[ lane ] = decode_u32( &key_bytes[ lane ][ i ] );
+            }
+        block = _mm256_loadu_si256( (__m256i const *)words );
+        hash_lanes = _mm256_mullo_epi32( hash_lanes, powers[ 4 ] );
+        hash_lanes = _mm256_add_epi32( hash_lanes, _mm256_mullo_epi32( _mm256_and_si256( block, mask ), powers[ 3 ] ) );
+        hash_lanes = _mm256_add_epi32( hash_lanes, _mm256_mullo_epi32( _mm256_and_si256( _mm256_srli_epi32( block, 8 ), mask ), powers[ 2 ] ) );
+        hash_lanes = _mm256_add_epi32( hash_lanes, _mm256_mullo_epi32( _mm256_and_si256( _mm256_srli_epi32( block, 16 ), mask ), powers[ 1 ] ) );
+        hash_lanes = _mm256_add_epi32( hash_lanes, _mm256_srli_epi32( block, 24 ) );
+        }
+
+    for( ; i < size; i++ )
+        {
+        for( lane = 0; lane < 8; lane++ )
+            {
+            words[ lane ] = key_bytes[ lane ][ i ];
+            }
+        hash_lanes = _mm256_add_epi32( _mm256_mullo_epi32( hash_lanes, powers[ 1 ] ),
+                                       _mm256_loadu_si256( (__m256i const *)words ) );
+        }
+
+    _mm256_storeu_si256( (__m256i *)&hashes[ first ], hash_lanes );
+    }
+
+/*-------------------------------------------------------------
+Hash the keys left over one at a time.
+-------------------------------------------------------------*/
+for( ; first < count; first++ )
+    {
+    hashes[ first ] = hash_sdbm_avx2( &keys[ first ] );
+    }
+
+}   /* hash_sdbm_batch_avx2() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      hash_sdbm_batch_avx512
+ *
+ *  Description:
+ *      AVX-512 batch kernel of the SDBM hash, hashing groups of sixteen
+ *      keys of the same size together. Smaller groups go to the AVX2
+ *      batch kernel.
+ *
+ ************************************************************************/
+static HMAP_TARGET_AVX512 void hash_sdbm_batch_avx512
+    (
+    HMAP_anon_type
+                const * keys,       /* keys to hash                     */
+    unsigned int        count,      /* num keys                         */
+    HMAP_hash_val_type
+                      * hashes      /* out: hash value per key          */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+__m512i                 block;
+unsigned int            first;
+__m512i                 hash_lanes;
+unsigned int            i;
+unsigned char const   * key_bytes[ 16 ];
+unsigned int            lane;
+__m512i                 mask;
+__m512i                 powers[ 5 ];
+unsigned int            size;
+unsigned int            words[ 16 ];
+
+/*-------------------------------------------------------------
+Initalize variables
+-------------------------------------------------------------*/
+mask = _mm512_set1_epi32( 0xFF );
+for( i = 0; i < 5; i++ )
+    {
+    powers[ i ] = _mm512_set1_epi32( (int)hmap_sdbm_powers[ HMAP_SDBM_POWERS - 1 - i ] );
+    }
+
+/*-------------------------------------------------------------
+Hash each group of keys.
+-------------------------------------------------------------*/
+for( first = 0; first + 16 <= count; first += 16 )
+    {
+    size = keys[ first ].size;
+    for( lane = 0; lane < 16; lane++ )
+        {
+        key_bytes[ lane ] = keys[ first + lane ].ptr;
+        if( keys[ first + lane ].size != size )
+            {
+            break;
+            }
+        }
+
+    if( lane < 16 )
+        {
+        hash_sdbm_batch_avx2( &keys[ first ], 16, &hashes[ first ] );
+        continue;
+        }
+
+    /*---------------------------------------------------------
+    Hash whole words of the keys, then their remaining bytes.
+    ---------------------------------------------------------*/
+    hash_lanes = _mm512_setzero_si512();
+    for( i = 0; i + 4 <= size; i += 4 )
+        {
+        for( lane = 0; lane < 16; lane++ )
+            {
+            words[ lane ] = decode_u32( &key_bytes[ lane ][ i ] );
+            }
+        block = _mm512_loadu_si512( words );
+        hash_lanes = _mm512_mullo_epi32( hash_lanes, powers[ 4 ] );
+        hash_lanes = _mm512_add_epi32( hash_lanes, _mm512_mullo_epi32( _mm512_and_si512( block, mask ), powers[ 3 ] ) );
+        hash_lanes = _mm512_add_epi32( hash_lanes, _mm512_mullo_epi32( _mm512_and_si512( _mm512_srli_epi32( block, 8 ), mask ), powers[ 2 ] ) );
+        hash_lanes = _mm512_add_epi32( hash_lanes, _mm512_mullo_epi32( _mm512_and_si512( _mm512_srli_epi32( block, 16 ), mask ), powers[ 1 ] ) );
+        hash_lanes = _mm512_add_epi32( hash_lanes, _mm512_srli_epi32( block, 24 ) );
+        }
+
+    for( ; i < size; i++ )
+        {
+        for( lane = 0; lane < 16; lane++ )
+            {
+            words[ lane ] = key_bytes[ lane ][ i ];
+            }
+        hash_lanes = _mm512_add_epi32( _mm512_mullo_epi32( hash_lanes, powers[ 1 ] ),
+                                       _mm512_loadu_si512( words ) );
+        }
+
+    _mm512_storeu_si512( &hashes[ first ], hash_lanes );
+    }
+
+/*-------------------------------------------------------------
+Hash the keys left over.
+-------------------------------------------------------------*/
+hash_sdbm_batch_avx2( &keys[ first ], count - first, &hashes[ first ] );
+
+}   /* hash_sdbm_batch_avx512() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      hash_sdbm_sse42
+ *
+ *  Description:
+ *      SSE4 kernel of hash_sdbm, giving the same hash with four lanes.
+ *
+ ************************************************************************/
+static HMAP_TARGET_SSE42 HMAP_hash_val_type hash_sdbm_sse42
+    (
+    const HMAP_anon_type
+                      * key         /* hash map entry key               */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+__m128i                 hash_lanes;
+HMAP_hash_val_type      hash;
+unsigned int            i;
+unsigned char const   * key_bytes;
+__m128i                 step;
+
+/*-------------------------------------------------------------
+Initalize variables
+-------------------------------------------------------------*/
+key_bytes = key->ptr;
+hash_lanes = _mm_setzero_si128();
+step = _mm_set1_epi32( (int)hmap_sdbm_powers[ HMAP_SDBM_POWERS - 1 - 4 ] );
+
+/*-------------------------------------------------------------
+Hash whole blocks in the lanes.
+-------------------------------------------------------------*/
+for( i = 0; i + 4 <= key->size; i += 4 )
+    {
+    hash_lanes = _mm_add_epi32( _mm_mullo_epi32( hash_lanes, step ),
+                                _mm_cvtepu8_epi32( _mm_cvtsi32_si128( (int)( key_bytes[ i ]
+                                                                           | key_bytes[ i + 1 ] << 8
+                                                                           | key_bytes[ i + 2 ] << 16
+                                                                           | (unsigned int)key_bytes[ i + 3 ] << 24 ) ) ) );
+    }
+
+/*-------------------------------------------------------------
+Weight and sum the lanes.
+-------------------------------------------------------------*/
+hash_lanes = _mm_mullo_epi32( hash_lanes, _mm_loadu_si128( (__m128i const *)&hmap_sdbm_powers[ HMAP_SDBM_POWERS - 4 ] ) );
+hash_lanes = _mm_add_epi32( hash_lanes, _mm_shuffle_epi32( hash_lanes, 0x4E ) );
+hash_lanes = _mm_add_epi32( hash_lanes, _mm_shuffle_epi32( hash_lanes, 0xB1 ) );
+hash = (HMAP_hash_val_type)_mm_cvtsi128_si32( hash_lanes );
+
+/*-------------------------------------------------------------
+Hash the remaining bytes one at a time.
+-------------------------------------------------------------*/
+for( ; i < key->size; i++ )
+    {
+    hash = (hash << 16) + (hash << 6) - hash + key_bytes[ i ];
+    }
+
+return( hash );
+
+}   /* hash_sdbm_sse42() */
+#endif
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      insert_sorted
+ *
+ *  Description:
+ *      Link an entry into a sorted bucket ahead of the entries that do
+ *      not order before it, and add its slot to the bucket's index.
+ *      Returns HMAP_BOOL_FALSE if the index could not grow to hold it
+ *      within memory and the map's size limit.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 insert_sorted
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to add                     */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_sorted_type      * grown;
+unsigned int            i;
+HMAP_anon_type          key_parts[ 2 ];
+hmap_link_type        * link;
+unsigned int            position;
+hmap_sorted_slot_type * slots;
+hmap_sorted_type      * sorted;
+hmap_ref_type         * sorted_ref;
+
+sorted_ref = (hmap_ref_type *)ref_to_ptr( map, map->table->sorted )
+           + entry->key_hash % map->table->buckets_len;
+sorted = ref_to_ptr( map, *sorted_ref );
+
+/*-------------------------------------------------------------
+Double the index if it is full and the map's size limit
+allows.
+-------------------------------------------------------------*/
+if( sorted->count == sorted->capacity )
+    {
+    if( !reserve_memory( map, HMAP_INVALID_POINTER, (unsigned long long)sorted->capacity * sizeof(*slots) ) )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    grown = alloc_memory( map, sizeof(*grown) + 2ull * sorted->capacity * sizeof(*slots) );
+    if( grown == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+
+    grown->count = sorted->count;
+    grown->capacity = 2 * sorted->capacity;
+    for( i = 0; i < sorted->count; i++ )
+        {
+        ( (hmap_sorted_slot_type *)( grown + 1 ) )[ i ] = ( (hmap_sorted_slot_type *)( sorted + 1 ) )[ i ];
+        }
+
+    map->table->size += sorted->capacity * sizeof(*slots);
+    free_memory( map, sorted );
+    sorted = grown;
+    *sorted_ref = ptr_to_ref( map, sorted );
+    }
+
+/*-------------------------------------------------------------
+Link the entry after the entry of the slot before its own.
+-------------------------------------------------------------*/
+slots = (hmap_sorted_slot_type *)( sorted + 1 );
+get_entry_key_parts( map, entry, key_parts );
+position = get_sorted_position( map, sorted, entry->key_hash, key_parts );
+link = get_bucket_by_hash( map, entry->key_hash );
+if( position > 0 )
+    {
+    link = &link_to_ptr( map, slots[ position - 1 ].link )->next;
+    }
+entry->next = *link;
+*link = ptr_to_link( map, entry );
+
+/*-------------------------------------------------------------
+Make room for its slot.
+-------------------------------------------------------------*/
+for( i = sorted->count; i > position; i-- )
+    {
+    slots[ i ] = slots[ i - 1 ];
+    }
+slots[ position ].key_hash = entry->key_hash;
+slots[ position ].link = *link;
+sorted->count++;
+
+return( HMAP_BOOL_TRUE );
+
+}   /* insert_sorted() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      link_entry
+ *
+ *  Description:
+ *      Add a new entry to the map's table: to the top of its bucket in
+ *      a chained map, to the first free slot from its home slot in a
+ *      dense map's index table, to one of its buckets in a cuckoo map,
+ *      or to its neighborhood in a hopscotch map. Returns
+ *      HMAP_STATUS_OUT_OF_MEMORY if a cuckoo or hopscotch map had to
+ *      grow and memory could not be allocated or the map's size limit
+ *      would be crossed, and HMAP_STATUS_TOO_MANY_COLLISIONS if growing
+ *      could not make room for an entry among those sharing its hash.
+ *
+ ************************************************************************/
+static HMAP_status_t8 link_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry to add                     */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_link_type        * bucket;
+hmap_entry_type       * entries;
+unsigned int            length;
+hmap_link_type          link;
+hmap_entry_type       * next;
+unsigned int            resizes;
+unsigned int            slot;
+
+/*-------------------------------------------------------------
+Dense maps index the entry's record.
+-------------------------------------------------------------*/
+if( map->table->engine == HMAP_ENGINE_DENSE )
+    {
+    entries = ref_to_ptr( map, map->table->entries );
+    slot = entry->key_hash & ( map->table->buckets_len - 1 );
+    while( get_dense_index( map, slot ) != 0 )
+        {
+        slot = ( slot + 1 ) & ( map->table->buckets_len - 1 );
+        }
+    set_dense_index( map, slot, (unsigned int)( entry - entries ) + 1 );
+    return( HMAP_STATUS_SUCCESS );
+    }
+
+/*-------------------------------------------------------------
+Cuckoo maps grow until the entry can be placed, a few times at
+most. Growing can not help once both of the entry's buckets
+are full of entries with its hash.
+-------------------------------------------------------------*/
+if( map->table->engine == HMAP_ENGINE_CUCKOO )
+    {
+    for( resizes = 0;
+         !place_cuckoo_entry( map, ref_to_ptr( map, map->table->buckets ), map->table->buckets_len, entry );
+         resizes++ )
+        {
+        if( resizes == HMAP_CUCKOO_RESIZES
+         || count_cuckoo_hash( map, entry->key_hash ) >= 2 * HMAP_CUCKOO_WAYS )
+            {
+            return( HMAP_STATUS_TOO_MANY_COLLISIONS );
+            }
+        if( !resize_cuckoo( map ) )
+            {
+            return( HMAP_STATUS_OUT_OF_MEMORY );
+            }
+        }
+    return( HMAP_STATUS_SUCCESS );
+    }
+
+/*-------------------------------------------------------------
+Hopscotch maps grow until the entry can be placed, a few times
+at most. Growing can not help once the neighborhood of the
+entry's home slot is full of entries with its hash.
+-------------------------------------------------------------*/
+if( map->table->engine == HMAP_ENGINE_HOPSCOTCH )
+    {
+    for( resizes = 0;
+         !place_hopscotch_entry( map, ref_to_ptr( map, map->table->buckets ), map->table->buckets_len, entry );
+         resizes++ )
+        {
+        if( resizes == HMAP_HOPSCOTCH_RESIZES
+         || count_hopscotch_hash( map, entry->key_hash ) >= HMAP_HOPSCOTCH_RANGE )
+            {
+            return( HMAP_STATUS_TOO_MANY_COLLISIONS );
+            }
+        if( !resize_hopscotch( map ) )
+            {
+            return( HMAP_STATUS_OUT_OF_MEMORY );
+            }
+        }
+    return( HMAP_STATUS_SUCCESS );
+    }
+
+/*-------------------------------------------------------------
+Insert the entry in its place in a sorted bucket. A sorted
+bucket whose index can not grow goes back to an unsorted chain.
+-------------------------------------------------------------*/
+if( get_sorted_bucket( map, entry->key_hash ) != HMAP_INVALID_POINTER )
+    {
+    if( insert_sorted( map, entry ) )
+        {
+        return( HMAP_STATUS_SUCCESS );
+        }
+    free_sorted_bucket( map, entry->key_hash );
+    }
+
+/*-------------------------------------------------------------
+Push the entry to the top of its bucket, and sort the bucket
+if it has grown too long to walk.
+-------------------------------------------------------------*/
+bucket = get_bucket_by_hash( map, entry->key_hash );
+entry->next = *bucket;
+*bucket = ptr_to_link( map, entry );
+
+length = 0;
+for( link = *bucket; link != HMAP_INVALID_LINK && length <= HMAP_SORTED_MAX; link = next->next )
+    {
+    next = link_to_ptr( map, link );
+    length++;
+    }
+
+if( length > HMAP_SORTED_MAX )
+    {
+    sort_bucket( map, entry->key_hash );
+    }
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* link_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      link_to_ptr
+ *
+ *  Description:
+ *      Convert a link to a pointer to its entry. The link must not be
+ *      HMAP_INVALID_LINK.
+ *
+ ************************************************************************/
+static hmap_entry_type * link_to_ptr
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_link_type      link        /* link to an entry                 */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            record;
+unsigned int            slab;
+
+/*-------------------------------------------------------------
+Find the record's slab and its place in the slab.
+-------------------------------------------------------------*/
+record = link - 1;
+slab = get_slab( record );
+record -= HMAP_SLAB_MIN * ( ( 1u << slab ) - 1 );
+
+return( (hmap_entry_type *)( (unsigned char *)ref_to_ptr( map, map->table->slabs[ slab ] )
+                           + (unsigned long long)record * get_record_size( map ) ) );
+
+}   /* link_to_ptr() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      link_to_ref
+ *
+ *  Description:
+ *      Convert a link to a reference to its entry, or to
+ *      HMAP_INVALID_REF if it is HMAP_INVALID_LINK.
+ *
+ ************************************************************************/
+static hmap_ref_type link_to_ref
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_link_type      link        /* link to an entry, or invalid     */
+    )
+{
+if( link == HMAP_INVALID_LINK )
+    {
+    return( HMAP_INVALID_REF );
+    }
+
+return( ptr_to_ref( map, link_to_ptr( map, link ) ) );
+
+}   /* link_to_ref() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      load_snapshot_block
+ *
+ *  Description:
+ *      Insert the entries of a decompressed snapshot block into the
+ *      map.
+ *
+ ************************************************************************/
+static HMAP_status_t8 load_snapshot_block
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_snapshot_block_type
+                      * block       /* verified snapshot block          */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char         * bytes;
+HMAP_anon_type          data;
+unsigned int            i;
+HMAP_anon_type          key;
+HMAP_hash_val_type      key_hash;
+unsigned int            position;
+unsigned int            size;
+HMAP_status_t8          status;
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+bytes = block->entries;
+position = 0;
+
+/*-------------------------------------------------------------
+Decode and insert each entry: the key hash, the key and data
+sizes as varints, then the key and data bytes.
+-------------------------------------------------------------*/
+for( i = 0; i < block->index.entry_count; i++ )
+    {
+    if( block->index.raw_size - position < 4 )
+        {
+        return( HMAP_STATUS_CORRUPT_DATA );
+        }
+    key_hash = decode_u32( &bytes[ position ] );
+    position += 4;
+
+    size = decode_varint( &bytes[ position ], block->index.raw_size - position, &key.size );
+    if( size == 0 )
+        {
+        return( HMAP_STATUS_CORRUPT_DATA );
+        }
+    position += size;
+
+    size = decode_varint( &bytes[ position ], block->index.raw_size - position, &data.size );
+    if( size == 0 )
+        {
+        return( HMAP_STATUS_CORRUPT_DATA );
+        }
+    position += size;
+
+    if( key.size > block->index.raw_size - position
+     || data.size > block->index.raw_size - position - key.size )
+        {
+        return( HMAP_STATUS_CORRUPT_DATA );
+        }
+    key.ptr = &bytes[ position ];
+    data.ptr = &bytes[ position + key.size ];
+    position += key.size + data.size;
+
+    status = set_entry_data( map, &key, key_hash, &data );
+    if( status != HMAP_STATUS_SUCCESS )
+        {
+        return( status );
+        }
+    }
+
+return( HMAP_STATUS_SUCCESS );
+
+}   /* load_snapshot_block() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      lock_map
+ *
+ *  Description:
+ *      Lock a shared map for reading or writing. Any number of readers
+ *      or a single writer may hold the lock. The lock is a spin lock in
+ *      the shared region, so it works across processes. A waiting
+ *      writer keeps new readers out, and waiters back off between
+ *      attempts. Heap maps are not locked.
+ *
+ ************************************************************************/
+static void lock_map
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_bool_t8        write       /* lock for writing                 */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            i;
+unsigned int            lock;
+unsigned int            spins;
+
+/*-------------------------------------------------------------
+Only shared maps are locked.
+-------------------------------------------------------------*/
+if( map->region == HMAP_INVALID_POINTER )
+    {
+    return;
+    }
+
+/*-------------------------------------------------------------
+A writer waits for the readers to leave, marking itself pending
+so no new readers enter meanwhile. A reader waits for no writer
+to hold or wait for the lock, then adds itself to the reader
+count. Each failed attempt pauses twice as long as the last, up
+to HMAP_LOCK_SPIN_MAX pauses.
+-------------------------------------------------------------*/
+spins = 1;
+for( ;; )
+    {
+    lock = __atomic_load_n( &map->region->lock, __ATOMIC_RELAXED );
+    if( write )
+        {
+        if( ( lock & ~HMAP_LOCK_PENDING ) == 0
+         && __atomic_compare_exchange_n( &map->region->lock, &lock, HMAP_LOCK_WRITER,
+                                         HMAP_BOOL_FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) )
+            {
+            return;
+            }
+        if( ( lock & HMAP_LOCK_PENDING ) == 0 )
+            {
+            __atomic_fetch_or( &map->region->lock, HMAP_LOCK_PENDING, __ATOMIC_RELAXED );
+            }
+        }
+    else
+        {
+        if( ( lock & ( HMAP_LOCK_WRITER | HMAP_LOCK_PENDING ) ) == 0
+         && __atomic_compare_exchange_n( &map->region->lock, &lock, lock + 1,
+                                         HMAP_BOOL_FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) )
+            {
+            return;
+            }
+        }
+
+    for( i = 0; i < spins; i++ )
+        {
+        HMAP_CPU_PAUSE();
+        }
+    if( spins < HMAP_LOCK_SPIN_MAX )
+        {
+        spins *= 2;
+        }
+    }
+
+}   /* lock_map() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      log_mutation
+ *
+ *  Description:
+ *      Append a redo record for a set (data given) or remove (data is
+ *      HMAP_INVALID_POINTER) to the map's log, and end the group if the
+ *      sync policy calls for it. A record is the record type, the key
+ *      hash, the key and data sizes as varints, the key and data bytes
+ *      and a checksum of all of the above. Nothing is appended to a
+ *      failed log.
+ *
+ ************************************************************************/
+static HMAP_status_t8 log_mutation
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned char       record_type,/* HMAP_LOG_RECORD_SET or _REMOVE   */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    HMAP_anon_type
+                const * key,        /* entry key                        */
+    HMAP_anon_type
+                const * data        /* entry data, or invalid           */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            checksum;
+unsigned char           checksum_bytes[ HMAP_CHECKSUM_SIZE ];
+hmap_log_type         * log;
+unsigned char           prefix[ HMAP_LOG_PREFIX_MAX ];
+unsigned int            prefix_size;
+HMAP_bool_t8            written;
+
+/*-------------------------------------------------------------
+Initialize variables
+-------------------------------------------------------------*/
+log = map->log;
+if( log->failed )
+    {
+    return( HMAP_STATUS_IO_ERROR );
+    }
+
+/*-------------------------------------------------------------
+Encode the record prefix and checksum the record.
+-------------------------------------------------------------*/
+prefix[ 0 ] = record_type;
+encode_u32( &prefix[ 1 ], key_hash );
+prefix_size = 5;
+prefix_size += encode_varint( &prefix[ prefix_size ], key->size );
+if( data != HMAP_INVALID_POINTER )
+    {
+    prefix_size += encode_varint( &prefix[ prefix_size ], data->size );
+    }
+
+checksum = compute_checksum( HMAP_CHECKSUM_SEED, prefix, prefix_size );
+checksum = compute_checksum( checksum, key->ptr, key->size );
+if( data != HMAP_INVALID_POINTER )
+    {
+    checksum = compute_checksum( checksum, data->ptr, data->size );
+    }
+encode_u32( checksum_bytes, checksum );
+
+/*-------------------------------------------------------------
+Append the record.
+-------------------------------------------------------------*/
+written = append_log( log, prefix, prefix_size )
+       && append_log( log, key->ptr, key->size )
+       && ( data == HMAP_INVALID_POINTER
+         || append_log( log, data->ptr, data->size ) )
+       && append_log( log, checksum_bytes, sizeof( checksum_bytes ) );
+
+/*-------------------------------------------------------------
+End the group per the sync policy.
+-------------------------------------------------------------*/
+log->group_count++;
+if( written )
+    {
+    if( log->sync_policy == HMAP_LOG_SYNC_EVERY
+     || ( log->sync_policy == HMAP_LOG_SYNC_GROUP
+       && log->group_count >= log->group_size ) )
+        {
+        written = flush_log( log, HMAP_BOOL_TRUE );
+        }
+    }
+
+return( written ? HMAP_STATUS_SUCCESS : HMAP_STATUS_IO_ERROR );
+
+}   /* log_mutation() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      lookup_entry
+ *
+ *  Description:
+ *      Get a pointer to the entry associated with this key for a read.
+ *      A move-to-front map counts the hit and every few hits found
+ *      past the head of their bucket are moved to the head, so hot
+ *      keys gather there without a write on every lookup. Writes find
+ *      their entries with get_entry_by_key and are not counted.
+ *
+ ************************************************************************/
+static hmap_entry_type * lookup_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_link_type        * bucket;
+unsigned int            depth;
+hmap_entry_type       * entry;
+hmap_link_type          entry_link;
+hmap_link_type        * link;
+
+if( map->table->move_to_front == HMAP_BOOL_FALSE )
+    {
+    return( get_entry_by_key( map, key, key_hash ) );
+    }
+
+/*-------------------------------------------------------------
+Find the link to the entry and count the hit.
+-------------------------------------------------------------*/
+link = get_entry_link( map, key, key_hash, &depth );
+if( *link == HMAP_INVALID_LINK )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+entry = link_to_ptr( map, *link );
+
+map->table->hits++;
+map->table->hit_depth += depth;
+
+/*-------------------------------------------------------------
+Move every few deep hits to the head. Sorted buckets keep their
+order.
+-------------------------------------------------------------*/
+if( depth > 0
+ && ( ++map->table->deep_hits % HMAP_FRONT_INTERVAL ) == 0
+ && get_sorted_bucket( map, key_hash ) == HMAP_INVALID_POINTER )
+    {
+    entry_link = *link;
+    *link = entry->next;
+    bucket = get_bucket_by_hash( map, key_hash );
+    entry->next = *bucket;
+    *bucket = entry_link;
+    }
+
+return( entry );
+
+}   /* lookup_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      next_entry
+ *
+ *  Description:
+ *      Get the next entry of the map, in insertion order for dense and
+ *      ordered maps and in bucket order otherwise. The iterator must start at
+ *      bucket 0 with an invalid entry. Returns HMAP_INVALID_POINTER
+ *      after the last entry. The map must not be changed during the
+ *      iteration.
+ *
+ ************************************************************************/
+static hmap_entry_type * next_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_iterator_type* iterator    /* in/out: position in map          */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_link_type        * buckets;
+hmap_cuckoo_bucket_type
+                      * cuckoo_bucket;
+hmap_cuckoo_bucket_type
+                      * cuckoo_buckets;
+hmap_entry_type       * entries;
+hmap_entry_type       * entry;
+hmap_ref_type         * order;
+hmap_hopscotch_slot_type
+                      * slots;
+
+/*-------------------------------------------------------------
+Dense maps are scanned along their entry array, which is in
+insertion order, skipping removed records.
+-------------------------------------------------------------*/
+if( map->table->engine == HMAP_ENGINE_DENSE )
+    {
+    entries = ref_to_ptr( map, map->table->entries );
+    while( iterator->bucket < map->table->entries_len )
+        {
+        entry = &entries[ iterator->bucket++ ];
+        if( entry->size != 0 )
+            {
+            return( entry );
+            }
+        }
+    return( HMAP_INVALID_POINTER );
+    }
+
+/*-------------------------------------------------------------
+Ordered maps are scanned in insertion order, skipping removed
+entries.
+-------------------------------------------------------------*/
+if( map->table->ordered != HMAP_BOOL_FALSE )
+    {
+    order = ref_to_ptr( map, map->table->order );
+    while( iterator->bucket < map->table->order_len )
+        {
+        if( order[ iterator->bucket++ ] != HMAP_INVALID_REF )
+            {
+            return( ref_to_ptr( map, order[ iterator->bucket - 1 ] ) );
+            }
+        }
+    return( HMAP_INVALID_POINTER );
+    }
+
+/*-------------------------------------------------------------
+Cuckoo maps are scanned slot by slot, using bucket as the
+number of slots passed.
+-------------------------------------------------------------*/
+if( map->table->engine == HMAP_ENGINE_CUCKOO )
+    {
+    cuckoo_buckets = ref_to_ptr( map, map->table->buckets );
+    while( iterator->bucket < map->table->buckets_len * HMAP_CUCKOO_WAYS )
+        {
+        cuckoo_bucket = &cuckoo_buckets[ iterator->bucket / HMAP_CUCKOO_WAYS ];
+        if( cuckoo_bucket->tags[ iterator->bucket++ % HMAP_CUCKOO_WAYS ] != 0 )
+            {
+            return( ref_to_ptr( map, cuckoo_bucket->entries[ ( iterator->bucket - 1 ) % HMAP_CUCKOO_WAYS ] ) );
+            }
+        }
+    return( HMAP_INVALID_POINTER );
+    }
+
+/*-------------------------------------------------------------
+Hopscotch maps are scanned slot by slot.
+-------------------------------------------------------------*/
+if( map->table->engine == HMAP_ENGINE_HOPSCOTCH )
+    {
+    slots = ref_to_ptr( map, map->table->buckets );
+    while( iterator->bucket < map->table->buckets_len )
+        {
+        if( slots[ iterator->bucket++ ].entry != HMAP_INVALID_REF )
+            {
+            return( ref_to_ptr( map, slots[ iterator->bucket - 1 ].entry ) );
+            }
+        }
+    return( HMAP_INVALID_POINTER );
+    }
+
+/*-------------------------------------------------------------
+Find the next non-empty bucket if the current one is done.
+-------------------------------------------------------------*/
+buckets = ref_to_ptr( map, map->table->buckets );
+while( iterator->entry == HMAP_INVALID_REF )
+    {
+    if( iterator->bucket >= map->table->buckets_len )
+        {
+        return( HMAP_INVALID_POINTER );
+        }
+    iterator->entry = link_to_ref( map, buckets[ iterator->bucket++ ] );
+    }
+
+/*-------------------------------------------------------------
+Return the entry and advance along its bucket.
+-------------------------------------------------------------*/
+entry = ref_to_ptr( map, iterator->entry );
+iterator->entry = link_to_ref( map, entry->next );
+
+return( entry );
+
+}   /* next_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      open_segment
+ *
+ *  Description:
+ *      Allocate a new current value segment, at a free index if there
+ *      is one. The old current segment is freed if none of its data is
+ *      live. Returns HMAP_BOOL_FALSE if memory could not be allocated,
+ *      leaving the current segment as is.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 open_segment
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char         * bytes;
+unsigned int            capacity;
+unsigned int            i;
+unsigned int            index;
+hmap_segment_type     * list;
+hmap_segments_type    * segments;
+
+/*-------------------------------------------------------------
+Find a free index, growing the list if there is none.
+-------------------------------------------------------------*/
+segments = map->segments;
+for( index = 0; index < segments->count; index++ )
+    {
+    if( segments->list[ index ].bytes == HMAP_INVALID_POINTER )
+        {
+        break;
+        }
+    }
+
+if( index == segments->capacity )
+    {
+    capacity = segments->capacity * 2;
+    if( capacity == 0 )
+        {
+        capacity = HMAP_SEGMENT_LIST_MIN;
+        }
+    list = map->malloc( (unsigned long long)capacity * sizeof(*list) );
+    if( list == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    for( i = 0; i < segments->count; i++ )
+        {
+        list[ i ] = segments->list[ i ];
+        }
+    if( segments->list != HMAP_INVALID_POINTER )
+        {
+        map->free( segments->list );
+        }
+    segments->list = list;
+    segments->capacity = capacity;
+    }
+
+/*-------------------------------------------------------------
+Allocate the segment.
+-------------------------------------------------------------*/
+bytes = alloc_memory( map, segments->segment_size );
+if( bytes == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+if( index == segments->count )
+    {
+    segments->count++;
+    }
+segments->list[ index ].bytes = bytes;
+segments->list[ index ].used = 0;
+segments->list[ index ].live = 0;
+segments->list[ index ].evacuating = HMAP_BOOL_FALSE;
+
+/*-------------------------------------------------------------
+Switch to it, freeing the old current segment if it is empty.
+-------------------------------------------------------------*/
+i = segments->current;
+segments->current = index;
+if( i != HMAP_SEGMENT_NONE
+ && segments->list[ i ].live == 0 )
+    {
+    close_segment( map, i );
+    }
+
+return( HMAP_BOOL_TRUE );
+
+}   /* open_segment() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      pack_snapshot_entry
+ *
+ *  Description:
+ *      Append an entry to a raw snapshot block. Returns HMAP_BOOL_FALSE
+ *      if the block could not be grown.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 pack_snapshot_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_snapshot_block_type
+                      * block,      /* block being filled               */
+    hmap_entry_type   * entry       /* entry to pack                    */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char         * bytes;
+unsigned int            data_size;
+HMAP_anon_type          destination;
+unsigned int            key_size;
+unsigned int            position;
+HMAP_anon_type          source;
+
+/*-------------------------------------------------------------
+Make room for the entry. Only the used part of a multimap's
+value list is saved.
+-------------------------------------------------------------*/
+position = block->index.raw_size;
+key_size = get_key_size( map, entry );
+source.ptr = get_entry_data( map, entry );
+data_size = entry->data.size;
+if( source.ptr == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+if( map->table->multimap != HMAP_BOOL_FALSE )
+    {
+    data_size = decode_u32( (unsigned char *)source.ptr + 4 );
+    }
+
+if( !grow_buffer( map, &block->raw, &block->raw_capacity, position,
+                  position + HMAP_SNAPSHOT_PREFIX_MAX + key_size + data_size ) )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+bytes = block->raw;
+
+/*-------------------------------------------------------------
+Encode the key hash and sizes, then copy the key and data.
+-------------------------------------------------------------*/
+encode_u32( &bytes[ position ], entry->key_hash );
+position += 4;
+position += encode_varint( &bytes[ position ], key_size );
+position += encode_varint( &bytes[ position ], data_size );
+
+copy_entry_key( map, entry, &bytes[ position ] );
+position += key_size;
+
+destination.ptr = &bytes[ position ];
+source.size = data_size;
+copy_anon_data( &destination, &source );
+position += data_size;
+
+block->index.raw_size = position;
+block->index.entry_count++;
+
+return( HMAP_BOOL_TRUE );
+
+}   /* pack_snapshot_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      place_cuckoo_entry
+ *
+ *  Description:
+ *      Place an entry in one of its two buckets of a cuckoo table. If
+ *      both are full, a breadth first search looks for the shortest
+ *      chain of entries that can each be moved to their other bucket
+ *      to free a slot, and moves them. Returns HMAP_BOOL_FALSE if no
+ *      chain was found within HMAP_CUCKOO_SEARCH buckets.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 place_cuckoo_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_cuckoo_bucket_type
+                      * buckets,    /* table to place the entry in      */
+    unsigned int        buckets_len,/* num buckets, power of 2          */
+    hmap_entry_type   * entry       /* entry to place                   */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_cuckoo_bucket_type
+                      * bucket;
+unsigned int            bucket_index;
+unsigned int            count;
+unsigned int            free_slot;
+unsigned int            head;
+unsigned int            i;
+unsigned int            node;
+unsigned int            other;
+hmap_cuckoo_node_type   search[ HMAP_CUCKOO_SEARCH ];
+unsigned int            slot;
+unsigned char           tag;
+
+/*-------------------------------------------------------------
+Start the search from both of the entry's buckets.
+-------------------------------------------------------------*/
+tag = get_cuckoo_tag( entry->key_hash );
+search[ 0 ].bucket = entry->key_hash & ( buckets_len - 1 );
+search[ 0 ].parent = 0;
+search[ 0 ].slot = 0;
+search[ 1 ].bucket = get_cuckoo_bucket( buckets_len, search[ 0 ].bucket, tag );
+search[ 1 ].parent = 1;
+search[ 1 ].slot = 0;
+count = 2;
+
+/*-------------------------------------------------------------
+Visit the buckets in the order they were reached. A bucket with
+a free slot ends the search; the entries of a full bucket lead
+on to their other buckets.
+-------------------------------------------------------------*/
+for( head = 0; head < count; head++ )
+    {
+    bucket = &buckets[ search[ head ].bucket ];
+    for( free_slot = 0; free_slot < HMAP_CUCKOO_WAYS; free_slot++ )
+        {
+        if( bucket->tags[ free_slot ] == 0 )
+            {
+            break;
+            }
+        }
+
+    if( free_slot < HMAP_CUCKOO_WAYS )
+        {
+        break;
+        }
+
+    for( slot = 0; slot < HMAP_CUCKOO_WAYS && count < HMAP_CUCKOO_SEARCH; slot++ )
+        {
+        /*-----------------------------------------------------
+        Skip buckets already on the path to this one, as moving
+        an entry twice along one path would lose another.
+        -----------------------------------------------------*/
+        other = get_cuckoo_bucket( buckets_len, search[ head ].bucket, bucket->tags[ slot ] );
+        node = head;
+        while( search[ node ].bucket != other
+            && search[ node ].parent != node )
+            {
+            node = search[ node ].parent;
+            }
+        if( search[ node ].bucket != other )
+            {
+            search[ count ].bucket = other;
+            search[ count ].parent = head;
+            search[ count ].slot = (unsigned char)slot;
+            count++;
+            }
+        }
+    }
+
+if( head == count )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Walk the path back to where it started, moving each entry on
+it into the slot freed ahead of it. A moved entry could land
+behind the scan of a save in progress, so it is packed first.
+-------------------------------------------------------------*/
+node = head;
+while( search[ node ].parent != node )
+    {
+    bucket = &buckets[ search[ search[ node ].parent ].bucket ];
+    i = search[ node ].slot;
+    preserve_entry( map, ref_to_ptr( map, bucket->entries[ i ] ) );
+    buckets[ search[ node ].bucket ].tags[ free_slot ] = bucket->tags[ i ];
+    buckets[ search[ node ].bucket ].entries[ free_slot ] = bucket->entries[ i ];
+    free_slot = i;
+    node = search[ node ].parent;
+    }
+
+/*-------------------------------------------------------------
+Place the entry in the slot freed in one of its buckets.
+-------------------------------------------------------------*/
+bucket_index = search[ node ].bucket;
+buckets[ bucket_index ].tags[ free_slot ] = tag;
+buckets[ bucket_index ].entries[ free_slot ] = ptr_to_ref( map, entry );
+
+return( HMAP_BOOL_TRUE );
+
+}   /* place_cuckoo_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      place_hopscotch_entry
+ *
+ *  Description:
+ *      Place an entry in the neighborhood of its home slot in a
+ *      hopscotch table. The nearest empty slot is found by probing
+ *      forward; while it is outside the neighborhood, an entry between
+ *      the two whose own neighborhood reaches the empty slot is moved
+ *      into it, bringing the empty slot closer. Returns
+ *      HMAP_BOOL_FALSE if there is no empty slot within
+ *      HMAP_HOPSCOTCH_PROBE slots, or it could not be brought close
+ *      enough.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 place_hopscotch_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_hopscotch_slot_type
+                      * slots,      /* table to place the entry in      */
+    unsigned int        slots_len,  /* num slots, power of 2            */
+    hmap_entry_type   * entry       /* entry to place                   */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            distance;
+unsigned int            empty;
+unsigned int            from;
+unsigned int            home;
+unsigned int            i;
+unsigned int            owner;
+unsigned int            reach;
+
+/*-------------------------------------------------------------
+Find the nearest empty slot.
+-------------------------------------------------------------*/
+home = get_hopscotch_home( entry->key_hash, slots_len );
+for( distance = 0; distance < HMAP_HOPSCOTCH_PROBE && distance < slots_len; distance++ )
+    {
+    if( slots[ ( home + distance ) & ( slots_len - 1 ) ].entry == HMAP_INVALID_REF )
+        {
+        break;
+        }
+    }
+
+if( distance == HMAP_HOPSCOTCH_PROBE
+ || distance == slots_len )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+empty = ( home + distance ) & ( slots_len - 1 );
+
+/*-------------------------------------------------------------
+Move the empty slot back into the home slot's neighborhood.
+Owners are tried from the farthest from the empty slot, and
+each owner's entries from the nearest to the owner, so each
+move goes as far back as possible. A moved entry is packed for
+a save in progress first, as it could land behind its scan.
+-------------------------------------------------------------*/
+while( distance >= HMAP_HOPSCOTCH_RANGE )
+    {
+    from = empty;
+    for( reach = HMAP_HOPSCOTCH_RANGE - 1; reach > 0 && from == empty; reach-- )
+        {
+        owner = ( empty - reach ) & ( slots_len - 1 );
+        for( i = 0; i < reach; i++ )
+            {
+            if( ( slots[ owner ].hop & ( 1u << i ) ) != 0 )
+                {
+                from = ( owner + i ) & ( slots_len - 1 );
+                preserve_entry( map, ref_to_ptr( map, slots[ from ].entry ) );
+                slots[ empty ].entry = slots[ from ].entry;
+                slots[ empty ].hash = slots[ from ].hash;
+                slots[ owner ].hop |= 1u << reach;
+                slots[ owner ].hop &= ~( 1u << i );
+                distance -= reach - i;
+                break;
+                }
+            }
+        }
+
+    if( from == empty )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    slots[ from ].entry = HMAP_INVALID_REF;
+    empty = from;
+    }
+
+/*-------------------------------------------------------------
+Place the entry.
+-------------------------------------------------------------*/
+slots[ empty ].entry = ptr_to_ref( map, entry );
+slots[ empty ].hash = entry->key_hash;
+slots[ home ].hop |= 1u << distance;
+
+return( HMAP_BOOL_TRUE );
+
+}   /* place_hopscotch_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      prefetch_bucket
+ *
+ *  Description:
+ *      Start loading the bucket or slot where a lookup of this hash
+ *      value begins.
+ *
+ ************************************************************************/
+static void prefetch_bucket
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char         * buckets;
+unsigned int            mask;
+
+/*-------------------------------------------------------------
+Find the address each engine reads first.
+-------------------------------------------------------------*/
+if( map->table->buckets_len == 0 )
+    {
+    return;
+    }
+
+buckets = ref_to_ptr( map, map->table->buckets );
+mask = map->table->buckets_len - 1;
+if( map->table->engine == HMAP_ENGINE_DENSE )
+    {
+    __builtin_prefetch( &buckets[ ( key_hash & mask ) * map->table->index_size ] );
+    }
+else if( map->table->engine == HMAP_ENGINE_CUCKOO )
+    {
+    __builtin_prefetch( &( (hmap_cuckoo_bucket_type *)buckets )[ key_hash & mask ] );
+    }
+else if( map->table->engine == HMAP_ENGINE_HOPSCOTCH )
+    {
+    __builtin_prefetch( &( (hmap_hopscotch_slot_type *)buckets )[ get_hopscotch_home( key_hash, map->table->buckets_len ) ] );
+    }
+else
+    {
+    __builtin_prefetch( get_bucket_by_hash( map, key_hash ) );
+    }
+
+}   /* prefetch_bucket() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      preserve_entry
+ *
+ *  Description:
+ *      Pack an entry into the save in progress if it has not been
+ *      yet. Called before an entry is changed, removed or moved, and
+ *      by the save's scan. A full block moves the save on to the
+ *      next; the last block of the wave grows until the next step
+ *      writes the wave. Failures are kept for the next step to
+ *      report, so the change itself goes ahead.
+ *
+ ************************************************************************/
+static void preserve_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry about to change            */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_snapshot_block_type
+                      * block;
+hmap_save_type        * save;
+
+/*-------------------------------------------------------------
+Nothing to do without a save, or if the entry is packed.
+-------------------------------------------------------------*/
+save = map->save;
+if( save == HMAP_INVALID_POINTER
+ || entry->epoch == map->table->save_epoch )
+    {
+    return;
+    }
+entry->epoch = map->table->save_epoch;
+
+if( save->status != HMAP_STATUS_SUCCESS )
+    {
+    return;
+    }
+
+/*-------------------------------------------------------------
+Pack the entry.
+-------------------------------------------------------------*/
+block = &save->wave->blocks[ save->wave->count ];
+if( !pack_snapshot_entry( map, block, entry ) )
+    {
+    save->status = HMAP_STATUS_OUT_OF_MEMORY;
+    return;
+    }
+
+if( block->index.raw_size >= save->block_size
+ && save->wave->count < HMAP_SNAPSHOT_WAVE - 1 )
+    {
+    save->wave->count++;
+    }
+
+}   /* preserve_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      ptr_to_link
+ *
+ *  Description:
+ *      Convert a pointer to a slab record to its link, by finding the
+ *      slab it is in. There are few slabs, as each is twice the size
+ *      of the one before.
+ *
+ ************************************************************************/
+static hmap_link_type ptr_to_link
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry in a slab record           */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned long long      offset;
+unsigned int            record_size;
+unsigned int            slab;
+
+/*-------------------------------------------------------------
+Find the slab the record is in.
+-------------------------------------------------------------*/
+record_size = get_record_size( map );
+for( slab = 0; slab < HMAP_SLAB_COUNT; slab++ )
+    {
+    if( map->table->slabs[ slab ] == HMAP_INVALID_REF )
+        {
+        continue;
+        }
+    offset = (uintptr_t)entry - (uintptr_t)ref_to_ptr( map, map->table->slabs[ slab ] );
+    if( offset < ( (unsigned long long)HMAP_SLAB_MIN << slab ) * record_size )
+        {
+        return( (hmap_link_type)( HMAP_SLAB_MIN * ( ( 1u << slab ) - 1 ) + offset / record_size + 1 ) );
+        }
+    }
+
+return( HMAP_INVALID_LINK );
+
+}   /* ptr_to_link() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      ptr_to_ref
+ *
+ *  Description:
+ *      Convert a pointer to map memory to a map reference.
+ *
+ ************************************************************************/
+static hmap_ref_type ptr_to_ref
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    void              * ptr         /* pointer to map memory            */
+    )
+{
+return( (hmap_ref_type)( (uintptr_t)ptr - (uintptr_t)map->base ) );
+
+}   /* ptr_to_ref() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      read_log_record
+ *
+ *  Description:
+ *      Read the next record from a log. The key and data point into the
+ *      reader's buffer and are valid until the next read. For header
+ *      records, key_hash receives the log's hash type. Returns
+ *      HMAP_BOOL_FALSE at the end of the log, at the first torn or
+ *      corrupt record, or on error (see the reader status).
+ *
+ ************************************************************************/
+static HMAP_bool_t8 read_log_record
+    (
+    hmap_log_reader_type
+                      * reader,     /* log reader                       */
+    unsigned char     * record_type,/* out: type of record              */
+    HMAP_hash_val_type* key_hash,   /* out: key hash                    */
+    HMAP_anon_type    * key,        /* out: entry key                   */
+    HMAP_anon_type    * data        /* out: entry data                  */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            available;
+unsigned char         * bytes;
+unsigned int            checksum;
+unsigned int            prefix_size;
+unsigned int            size;
+unsigned long long      record_size;
+
+/*-------------------------------------------------------------
+Buffer the record prefix, which may be cut short by the end
+of the log.
+-------------------------------------------------------------*/
+available = fill_log_reader( reader, HMAP_LOG_PREFIX_MAX );
+if( available == 0 )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+bytes = &reader->buffer[ reader->position ];
+*record_type = bytes[ 0 ];
+key->size = 0;
+data->size = 0;
+
+/*-------------------------------------------------------------
+Determine the size of the record.
+-------------------------------------------------------------*/
+switch( *record_type )
+    {
+    case HMAP_LOG_RECORD_HEADER:
+        if( available < HMAP_LOG_HEADER_SIZE
+         || decode_u32( &bytes[ 1 ] ) != HMAP_LOG_MAGIC
+         || bytes[ 5 ] != HMAP_LOG_VERSION )
+            {
+            return( HMAP_BOOL_FALSE );
+            }
+        prefix_size = HMAP_LOG_HEADER_SIZE - HMAP_CHECKSUM_SIZE;
+        *key_hash = bytes[ 6 ];
+        break;
+
+    case HMAP_LOG_RECORD_SET:
+    case HMAP_LOG_RECORD_REMOVE:
+        if( available < 5 )
+            {
+            return( HMAP_BOOL_FALSE );
+            }
+        prefix_size = 5;
+
+        size = decode_varint( &bytes[ prefix_size ], available - prefix_size, &key->size );
+        if( size == 0 )
+            {
+            return( HMAP_BOOL_FALSE );
+            }
+        prefix_size += size;
+
+        if( *record_type == HMAP_LOG_RECORD_SET )
+            {
+            size = decode_varint( &bytes[ prefix_size ], available - prefix_size, &data->size );
+            if( size == 0 )
+                {
+                return( HMAP_BOOL_FALSE );
+                }
+            prefix_size += size;
+            }
+        *key_hash = decode_u32( &bytes[ 1 ] );
+        break;
+
+    default:
+        return( HMAP_BOOL_FALSE );
+    }
+
+record_size = (unsigned long long)prefix_size + key->size + data->size + HMAP_CHECKSUM_SIZE;
+if( record_size > HMAP_LOG_RECORD_MAX )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Buffer the whole record. A short record is torn.
+-------------------------------------------------------------*/
+if( fill_log_reader( reader, (unsigned int)record_size ) < record_size )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Verify the checksum.
+-------------------------------------------------------------*/
+bytes = &reader->buffer[ reader->position ];
+checksum = compute_checksum( HMAP_CHECKSUM_SEED, bytes, (unsigned int)record_size - HMAP_CHECKSUM_SIZE );
+if( checksum != decode_u32( &bytes[ record_size - HMAP_CHECKSUM_SIZE ] ) )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+/*-------------------------------------------------------------
+Return the record and move past it.
+-------------------------------------------------------------*/
+key->ptr = &bytes[ prefix_size ];
+data->ptr = &bytes[ prefix_size + key->size ];
+reader->position += (unsigned int)record_size;
+reader->valid_size = reader->offset + reader->position;
+
+return( HMAP_BOOL_TRUE );
+
+}   /* read_log_record() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      read_lz_length
+ *
+ *  Description:
+ *      Read a sequence length: the token nibble, plus extra length
+ *      bytes if the nibble is 15. Returns HMAP_BOOL_FALSE if the input
+ *      ends early or the length overflows.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 read_lz_length
+    (
+    unsigned char const
+                      * source,     /* compressed bytes                 */
+    unsigned int        source_size,/* num compressed bytes             */
+    unsigned int      * input,      /* in/out: position in source       */
+    unsigned int        nibble,     /* length from the token            */
+    unsigned int      * length      /* out: decoded length              */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char           extra;
+
+/*-------------------------------------------------------------
+Add extra bytes until one is less than 255.
+-------------------------------------------------------------*/
+*length = nibble;
+if( nibble == 15 )
+    {
+    do
+        {
+        if( *input >= source_size
+         || *length > 0xFFFFFFFFu - 255 )
+            {
+            return( HMAP_BOOL_FALSE );
+            }
+        extra = source[ ( *input )++ ];
+        *length += extra;
+        } while( extra == 255 );
+    }
+
+return( HMAP_BOOL_TRUE );
+
+}   /* read_lz_length() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      read_snapshot
+ *
+ *  Description:
+ *      Read exactly size bytes of a snapshot. Returns HMAP_BOOL_FALSE on
+ *      error or if the snapshot ends early.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 read_snapshot
+    (
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to read                 */
+    unsigned long long  offset,     /* snapshot offset                  */
+    void              * buffer,     /* out: bytes read                  */
+    unsigned int        size        /* num bytes to read                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            read_size;
+
+/*-------------------------------------------------------------
+Read until all bytes have arrived.
+-------------------------------------------------------------*/
+while( size > 0 )
+    {
+    if( !snapshot->read( snapshot->context, offset, buffer, size, &read_size )
+     || read_size == 0 )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    offset += read_size;
+    buffer = (unsigned char *)buffer + read_size;
+    size -= read_size;
+    }
+
+return( HMAP_BOOL_TRUE );
+
+}   /* read_snapshot() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      read_snapshot_index
+ *
+ *  Description:
+ *      Read and verify a snapshot's trailer and block index. The index
+ *      is allocated with the given allocator.
+ *
+ ************************************************************************/
+static HMAP_status_t8 read_snapshot_index
+    (
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to read                 */
+    HMAP_malloc_fptr    malloc,     /* index allocator                  */
+    HMAP_free_fptr      free,       /* index deallocator                */
+    hmap_snapshot_index_type
+                     ** out_index,  /* out: block index                 */
+    unsigned int      * block_count,/* out: num blocks                  */
+    unsigned int      * entry_count /* out: num entries                 */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned char         * bytes;
+unsigned int            i;
+hmap_snapshot_index_type
+                      * index;
+unsigned long long      index_offset;
+unsigned long long      index_size;
+unsigned char           trailer[ HMAP_SNAPSHOT_TRAILER_SIZE ];
+
+/*-------------------------------------------------------------
+Read the trailer at the end of the snapshot: the index offset,
+the block and entry counts, the index checksum and the magic.
+-------------------------------------------------------------*/
+if( snapshot->size < HMAP_SNAPSHOT_HEADER_SIZE + HMAP_SNAPSHOT_TRAILER_SIZE )
+    {
+    return( HMAP_STATUS_CORRUPT_DATA );
+    }
+
+if( !read_snapshot( snapshot, snapshot->size - HMAP_SNAPSHOT_TRAILER_SIZE, trailer, sizeof( trailer ) ) )
+    {
+    return( HMAP_STATUS_IO_ERROR );
+    }
+
+index_offset = decode_u32( &trailer[ 0 ] ) | ( (unsigned long long)decode_u32( &trailer[ 4 ] ) << 32 );
+*block_count = decode_u32( &trailer[ 8 ] );
+*entry_count = decode_u32( &trailer[ 12 ] );
+index_size = (unsigned long long)*block_count * HMAP_SNAPSHOT_INDEX_SIZE;
+
+if( decode_u32( &trailer[ 20 ] ) != HMAP_SNAPSHOT_MAGIC
+ || index_offset + index_size + HMAP_SNAPSHOT_TRAILER_SIZE != snapshot->size
+ || index_size > 0xFFFFFFFFu )
+    {
+    return( HMAP_STATUS_CORRUPT_DATA );
+    }
+
+/*-------------------------------------------------------------
+Read and verify the index.
+-------------------------------------------------------------*/
+bytes = malloc( index_size + sizeof(*index) * (unsigned long long)*block_count + 1 );
+if( bytes == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
+index = (hmap_snapshot_index_type *)bytes;
+bytes += sizeof(*index) * (unsigned long long)*block_count;
+
+if( !read_snapshot( snapshot, index_offset, bytes, (unsigned int)index_size ) )
+    {
+    free( index );
+    return( HMAP_STATUS_IO_ERROR );
+    }
+
+if( compute_checksum( HMAP_CHECKSUM_SEED, bytes, (unsigned int)index_size ) != decode_u32( &trailer[ 16 ] ) )
+    {
+    free( index );
+    return( HMAP_STATUS_CORRUPT_DATA );
+    }
+
+/*-------------------------------------------------------------
+Decode the index in place, ahead of its encoded form.
+-------------------------------------------------------------*/
+for( i = 0; i < *block_count; i++ )
+    {
+    index[ i ].offset = decode_u32( &bytes[ 0 ] ) | ( (unsigned long long)decode_u32( &bytes[ 4 ] ) << 32 );
+    index[ i ].stored_size = decode_u32( &bytes[ 8 ] );
+    index[ i ].raw_size = decode_u32( &bytes[ 12 ] );
+    index[ i ].entry_count = decode_u32( &bytes[ 16 ] );
+    index[ i ].checksum = decode_u32( &bytes[ 20 ] );
+    bytes += HMAP_SNAPSHOT_INDEX_SIZE;
+
+    if( index[ i ].offset + index[ i ].stored_size > index_offset )
+        {
+        free( index );
+        return( HMAP_STATUS_CORRUPT_DATA );
+        }
+    }
+
+*out_index = index;
+return( HMAP_STATUS_SUCCESS );
+
+}   /* read_snapshot_index() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      read_snapshot_wave
+ *
+ *  Description:
+ *      Read the next wave of stored blocks of a snapshot being loaded.
+ *      With the snapshot's submit hook the reads are only started,
+ *      tagged from first_tag on, and wait_snapshot_wave waits for
+ *      them. The wave is left empty after the last block.
+ *
+ ************************************************************************/
+static HMAP_status_t8 read_snapshot_wave
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to read                 */
+    hmap_snapshot_wave_type
+                      * wave,       /* out: wave of stored blocks       */
+    unsigned int        first_tag,  /* tag of the wave's first read     */
+    hmap_snapshot_index_type
+                const * index,      /* block index                      */
+    unsigned int        block_count,/* num blocks                       */
+    unsigned int      * next_block  /* in/out: next block to read       */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_snapshot_block_type
+                      * block;
+unsigned int            i;
+
+/*-------------------------------------------------------------
+Take the next blocks of the index.
+-------------------------------------------------------------*/
+wave->count = block_count - *next_block;
+if( wave->count > HMAP_SNAPSHOT_WAVE )
+    {
+    wave->count = HMAP_SNAPSHOT_WAVE;
+    }
+
+/*-------------------------------------------------------------
+Read or start reading each block. If a read fails to start,
+the wave is cut short so only the reads started are waited for.
+-------------------------------------------------------------*/
+for( i = 0; i < wave->count; i++ )
+    {
+    block = &wave->blocks[ i ];
+    block->index = index[ *next_block + i ];
+    if( !grow_buffer( map, &block->stored, &block->stored_capacity, 0, block->index.stored_size )
+     || !grow_buffer( map, &block->raw, &block->raw_capacity, 0, block->index.raw_size ) )
+        {
+        wave->count = i;
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
+
+    if( snapshot->submit != HMAP_INVALID_POINTER
+     && snapshot->wait   != HMAP_INVALID_POINTER )
+        {
+        if( !snapshot->submit( snapshot->context, block->index.offset, block->stored,
+                               block->index.stored_size, first_tag + i ) )
+            {
+            wave->count = i;
+            return( HMAP_STATUS_IO_ERROR );
+            }
+        wave->reading = HMAP_BOOL_TRUE;
+        }
+    else if( !read_snapshot( snapshot, block->index.offset, block->stored, block->index.stored_size ) )
+        {
+        return( HMAP_STATUS_IO_ERROR );
+        }
+    }
+
+*next_block += wave->count;
+return( HMAP_STATUS_SUCCESS );
+
+}   /* read_snapshot_wave() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      read_spill
+ *
+ *  Description:
+ *      Read exactly size bytes of a spill file. Returns HMAP_BOOL_FALSE
+ *      on error or if the file ends early.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 read_spill
+    (
+    HMAP_spill_def_type
+                      * file,       /* spill file to read               */
+    unsigned long long  offset,     /* file offset                      */
+    void              * buffer,     /* out: bytes read                  */
+    unsigned int        size        /* num bytes to read                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            read_size;
+
+/*-------------------------------------------------------------
+Read until all bytes have arrived.
+-------------------------------------------------------------*/
+while( size > 0 )
+    {
+    if( !file->read( file->context, offset, buffer, size, &read_size )
+     || read_size == 0 )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    offset += read_size;
+    buffer = (unsigned char *)buffer + read_size;
+    size -= read_size;
+    }
+
+return( HMAP_BOOL_TRUE );
+
+}   /* read_spill() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      ref_to_ptr
+ *
+ *  Description:
+ *      Convert a map reference to a pointer. The reference must not be
+ *      HMAP_INVALID_REF.
+ *
+ ************************************************************************/
+static void * ref_to_ptr
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_ref_type       ref         /* reference to map memory          */
+    )
+{
+return( (void *)( (uintptr_t)map->base + (uintptr_t)ref ) );
+
+}   /* ref_to_ptr() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      region_alloc
+ *
+ *  Description:
+ *      Allocate a block from the map's shared region. Blocks are sized
+ *      in powers of two, including their header. Returns
+ *      HMAP_INVALID_POINTER if the region is exhausted.
+ *
+ ************************************************************************/
+static void * region_alloc
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned long long  size        /* num bytes to allocate            */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_block_type       * block;
+unsigned long long      block_size;
+hmap_ref_type           block_ref;
+unsigned int            size_class;
+hmap_region_type      * region;
+
+/*-------------------------------------------------------------
+Find the smallest size class that fits the request.
+-------------------------------------------------------------*/
+region = map->region;
+size_class = HMAP_REGION_CLASS_MIN;
+block_size = (unsigned long long)1 << size_class;
+while( block_size < size + sizeof(*block) )
+    {
+    size_class++;
+    block_size <<= 1;
+    }
+
+if( size_class - HMAP_REGION_CLASS_MIN >= HMAP_REGION_CLASS_COUNT )
+    {
+    return( HMAP_INVALID_POINTER );
+    }
+
+/*-------------------------------------------------------------
+Reuse a free block of the class if one is available,
+otherwise carve a new block from the top of the region. The
+first bytes of a free block hold the next free block.
+-------------------------------------------------------------*/
+block_ref = region->free_lists[ size_class - HMAP_REGION_CLASS_MIN ];
+if( block_ref != HMAP_INVALID_REF )
+    {
+    block = ref_to_ptr( map, block_ref );
+    region->free_lists[ size_class - HMAP_REGION_CLASS_MIN ] = *(hmap_ref_type *)( block + 1 );
+    }
+else
+    {
+    if( region->top + block_size > region->region_size )
+        {
+        return( HMAP_INVALID_POINTER );
+        }
+    block = ref_to_ptr( map, region->top );
+    block->size_class = size_class;
+    region->top += block_size;
+    }
+
+return( block + 1 );
+
+}   /* region_alloc() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      region_free
+ *
+ *  Description:
+ *      Return a block to the free list of its size class.
+ *
+ ************************************************************************/
+static void region_free
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    void              * memory      /* memory block to free             */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_block_type       * block;
+unsigned int            list;
+
+/*-------------------------------------------------------------
+Push the block onto its free list.
+-------------------------------------------------------------*/
+block = (hmap_block_type *)memory - 1;
+list = (unsigned int)block->size_class - HMAP_REGION_CLASS_MIN;
+*(hmap_ref_type *)memory = map->region->free_lists[ list ];
+map->region->free_lists[ list ] = ptr_to_ref( map, block );
+
+}   /* region_free() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      release_entry_data
+ *
+ *  Description:
+ *      Release an entry's data, wherever it is. Spilled data is left
+ *      in its file as dead space.
+ *
+ ************************************************************************/
+static void release_entry_data
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry whose data is released     */
+    )
+{
+if( ( entry->flags & HMAP_ENTRY_SPILLED ) != 0 )
+    {
+    map->spill->live_size[ get_spill_file( entry ) ] -= entry->data.size;
+    entry->flags &= ~( HMAP_ENTRY_SPILLED | HMAP_ENTRY_SPILL_FILE );
+    return;
+    }
+
+free_data_blob( map, &entry->data );
+
+}   /* release_entry_data() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      release_prefix
+ *
+ *  Description:
+ *      Drop a user of a shared prefix, freeing the prefix when its
+ *      last user is gone.
+ *
+ ************************************************************************/
+static void release_prefix
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_ref_type       prefix_ref  /* reference to prefix              */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_ref_type         * link;
+hmap_prefix_type      * prefix;
+
+/*-------------------------------------------------------------
+Keep the prefix while other keys use it.
+-------------------------------------------------------------*/
+prefix = ref_to_ptr( map, prefix_ref );
+prefix->refs--;
+if( prefix->refs > 0 )
+    {
+    return;
+    }
+
+/*-------------------------------------------------------------
+Unlink the prefix from its bucket and free it.
+-------------------------------------------------------------*/
+link = (hmap_ref_type *)ref_to_ptr( map, map->table->prefixes )
+     + prefix->hash % map->table->prefixes_len;
+while( *link != prefix_ref )
+    {
+    link = &( (hmap_prefix_type *)ref_to_ptr( map, *link ) )->next;
+    }
+*link = prefix->next;
+
+map->table->prefix_count--;
+map->table->size -= sizeof(*prefix) + prefix->size;
+free_memory( map, prefix );
+
+}   /* release_prefix() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      remove_entry
+ *
+ *  Description:
+ *      Remove the entry for the given key from the map. Returns
+ *      HMAP_BOOL_TRUE if an entry was removed.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 remove_entry
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+unsigned int            depth;
+hmap_entry_type       * entry;
+hmap_link_type        * link;
+
+/*-------------------------------------------------------------
+Find the matching entry in the map. A chained map's entry is
+found by the link to it, which then unlinks it in the same
+pass.
+-------------------------------------------------------------*/
+link = HMAP_INVALID_POINTER;
+if( map->table->engine == HMAP_ENGINE_CHAINED )
+    {
+    link = get_entry_link( map, key, key_hash, &depth );
+    if( *link == HMAP_INVALID_LINK )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    entry = link_to_ptr( map, *link );
+    }
+else
+    {
+    entry = get_entry_by_key( map, key, key_hash );
+    if( entry == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    }
+
+/*-------------------------------------------------------------
+Remove the entry from the map's table and then destroy it,
+keeping it for a save in progress.
+-------------------------------------------------------------*/
+preserve_entry( map, entry );
+if( link != HMAP_INVALID_POINTER )
+    {
+    *link = entry->next;
+    remove_sorted( map, entry );
+    }
+else
+    {
+    unlink_entry( map, entry );
+    }
+destroy_entry( map, entry );
+
+return( HMAP_BOOL_TRUE );
+
+}   /* remove_entry() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      remove_order
+ *
+ *  Description:
+ *      Remove an entry from an ordered map's insertion order, leaving
+ *      an invalid reference in its place. Invalid references at the
+ *      end of the array are dropped.
+ *
+ ************************************************************************/
+static void remove_order
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry being removed              */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+hmap_ref_type         * order;
+
+/*-------------------------------------------------------------
+Clear the entry's slot and trim the end of the array.
+-------------------------------------------------------------*/
+order = ref_to_ptr( map, map->table->order );
+order[ ( (hmap_ordered_entry_type *)entry )->order ] = HMAP_INVALID_REF;
+while( map->table->order_len > 0
+    && order[ map->table->order_len - 1 ] == HMAP_INVALID_REF )
+    {
+    map->table->order_len--;
+    }
+
+}   /* remove_order() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      remove_sorted
+ *
+ *  Description:
+ *      Remove the slot of an entry just unlinked from a sorted bucket.
+ *      The bucket goes back to an unsorted chain once it is short
+ *      enough to walk.
+ *
+ ************************************************************************/
+static void remove_sorted
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * entry       /* entry unlinked from its bucket   */
+    )
+{
+/*-------------------------------------------------------------
+Local variables
+-------------------------------------------------------------*/
+HMAP_anon_type          key_parts[ 2 ];
+hmap_link_type          link;
+unsigned int            position;
+hmap_sorted_slot_type * slots;
+hmap_sorted_type      * sorted;
+
+sorted = get_sorted_bucket( map, entry->key_hash );
+if( sorted == HMAP_INVALID_POINTER )
+    {
+    return;
+    }
+
+/*-------------------------------------------------------------
+Find the entry's slot by its hash and key and close the gap.
+-------------------------------------------------------------*/
+slots = (hmap_sorted_slot_type *)( sorted + 1 );
+link = ptr_to_link( map, entry );
+get_entry_key_parts( map, entry, key_parts );
+position = get_sorted_position( map, sorted, entry->key_hash, key_parts );
+while( slots[ position ].link != link )
+    {
+    position++;
+    }
 
-static unsigned int get_entry_by_hash
-    (
-    hmap_map_type     * map,        /* hash map private data            */
-    HMAP_hash_val_type  key_hash,   /* hash map entry key               */
-    hmap_entry_type  ** entries,    /* out: array of entry ptrs for hash*/
-    unsigned int        entries_len /* capacity of entries array        */
-    );
+sorted->count--;
+for( ; position < sorted->count; position++ )
+    {
+    slots[ position ] = slots[ position + 1 ];
+    }
 
-static hmap_entry_type * get_entry_by_key
-    (
-    hmap_map_type     * map,        /* hash map private data            */
-    HMAP_anon_type    
-                const * key         /* hash map entry key               */
-    );
+if( sorted->count < HMAP_SORTED_MIN )
+    {
+    free_sorted_bucket( map, entry->key_hash );
+    }
 
-static HMAP_hash_val_type hash_sdbm
-    (
-    HMAP_anon_type    
-                const * key         /* hash map entry key               */
-    );
+}   /* remove_sorted() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      HMAP_create
+ *      reserve_memory
  *
  *  Description:
- *      Create a new hash map.
+ *      Check that size more bytes fit within the map's size limit,
+ *      spilling cold data to make room if the map has a spill file.
+ *      Spilled data does not count against the limit. Returns
+ *      HMAP_BOOL_FALSE if the bytes do not fit.
  *
  ************************************************************************/
-HMAP_status_t8 HMAP_create
+static HMAP_bool_t8 reserve_memory
     (
-    HMAP_def_type     * hmap_def,   /* hash map definition              */
-    HMAP_obj_type     * out_obj     /* out: hash map object             */
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * keep,       /* entry not to spill, or NULL      */
+    unsigned long long  size        /* num bytes about to be added      */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
-unsigned int            i;
-hmap_map_type         * map;
+unsigned long long      in_memory;
 
 /*-------------------------------------------------------------
-Verify inputs are not HMAP_INVALID_POINTER
+Without a limit, or bytes to add, anything fits.
 -------------------------------------------------------------*/
-if( hmap_def == HMAP_INVALID_POINTER 
- || out_obj  == HMAP_INVALID_POINTER )
+if( map->size_limit == 0
+ || size == 0 )
     {
-    return( HMAP_STATUS_INVALID_ARG );
-    } 
+    return( HMAP_BOOL_TRUE );
+    }
 
 /*-------------------------------------------------------------
-Verify memory allocator and deallocator functions are defined.
+Spill cold data if the bytes do not fit as things are.
 -------------------------------------------------------------*/
-if( hmap_def->malloc == HMAP_INVALID_POINTER 
- || hmap_def->free   == HMAP_INVALID_POINTER )
+in_memory = get_memory_in_use( map );
+if( in_memory + size > map->size_limit )
     {
-    return( HMAP_STATUS_INVALID_DEF );
-    } 
+    spill_cold_data( map, keep, size );
+    in_memory = get_memory_in_use( map );
+    }
+
+return( in_memory + size <= map->size_limit );
+
+}   /* reserve_memory() */
+
 
+/*************************************************************************
+ *
+ *  Procedure:
+ *      resize_cuckoo
+ *
+ *  Description:
+ *      Move a cuckoo map's entries to a table with twice as many
+ *      buckets, doubling again in the unlikely case that an entry can
+ *      not be placed. Returns HMAP_BOOL_FALSE if memory could not be
+ *      allocated, the growth would take the map over its size limit,
+ *      or the entries still did not fit after HMAP_CUCKOO_RESIZES
+ *      doublings, leaving the map unchanged.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 resize_cuckoo
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    )
+{
 /*-------------------------------------------------------------
-Initialize variables
+Local variables
 -------------------------------------------------------------*/
-map = HMAP_INVALID_POINTER;
-out_obj->data = HMAP_INVALID_POINTER;
+hmap_cuckoo_bucket_type
+                      * buckets;
+unsigned int            buckets_len;
+unsigned int            doublings;
+unsigned int            i;
+HMAP_bool_t8            placed;
+hmap_cuckoo_bucket_type
+                      * resized;
 
 /*-------------------------------------------------------------
-Allocate and initialize the private map data.
+Initialize variables
 -------------------------------------------------------------*/
-map = hmap_def->malloc( sizeof(*map) );
-map->malloc = hmap_def->malloc;
-map->free = hmap_def->free;
-map->entry_count = 0;
-map->data_size = 0;
-map->key_size = 0;
-map->buckets_len = hmap_def->map_size;
-map->buckets = map->malloc( map->buckets_len * sizeof(*map->buckets) );
-for( i = 0; i < map->buckets_len; i++ )
-    {
-    map->buckets[ i ] = HMAP_INVALID_POINTER;
-    }
-map->size = sizeof(*map) + sizeof(*map->buckets) * map->buckets_len;
+buckets = ref_to_ptr( map, map->table->buckets );
+buckets_len = map->table->buckets_len;
+placed = HMAP_BOOL_FALSE;
+resized = HMAP_INVALID_POINTER;
 
 /*-------------------------------------------------------------
-Set the appropriate hashing function per map definition.
+Place every entry in a larger table.
 -------------------------------------------------------------*/
-switch( hmap_def->hash_type )
+for( doublings = 0; !placed; doublings++ )
     {
-    case HMAP_HASH_FUNC_CUSTOM:
-        /*-----------------------------------------------------
-        A custom hash function must be provided if the defined
-        hash type is HMAP_HASH_CUSTOM.
-        -----------------------------------------------------*/
-        if( hmap_def->hash == HMAP_INVALID_POINTER )
+    if( doublings == HMAP_CUCKOO_RESIZES
+     || buckets_len > 0x7FFFFFFFu )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    buckets_len *= 2;
+
+    if( !reserve_memory( map, HMAP_INVALID_POINTER,
+                         sizeof(*resized) * (unsigned long long)( buckets_len - map->table->buckets_len ) ) )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    resized = alloc_memory( map, (unsigned long long)buckets_len * sizeof(*resized) );
+    if( resized == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    clear_cuckoo_buckets( resized, buckets_len );
+
+    placed = HMAP_BOOL_TRUE;
+    for( i = 0; i < map->table->buckets_len * HMAP_CUCKOO_WAYS && placed; i++ )
+        {
+        if( buckets[ i / HMAP_CUCKOO_WAYS ].tags[ i % HMAP_CUCKOO_WAYS ] != 0 )
             {
-            return( HMAP_STATUS_INVALID_DEF );
+            placed = place_cuckoo_entry( map, resized, buckets_len,
+                                         ref_to_ptr( map, buckets[ i / HMAP_CUCKOO_WAYS ].entries[ i % HMAP_CUCKOO_WAYS ] ) );
             }
-        map->hash = hmap_def->hash;
-        break;
-    
-    case HMAP_HASH_FUNC_SDBM:
-    default:
-        map->hash = hash_sdbm;
-        break;
+        }
+
+    if( !placed )
+        {
+        free_memory( map, resized );
+        }
     }
 
 /*-------------------------------------------------------------
-Construct the public map object.
+Switch to the new table.
 -------------------------------------------------------------*/
-out_obj->data = map;
+free_memory( map, buckets );
+map->table->size += sizeof(*resized) * ( buckets_len - map->table->buckets_len );
+map->table->buckets = ptr_to_ref( map, resized );
+map->table->buckets_len = buckets_len;
 
-/*-------------------------------------------------------------
-Object has been created successfully.
--------------------------------------------------------------*/
-return( HMAP_STATUS_SUCCESS );
+rewind_save( map );
+return( HMAP_BOOL_TRUE );
 
-}   /* HMAP_create() */
+}   /* resize_cuckoo() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      HMAP_destroy
+ *      resize_dense
  *
  *  Description:
- *      Destroy the hash map object.
+ *      Make room in a dense map's full entry array. The array is
+ *      compacted in place if at least half of it is removed records,
+ *      and moved to one twice its size otherwise. The index table is
+ *      rebuilt for the new capacity, with the narrowest index that
+ *      can address it. Returns HMAP_BOOL_FALSE if memory could not
+ *      be allocated or the growth would take the map over its size
+ *      limit, leaving the map unchanged.
  *
  ************************************************************************/
-HMAP_status_t8 HMAP_destroy
+static HMAP_bool_t8 resize_dense
     (
-    HMAP_obj_type     * obj       /* hash map object                    */
+    hmap_map_type     * map         /* hash map private data            */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
+unsigned int            buckets_len;
+unsigned int            capacity;
+hmap_entry_type       * entries;
+unsigned long long      growth;
 unsigned int            i;
-hmap_entry_type       * entry;
-hmap_map_type         * map;
+unsigned char         * indexes;
+unsigned int            index_size;
+unsigned int            length;
+hmap_entry_type       * resized;
 
 /*-------------------------------------------------------------
-Verify inputs are not HMAP_INVALID_POINTER
+Grow the array unless enough of it can be reclaimed.
 -------------------------------------------------------------*/
-if( obj == HMAP_INVALID_POINTER )
+entries = ref_to_ptr( map, map->table->entries );
+capacity = map->table->entries_capacity;
+if( map->table->entries_len - map->table->entry_count < map->table->entries_len / 2
+ || map->table->entries_len == 0 )
     {
-    return( HMAP_STATUS_INVALID_ARG );
-    } 
+    capacity *= 2;
+    if( capacity < HMAP_DENSE_MIN )
+        {
+        capacity = HMAP_DENSE_MIN;
+        }
+    }
 
 /*-------------------------------------------------------------
-Verify interface object has been successfully initialized.
+Size the index table to keep it at most two thirds full, using
+the narrowest index that can hold every position plus one.
 -------------------------------------------------------------*/
-if( obj->data == HMAP_INVALID_POINTER )
+buckets_len = 1;
+while( buckets_len < capacity + capacity / 2 )
     {
-    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    buckets_len *= 2;
     }
 
-/*-------------------------------------------------------------
-Initialize variables
--------------------------------------------------------------*/
-map = (hmap_map_type *)obj->data;
+index_size = sizeof( unsigned int );
+if( capacity < 0xFF )
+    {
+    index_size = sizeof( unsigned char );
+    }
+else if( capacity < 0xFFFF )
+    {
+    index_size = sizeof( unsigned short );
+    }
 
 /*-------------------------------------------------------------
-Free the map entries.
+Allocate the new index table, and the new array if it grows,
+if the map's size limit allows.
 -------------------------------------------------------------*/
-for( i = 0; i < map->buckets_len; i++ )
+growth = sizeof(*resized) * (unsigned long long)( capacity - map->table->entries_capacity )
+       + (unsigned long long)buckets_len * index_size;
+if( growth > (unsigned long long)map->table->buckets_len * map->table->index_size )
     {
-    while( map->buckets[ i ] != HMAP_INVALID_POINTER )
+    growth -= (unsigned long long)map->table->buckets_len * map->table->index_size;
+    if( !reserve_memory( map, HMAP_INVALID_POINTER, growth ) )
         {
-        /*-----------------------------------------------------
-        Pop the top entry from the bucket and then destroy it.
-        -----------------------------------------------------*/
-        entry = map->buckets[ i ];
-        map->buckets[ i ] = entry->next;
-        destroy_entry( map, entry );
+        return( HMAP_BOOL_FALSE );
+        }
+    }
+
+indexes = alloc_memory( map, (unsigned long long)buckets_len * index_size );
+if( indexes == HMAP_INVALID_POINTER )
+    {
+    return( HMAP_BOOL_FALSE );
+    }
+
+resized = entries;
+if( capacity != map->table->entries_capacity )
+    {
+    resized = alloc_memory( map, (unsigned long long)capacity * sizeof(*resized) );
+    if( resized == HMAP_INVALID_POINTER )
+        {
+        free_memory( map, indexes );
+        return( HMAP_BOOL_FALSE );
         }
     }
 
 /*-------------------------------------------------------------
-Free the map buckets.
+Pack the remaining entries to the front of the array, keeping
+their order.
 -------------------------------------------------------------*/
-map->free( map->buckets );
+length = 0;
+for( i = 0; i < map->table->entries_len; i++ )
+    {
+    if( entries[ i ].size != 0 )
+        {
+        resized[ length++ ] = entries[ i ];
+        }
+    }
 
 /*-------------------------------------------------------------
-Free the hash map.
+Switch to the new memory.
 -------------------------------------------------------------*/
-map->free( map );
-obj->data = HMAP_INVALID_POINTER;
+if( resized != entries
+ && map->table->entries_capacity > 0 )
+    {
+    free_memory( map, entries );
+    }
+if( map->table->buckets_len > 0 )
+    {
+    free_memory( map, ref_to_ptr( map, map->table->buckets ) );
+    }
+
+map->table->size += sizeof(*resized) * ( capacity - map->table->entries_capacity );
+map->table->size += buckets_len * index_size;
+map->table->size -= map->table->buckets_len * map->table->index_size;
+map->table->entries = ptr_to_ref( map, resized );
+map->table->entries_len = length;
+map->table->entries_capacity = capacity;
+map->table->buckets = ptr_to_ref( map, indexes );
+map->table->buckets_len = buckets_len;
+map->table->index_size = (unsigned char)index_size;
 
 /*-------------------------------------------------------------
-The hash map object has been destroyed successfully.
+Index the entries.
 -------------------------------------------------------------*/
-return( HMAP_STATUS_SUCCESS );
+for( i = 0; i < buckets_len * index_size; i++ )
+    {
+    indexes[ i ] = 0;
+    }
+for( i = 0; i < length; i++ )
+    {
+    link_entry( map, &resized[ i ] );
+    }
 
-}   /* HMAP_destroy() */
+rewind_save( map );
+return( HMAP_BOOL_TRUE );
+
+}   /* resize_dense() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      HMAP_get_data
+ *      resize_hopscotch
  *
  *  Description:
- *      Get the data associated with the key.
+ *      Move a hopscotch map's entries to a table with twice as many
+ *      slots, doubling again in the unlikely case that an entry can
+ *      not be placed. Returns HMAP_BOOL_FALSE if memory could not be
+ *      allocated, the growth would take the map over its size limit,
+ *      or the entries still did not fit after HMAP_HOPSCOTCH_RESIZES
+ *      doublings, leaving the map unchanged.
  *
  ************************************************************************/
-HMAP_status_t8 HMAP_get_data
+static HMAP_bool_t8 resize_hopscotch
     (
-    HMAP_obj_type     * obj,        /* hash map object                  */
-    const HMAP_anon_type
-                      * key,        /* hash map entry key               */
-    HMAP_anon_type    * data        /* out: entry data                  */
+    hmap_map_type     * map         /* hash map private data            */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
-hmap_entry_type       * entry;
+unsigned int            doublings;
 unsigned int            i;
-hmap_map_type         * map;
+HMAP_bool_t8            placed;
+hmap_hopscotch_slot_type
+                      * resized;
+hmap_hopscotch_slot_type
+                      * slots;
+unsigned int            slots_len;
 
 /*-------------------------------------------------------------
-Verify inputs are not HMAP_INVALID_POINTER.
+Initialize variables
 -------------------------------------------------------------*/
-if( obj  == HMAP_INVALID_POINTER 
- || key  == HMAP_INVALID_POINTER
- || data == HMAP_INVALID_POINTER )
-    {
-    return( HMAP_STATUS_INVALID_ARG );
-    } 
+slots = ref_to_ptr( map, map->table->buckets );
+slots_len = map->table->buckets_len;
+placed = HMAP_BOOL_FALSE;
+resized = HMAP_INVALID_POINTER;
 
 /*-------------------------------------------------------------
-Verify interface object has been successfully initialized.
+Place every entry in a larger table.
 -------------------------------------------------------------*/
-if( obj->data == HMAP_INVALID_POINTER )
+for( doublings = 0; !placed; doublings++ )
     {
-    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    if( doublings == HMAP_HOPSCOTCH_RESIZES
+     || slots_len > 0x7FFFFFFFu )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    slots_len *= 2;
+
+    if( !reserve_memory( map, HMAP_INVALID_POINTER,
+                         sizeof(*resized) * (unsigned long long)( slots_len - map->table->buckets_len ) ) )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    resized = alloc_memory( map, (unsigned long long)slots_len * sizeof(*resized) );
+    if( resized == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    clear_hopscotch_slots( resized, slots_len );
+
+    placed = HMAP_BOOL_TRUE;
+    for( i = 0; i < map->table->buckets_len && placed; i++ )
+        {
+        if( slots[ i ].entry != HMAP_INVALID_REF )
+            {
+            placed = place_hopscotch_entry( map, resized, slots_len, ref_to_ptr( map, slots[ i ].entry ) );
+            }
+        }
+
+    if( !placed )
+        {
+        free_memory( map, resized );
+        }
     }
 
 /*-------------------------------------------------------------
-Get the private hash map data.
+Switch to the new table.
 -------------------------------------------------------------*/
-map = (hmap_map_type *)obj->data;
+free_memory( map, slots );
+map->table->size += sizeof(*resized) * ( slots_len - map->table->buckets_len );
+map->table->buckets = ptr_to_ref( map, resized );
+map->table->buckets_len = slots_len;
+
+rewind_save( map );
+return( HMAP_BOOL_TRUE );
+
+}   /* resize_hopscotch() */
 
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      resize_order
+ *
+ *  Description:
+ *      Make room in an ordered map's full order array. The array is
+ *      compacted in place if at least half of it is removed entries,
+ *      and moved to one twice its size otherwise. Returns
+ *      HMAP_BOOL_FALSE if memory could not be allocated or the growth
+ *      would take the map over its size limit, leaving the map
+ *      unchanged.
+ *
+ ************************************************************************/
+static HMAP_bool_t8 resize_order
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    )
+{
 /*-------------------------------------------------------------
-Get the entry associated with the key.
+Local variables
 -------------------------------------------------------------*/
-entry = get_entry_by_key( map, key );
+unsigned int            capacity;
+unsigned int            i;
+unsigned int            length;
+hmap_ref_type         * order;
+hmap_ref_type         * resized;
 
 /*-------------------------------------------------------------
-Verify a valid entry was found.
+Grow the array unless enough of it can be reclaimed.
 -------------------------------------------------------------*/
-if( entry == HMAP_INVALID_POINTER )
+order = ref_to_ptr( map, map->table->order );
+resized = order;
+capacity = map->table->order_capacity;
+if( map->table->order_len - map->table->entry_count < map->table->order_len / 2
+ || map->table->order_len == 0 )
+    {
+    capacity = capacity * 2;
+    if( capacity < HMAP_ORDER_MIN )
+        {
+        capacity = HMAP_ORDER_MIN;
+        }
+    if( !reserve_memory( map, HMAP_INVALID_POINTER,
+                         sizeof(*resized) * (unsigned long long)( capacity - map->table->order_capacity ) ) )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    resized = alloc_memory( map, (unsigned long long)capacity * sizeof(*resized) );
+    if( resized == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_BOOL_FALSE );
+        }
+    }
+
+/*-------------------------------------------------------------
+Pack the remaining entries to the front of the array and
+update their positions.
+-------------------------------------------------------------*/
+length = 0;
+for( i = 0; i < map->table->order_len; i++ )
+    {
+    if( order[ i ] != HMAP_INVALID_REF )
+        {
+        resized[ length ] = order[ i ];
+        ( (hmap_ordered_entry_type *)ref_to_ptr( map, order[ i ] ) )->order = length;
+        length++;
+        }
+    }
+
+if( resized != order )
+    {
+    if( map->table->order_capacity > 0 )
+        {
+        free_memory( map, order );
+        }
+    map->table->size += sizeof(*resized) * ( capacity - map->table->order_capacity );
+    map->table->order = ptr_to_ref( map, resized );
+    map->table->order_capacity = capacity;
+    }
+map->table->order_len = length;
+
+rewind_save( map );
+return( HMAP_BOOL_TRUE );
+
+}   /* resize_order() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      rewind_save
+ *
+ *  Description:
+ *      Restart the scan of a save in progress after the map's entries
+ *      were rearranged, as entries yet to be packed may have moved
+ *      behind it. Packed entries are skipped by the new scan.
+ *
+ ************************************************************************/
+static void rewind_save
+    (
+    hmap_map_type     * map         /* hash map private data            */
+    )
+{
+if( map->save != HMAP_INVALID_POINTER )
     {
-    return( HMAP_STATUS_KEY_NOT_IN_MAP );
+    map->save->iterator.bucket = 0;
+    map->save->iterator.entry = HMAP_INVALID_REF;
     }
 
-/*-------------------------------------------------------------
-Get the entry data.
--------------------------------------------------------------*/
-copy_anon_data( data, &entry->data );
-
-return( HMAP_STATUS_SUCCESS );
-
-}   /* HMAP_get_data() */
+}   /* rewind_save() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      HMAP_get_entry_count
+ *      run_snapshot_wave
  *
  *  Description:
- *      Get the number of entries in the map.
+ *      Run a task for every block of a wave, in parallel if the
+ *      snapshot has a parallel hook.
  *
  ************************************************************************/
-HMAP_status_t8 HMAP_get_entry_count
+static void run_snapshot_wave
     (
-    HMAP_obj_type     * obj,        /* hash map object                  */
-    unsigned int      * entry_count /* out: number of entries in map    */
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot definition              */
+    hmap_snapshot_wave_type
+                      * wave,       /* wave of blocks                   */
+    HMAP_task_fptr      task        /* task to run on each block        */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
-hmap_entry_type       * entry;
-hmap_map_type         * map;
+unsigned int            i;
 
 /*-------------------------------------------------------------
-Verify inputs are not HMAP_INVALID_POINTER.
+Hand the job to the caller's thread pool, or run it here.
 -------------------------------------------------------------*/
-if( obj  == HMAP_INVALID_POINTER )
+if( snapshot->parallel != HMAP_INVALID_POINTER )
     {
-    return( HMAP_STATUS_INVALID_ARG );
-    } 
-
-/*-------------------------------------------------------------
-Verify interface object has been successfully initialized.
--------------------------------------------------------------*/
-if( obj->data == HMAP_INVALID_POINTER )
+    snapshot->parallel( snapshot->parallel_context, task, wave, wave->count );
+    }
+else
     {
-    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    for( i = 0; i < wave->count; i++ )
+        {
+        task( wave, i );
+        }
     }
 
-/*-------------------------------------------------------------
-Get the private hash map data.
--------------------------------------------------------------*/
-map = (hmap_map_type *)obj->data;
-
-/*-------------------------------------------------------------
-Get the entry associated with the key.
--------------------------------------------------------------*/
-*entry_count = map->entry_count;
-
-return( HMAP_STATUS_SUCCESS );
-
-}   /* HMAP_get_entry_count() */
+}   /* run_snapshot_wave() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      HMAP_get_hash
+ *      save_snapshot_index
  *
  *  Description:
- *      Get the hash value of provided data.
+ *      Write a snapshot's block index and trailer.
  *
  ************************************************************************/
-HMAP_status_t8 HMAP_get_hash
+static HMAP_status_t8 save_snapshot_index
     (
-    HMAP_obj_type     * obj,        /* hash map object                  */
-    HMAP_anon_type
-                const * data,       /* data to hash                     */
-    HMAP_hash_val_type* hash        /* out: hash value of data          */
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to write                */
+    hmap_snapshot_index_type
+                const * index,      /* block index                      */
+    unsigned int        block_count,/* num blocks                       */
+    unsigned long long  offset      /* snapshot offset of the index     */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
-hmap_map_type         * map;
+unsigned char         * bytes;
+unsigned int            checksum;
+unsigned int            entry_count;
+unsigned int            i;
+unsigned char           trailer[ HMAP_SNAPSHOT_TRAILER_SIZE ];
 
 /*-------------------------------------------------------------
-Verify inputs are not HMAP_INVALID_POINTER.
+Encode the index.
 -------------------------------------------------------------*/
-if( obj  == HMAP_INVALID_POINTER
- || data == HMAP_INVALID_POINTER
- || hash == HMAP_INVALID_POINTER )
+bytes = map->malloc( (unsigned long long)block_count * HMAP_SNAPSHOT_INDEX_SIZE + 1 );
+if( bytes == HMAP_INVALID_POINTER )
     {
-    return( HMAP_STATUS_INVALID_ARG );
-    } 
+    return( HMAP_STATUS_OUT_OF_MEMORY );
+    }
 
-/*-------------------------------------------------------------
-Verify interface object has been successfully initialized.
--------------------------------------------------------------*/
-if( obj->data == HMAP_INVALID_POINTER )
+entry_count = 0;
+for( i = 0; i < block_count; i++ )
     {
-    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    encode_u32( &bytes[ i * HMAP_SNAPSHOT_INDEX_SIZE + 0 ], (unsigned int)index[ i ].offset );
+    encode_u32( &bytes[ i * HMAP_SNAPSHOT_INDEX_SIZE + 4 ], (unsigned int)( index[ i ].offset >> 32 ) );
+    encode_u32( &bytes[ i * HMAP_SNAPSHOT_INDEX_SIZE + 8 ], index[ i ].stored_size );
+    encode_u32( &bytes[ i * HMAP_SNAPSHOT_INDEX_SIZE + 12 ], index[ i ].raw_size );
+    encode_u32( &bytes[ i * HMAP_SNAPSHOT_INDEX_SIZE + 16 ], index[ i ].entry_count );
+    encode_u32( &bytes[ i * HMAP_SNAPSHOT_INDEX_SIZE + 20 ], index[ i ].checksum );
+    entry_count += index[ i ].entry_count;
     }
+checksum = compute_checksum( HMAP_CHECKSUM_SEED, bytes, block_count * HMAP_SNAPSHOT_INDEX_SIZE );
 
 /*-------------------------------------------------------------
-Get the private hash map data.
+Encode the trailer.
 -------------------------------------------------------------*/
-map = (hmap_map_type *)obj->data;
+encode_u32( &trailer[ 0 ], (unsigned int)offset );
+encode_u32( &trailer[ 4 ], (unsigned int)( offset >> 32 ) );
+encode_u32( &trailer[ 8 ], block_count );
+encode_u32( &trailer[ 12 ], entry_count );
+encode_u32( &trailer[ 16 ], checksum );
+encode_u32( &trailer[ 20 ], HMAP_SNAPSHOT_MAGIC );
 
 /*-------------------------------------------------------------
-Hash the given data.
+Write both.
 -------------------------------------------------------------*/
-*hash = map->hash( data );
+if( ( block_count > 0
+   && !snapshot->write( snapshot->context, bytes, block_count * HMAP_SNAPSHOT_INDEX_SIZE ) )
+ || !snapshot->write( snapshot->context, trailer, sizeof( trailer ) ) )
+    {
+    map->free( bytes );
+    return( HMAP_STATUS_IO_ERROR );
+    }
 
+map->free( bytes );
 return( HMAP_STATUS_SUCCESS );
 
-}   /* HMAP_get_hash() */
+}   /* save_snapshot_index() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      HMAP_get_size
+ *      save_snapshot_wave
  *
  *  Description:
- *      Get the total memory allocated to the hash map.
+ *      Compress the blocks of a wave as one parallel job, write them in
+ *      order and add them to the block index. The wave is emptied.
  *
  ************************************************************************/
-HMAP_status_t8 HMAP_get_size
+static HMAP_status_t8 save_snapshot_wave
     (
-    HMAP_obj_type     * obj,        /* hash map object                  */
-    unsigned int      * size        /* out: total size of map (bytes)   */
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to write                */
+    hmap_snapshot_wave_type
+                      * wave,       /* wave of raw blocks               */
+    hmap_snapshot_index_type
+                     ** index,      /* in/out: block index              */
+    unsigned int      * index_capacity,
+                                    /* in/out: capacity of index        */
+    unsigned int      * index_count,/* in/out: num blocks in index      */
+    unsigned long long* offset      /* in/out: snapshot offset          */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
-hmap_entry_type       * entry;
-hmap_map_type         * map;
+hmap_snapshot_block_type
+                      * block;
+unsigned int            i;
+unsigned int            index_size;
 
 /*-------------------------------------------------------------
-Verify inputs are not HMAP_INVALID_POINTER.
+Make room for the wave's blocks in the output buffers and the
+index.
 -------------------------------------------------------------*/
-if( obj  == HMAP_INVALID_POINTER )
+for( i = 0; i < wave->count; i++ )
     {
-    return( HMAP_STATUS_INVALID_ARG );
-    } 
+    block = &wave->blocks[ i ];
+    if( !grow_buffer( map, &block->stored, &block->stored_capacity, 0, block->index.raw_size ) )
+        {
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
+    }
 
-/*-------------------------------------------------------------
-Verify interface object has been successfully initialized.
--------------------------------------------------------------*/
-if( obj->data == HMAP_INVALID_POINTER )
+index_size = *index_capacity * sizeof( **index );
+if( !grow_buffer( map, (unsigned char **)index, &index_size, *index_count * sizeof( **index ),
+                  ( *index_count + wave->count ) * sizeof( **index ) ) )
     {
-    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    return( HMAP_STATUS_OUT_OF_MEMORY );
     }
+*index_capacity = index_size / sizeof( **index );
 
 /*-------------------------------------------------------------
-Get the private hash map data.
+Compress the blocks.
 -------------------------------------------------------------*/
-map = (hmap_map_type *)obj->data;
+run_snapshot_wave( snapshot, wave, compress_task );
 
 /*-------------------------------------------------------------
-Get the size of the hash map.
+Write them in order and index them.
 -------------------------------------------------------------*/
-*size = map->size;
+for( i = 0; i < wave->count; i++ )
+    {
+    block = &wave->blocks[ i ];
+    if( !snapshot->write( snapshot->context, block->entries, block->index.stored_size ) )
+        {
+        return( HMAP_STATUS_IO_ERROR );
+        }
 
+    block->index.offset = *offset;
+    *offset += block->index.stored_size;
+    ( *index )[ ( *index_count )++ ] = block->index;
+
+    block->index.raw_size = 0;
+    block->index.entry_count = 0;
+    }
+
+wave->count = 0;
 return( HMAP_STATUS_SUCCESS );
 
-}   /* HMAP_get_size() */
+}   /* save_snapshot_wave() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      HMAP_key_in_map
+ *      select_hash
  *
  *  Description:
- *      Returns true if the key exists in the given map.
+ *      Set the map's hashing function per the hash type of its table,
+ *      and its custom key equality. A custom key equality needs a
+ *      custom hash and keys stored in full.
  *
  ************************************************************************/
-HMAP_bool_t8 HMAP_key_in_map
+static HMAP_status_t8 select_hash
     (
-    HMAP_obj_type     * obj,        /* hash map object                  */
-    const HMAP_anon_type    
-                      * key         /* hash map entry key               */
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_def_type     * hmap_def    /* hash map definition              */
     )
 {
 /*-------------------------------------------------------------
-Local variables
--------------------------------------------------------------*/
-hmap_entry_type       * entry;
-hmap_map_type         * map;
-
-/*-------------------------------------------------------------
-Verify inputs are not HMAP_INVALID_POINTER.
+Set the appropriate hashing function.
 -------------------------------------------------------------*/
-if( obj  == HMAP_INVALID_POINTER 
- || key  == HMAP_INVALID_POINTER )
+switch( map->table->hash_type )
     {
-    return( HMAP_BOOL_FALSE );
-    } 
+    case HMAP_HASH_FUNC_CUSTOM:
+        /*-----------------------------------------------------
+        A custom hash function must be provided if the defined
+        hash type is HMAP_HASH_CUSTOM.
+        -----------------------------------------------------*/
+        if( hmap_def->hash == HMAP_INVALID_POINTER )
+            {
+            return( HMAP_STATUS_INVALID_DEF );
+            }
+        map->hash = hmap_def->hash;
+        map->hash_batch = HMAP_INVALID_POINTER;
+        break;
 
-/*-------------------------------------------------------------
-Verify interface object has been successfully initialized.
--------------------------------------------------------------*/
-if( obj->data == HMAP_INVALID_POINTER )
-    {
-    return( HMAP_BOOL_FALSE );
+    case HMAP_HASH_FUNC_SDBM:
+    default:
+        map->hash = select_sdbm( map->features );
+        map->hash_batch = select_sdbm_batch( map->features );
+        break;
     }
 
 /*-------------------------------------------------------------
-Get the private hash map data.
--------------------------------------------------------------*/
-map = (hmap_map_type *)obj->data;
-
-/*-------------------------------------------------------------
-Get the entry associated with the key.
+Set the custom key equality, if any.
 -------------------------------------------------------------*/
-entry = get_entry_by_key( map, key );
+map->equal = hmap_def->equal;
+if( map->equal != HMAP_INVALID_POINTER
+ && ( map->table->hash_type != HMAP_HASH_FUNC_CUSTOM
+   || map->table->key_mode == HMAP_KEY_MODE_PREFIX ) )
+    {
+    return( HMAP_STATUS_INVALID_DEF );
+    }
 
-/*-------------------------------------------------------------
-Verify a valid entry was found.
--------------------------------------------------------------*/
-return( entry != HMAP_INVALID_POINTER );
+return( HMAP_STATUS_SUCCESS );
 
-}   /* HMAP_key_in_map() */
+}   /* select_hash() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      HMAP_remove_entry
+ *      select_kernels
  *
  *  Description:
- *      Remove the entry for the given key from the map.
+ *      Detect the processor's features and bind the fastest kernels
+ *      they allow. Kernels of one function all give the same results,
+ *      so maps may be shared between processes on different
+ *      processors.
  *
  ************************************************************************/
-HMAP_status_t8 HMAP_remove_entry
+static void select_kernels
     (
-    HMAP_obj_type     * obj,        /* hash map object                  */
-    const HMAP_anon_type    
-                      * key         /* hashmap entry key                */
+    hmap_map_type     * map         /* hash map private data            */
     )
 {
 /*-------------------------------------------------------------
-Local variables
+Start from the portable kernels.
 -------------------------------------------------------------*/
-hmap_entry_type      ** bucket;
-hmap_entry_type       * entry;
-HMAP_hash_val_type      hash;
-unsigned int            i;
-unsigned int            index;
-hmap_map_type         * map;
+map->features = get_cpu_features();
+map->match = anon_data_match;
 
 /*-------------------------------------------------------------
-Verify inputs are not HMAP_INVALID_POINTER.
+Bind the widest kernels the processor supports.
 -------------------------------------------------------------*/
-if( obj  == HMAP_INVALID_POINTER 
- || key  == HMAP_INVALID_POINTER )
+#if defined( HMAP_X86 )
+if( ( map->features & HMAP_CPU_AVX2 ) != 0 )
     {
-    return( HMAP_STATUS_INVALID_ARG );
-    } 
-
-/*-------------------------------------------------------------
-Verify interface object has been successfully initialized.
--------------------------------------------------------------*/
-if( obj->data == HMAP_INVALID_POINTER )
+    map->match = anon_data_match_avx2;
+    }
+else if( ( map->features & HMAP_CPU_SSE2 ) != 0 )
     {
-    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    map->match = anon_data_match_sse2;
     }
+#endif
 
-/*-------------------------------------------------------------
-Resolve the map structure.
--------------------------------------------------------------*/
-map = (hmap_map_type *)obj->data;
+}   /* select_kernels() */
 
-/*-------------------------------------------------------------
-Find the matching entry in the map.
--------------------------------------------------------------*/
-entry = get_entry_by_key( map, key );
 
-/*-------------------------------------------------------------
-Remove the entry if it was found to exist.
--------------------------------------------------------------*/
-if( entry != HMAP_INVALID_POINTER )
+/*************************************************************************
+ *
+ *  Procedure:
+ *      select_sdbm
+ *
+ *  Description:
+ *      Get the fastest kernel of the SDBM hash for the given HMAP_CPU_*
+ *      features.
+ *
+ ************************************************************************/
+static HMAP_hash_fptr_type select_sdbm
+    (
+    unsigned int        features    /* HMAP_CPU_* features              */
+    )
+{
+#if defined( HMAP_X86 )
+if( ( features & HMAP_CPU_AVX512 ) != 0 )
     {
-    /*---------------------------------------------------------
-    Remove the entry from the bucket's linked list and then 
-    destroy it.
-    ---------------------------------------------------------*/
-    if( entry->previous != HMAP_INVALID_POINTER )
-        {
-        entry->previous->next = entry->next;
-        if( entry->next != HMAP_INVALID_POINTER )
-            {
-            entry->next->previous = entry->previous;
-            }
-        }
-    else
-        {
-        bucket = get_bucket_by_hash( map, entry->key_hash );
-        *bucket = entry->next;
-        }
+    return( hash_sdbm_avx512 );
+    }
+if( ( features & HMAP_CPU_AVX2 ) != 0 )
+    {
+    return( hash_sdbm_avx2 );
+    }
+if( ( features & HMAP_CPU_SSE42 ) != 0 )
+    {
+    return( hash_sdbm_sse42 );
+    }
+#endif
+
+return( hash_sdbm );
+
+}   /* select_sdbm() */
+
 
-    destroy_entry( map, entry );
+/*************************************************************************
+ *
+ *  Procedure:
+ *      select_sdbm_batch
+ *
+ *  Description:
+ *      Get the fastest batch kernel of the SDBM hash for the given
+ *      HMAP_CPU_* features, or HMAP_INVALID_POINTER if keys are best
+ *      hashed one at a time.
+ *
+ ************************************************************************/
+static hmap_hash_batch_fptr_type select_sdbm_batch
+    (
+    unsigned int        features    /* HMAP_CPU_* features              */
+    )
+{
+#if defined( HMAP_X86 )
+if( ( features & HMAP_CPU_AVX512 ) != 0 )
+    {
+    return( hash_sdbm_batch_avx512 );
+    }
+if( ( features & HMAP_CPU_AVX2 ) != 0 )
+    {
+    return( hash_sdbm_batch_avx2 );
     }
+#endif
 
-return( HMAP_STATUS_SUCCESS );
+return( HMAP_INVALID_POINTER );
 
-}   /* HMAP_remove_entry() */
+}   /* select_sdbm_batch() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      HMAP_set_data
+ *      set_dense_index
  *
  *  Description:
- *      Set the data associated with the key. If an entry for the key does
- *      not already exist, an entry will be created.
+ *      Set a slot of a dense map's index table.
  *
  ************************************************************************/
-HMAP_status_t8 HMAP_set_data
+static void set_dense_index
     (
-    HMAP_obj_type     * obj,        /* hash map object                  */
-    const HMAP_anon_type    
-                      * key,        /* hashmap entry key                */
-    const HMAP_anon_type    
-                      * data        /* entry data                       */
+    hmap_map_type     * map,        /* hash map private data            */
+    unsigned int        slot,       /* slot in index table              */
+    unsigned int        index       /* entry position plus one          */
     )
 {
 /*-------------------------------------------------------------
 Local variables
--------------------------------------------------------------*/
-hmap_entry_type      ** bucket;
-hmap_entry_type       * entry;
-HMAP_hash_val_type      hash;
-unsigned int            index;
-hmap_map_type         * map;
-
-/*-------------------------------------------------------------
-Verify inputs are not HMAP_INVALID_POINTER.
--------------------------------------------------------------*/
-if( obj  == HMAP_INVALID_POINTER 
- || key  == HMAP_INVALID_POINTER
- || data == HMAP_INVALID_POINTER )
-    {
-    return( HMAP_STATUS_INVALID_ARG );
-    } 
+-------------------------------------------------------------*/
+void                  * indexes;
 
 /*-------------------------------------------------------------
-Verify interface object has been successfully initialized.
+Write the slot at the table's index width.
 -------------------------------------------------------------*/
-if( obj->data == HMAP_INVALID_POINTER )
+indexes = ref_to_ptr( map, map->table->buckets );
+switch( map->table->index_size )
     {
-    return( HMAP_STATUS_MAP_UNINITIALIZED );
+    case 1:
+        ( (unsigned char *)indexes )[ slot ] = (unsigned char)index;
+        break;
+
+    case 2:
+        ( (unsigned short *)indexes )[ slot ] = (unsigned short)index;
+        break;
+
+    default:
+        ( (unsigned int *)indexes )[ slot ] = index;
+        break;
     }
 
+}   /* set_dense_index() */
+
+
+/*************************************************************************
+ *
+ *  Procedure:
+ *      set_entry_data
+ *
+ *  Description:
+ *      Set the data associated with the key, creating the entry if it
+ *      does not exist.
+ *
+ ************************************************************************/
+static HMAP_status_t8 set_entry_data
+    (
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_hash_val_type  key_hash,   /* hash value of key                */
+    HMAP_anon_type
+                const * data        /* entry data                       */
+    )
+{
 /*-------------------------------------------------------------
-Initialize variables
+Local variables
 -------------------------------------------------------------*/
-map = (hmap_map_type *)obj->data;
+hmap_blob_type          data_blob;
+hmap_entry_type       * entry;
+HMAP_anon_type          entry_data;
+unsigned int            growth;
+HMAP_status_t8          status;
 
 /*-------------------------------------------------------------
 Find the matching entry.
 -------------------------------------------------------------*/
-entry = get_entry_by_key( map, key );
+entry = get_entry_by_key( map, key, key_hash );
 
 /*-------------------------------------------------------------
 Create a new entry if no matching entry was found.
@@ -740,394 +13203,604 @@ if( entry == HMAP_INVALID_POINTER )
     /*---------------------------------------------------------
     Create the new entry.
     ---------------------------------------------------------*/
-    entry = create_entry( map, key, data );
+    entry = create_entry( map, key, key_hash, data );
+    if( entry == HMAP_INVALID_POINTER )
+        {
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
 
     /*---------------------------------------------------------
-    Push the new entry to the top of its bucket.
+    Add the new entry to the map's table.
     ---------------------------------------------------------*/
-    bucket = get_bucket_by_hash( map, entry->key_hash );
-    entry->next = *bucket;
-    if( entry->next )
+    status = link_entry( map, entry );
+    if( status != HMAP_STATUS_SUCCESS )
         {
-        entry->next->previous = entry;
+        destroy_entry( map, entry );
+        return( status );
         }
-    *bucket = entry;
     }
 
 /*-------------------------------------------------------------
-Update the size of the data, if necessary.
+Keep the old data for a save in progress.
+-------------------------------------------------------------*/
+preserve_entry( map, entry );
+
+/*-------------------------------------------------------------
+Update the size of the data, if necessary. The new data block
+is allocated before the old one is released so the entry is
+left intact if the allocation fails, or if the new data would
+take the map over its size limit. Spilled data is always
+replaced by a block in memory.
 -------------------------------------------------------------*/
-if( entry->data.size != data->size )
+if( entry->data.size != data->size
+ || ( entry->flags & HMAP_ENTRY_SPILLED ) != 0 )
     {
-    map->data_size += data->size - entry->data.size;
-    map->size += data->size - entry->data.size;
+    growth = 0;
+    if( ( entry->flags & HMAP_ENTRY_SPILLED ) != 0 )
+        {
+        growth = data->size;
+        }
+    else if( data->size > entry->data.size )
+        {
+        growth = data->size - entry->data.size;
+        }
+
+    if( !reserve_memory( map, entry, growth )
+     || !alloc_data_blob( map, &data_blob, data->size ) )
+        {
+        return( HMAP_STATUS_OUT_OF_MEMORY );
+        }
 
-    map->free( entry->data.ptr );
-    entry->data.ptr = map->malloc( data->size );
-    entry->data.size = data->size;
+    map->table->data_size += data->size - entry->data.size;
+    map->table->size += data->size - entry->data.size;
+    entry->size += data->size - entry->data.size;
+
+    release_entry_data( map, entry );
+    entry->data = data_blob;
     }
 
 /*-------------------------------------------------------------
-Set the entry data.
+Set the entry data, then spill colder data if the map holds
+too much.
 -------------------------------------------------------------*/
-copy_anon_data( &entry->data, data );
+entry_data.ptr = get_blob_bytes( map, &entry->data );
+copy_anon_data( &entry_data, data );
+entry->flags |= HMAP_ENTRY_REFERENCED;
+spill_cold_data( map, entry, 0 );
 
 return( HMAP_STATUS_SUCCESS );
 
-}   /* HMAP_set_data() */
+}   /* set_entry_data() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      anon_data_match
+ *      sort_bucket
  *
  *  Description:
- *      Returns true if the specified memory blocks match.
+ *      Sort a chained map bucket that has grown too long to walk,
+ *      relinking its entries in the order of their key hashes and
+ *      building its index. The bucket is left unsorted if memory
+ *      could not be allocated or the index would take the map over
+ *      its size limit.
  *
  ************************************************************************/
-static HMAP_bool_t8 anon_data_match
+static void sort_bucket
     (
-    HMAP_anon_type    
-                const * data_1,     /* anonymous data to be compared    */
-    HMAP_anon_type    
-                const * data_2      /* anonymous data to be compared    */
+    hmap_map_type     * map,        /* hash map private data            */
+    HMAP_hash_val_type  key_hash    /* hash value of a key in bucket    */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
+hmap_link_type        * bucket;
+unsigned int            count;
+hmap_entry_type       * entry;
 unsigned int            i;
-HMAP_bool_t8            match;
+HMAP_anon_type          key_parts[ 2 ];
+hmap_link_type          link;
+hmap_sorted_slot_type   slot;
+hmap_sorted_slot_type * slots;
+hmap_sorted_type      * sorted;
+hmap_ref_type         * sorted_refs;
 
 /*-------------------------------------------------------------
-First, check if the sizes match.
+The table of sorted buckets is allocated with the first one.
 -------------------------------------------------------------*/
-if( data_1->size != data_2->size )
+if( map->table->sorted == HMAP_INVALID_REF )
     {
-    return( HMAP_BOOL_FALSE );
+    if( !reserve_memory( map, HMAP_INVALID_POINTER, (unsigned long long)map->table->buckets_len * sizeof(*sorted_refs) ) )
+        {
+        return;
+        }
+    sorted_refs = alloc_memory( map, (unsigned long long)map->table->buckets_len * sizeof(*sorted_refs) );
+    if( sorted_refs == HMAP_INVALID_POINTER )
+        {
+        return;
+        }
+    for( i = 0; i < map->table->buckets_len; i++ )
+        {
+        sorted_refs[ i ] = HMAP_INVALID_REF;
+        }
+    map->table->sorted = ptr_to_ref( map, sorted_refs );
+    map->table->size += sizeof(*sorted_refs) * map->table->buckets_len;
     }
 
 /*-------------------------------------------------------------
-Check if the data is a byte-for-byte match.
+Allocate the index with room for the bucket to double.
 -------------------------------------------------------------*/
-for( i = 0; i < data_1->size; i++ )
+bucket = get_bucket_by_hash( map, key_hash );
+count = 0;
+for( link = *bucket; link != HMAP_INVALID_LINK; link = entry->next )
     {
-    if( ( (char *)( data_1->ptr ) )[ i ] != ( (char *)( data_2->ptr ) )[ i ] )
+    entry = link_to_ptr( map, link );
+    count++;
+    }
+
+if( !reserve_memory( map, HMAP_INVALID_POINTER, sizeof(*sorted) + 2ull * count * sizeof(*slots) ) )
+    {
+    return;
+    }
+sorted = alloc_memory( map, sizeof(*sorted) + 2ull * count * sizeof(*slots) );
+if( sorted == HMAP_INVALID_POINTER )
+    {
+    return;
+    }
+sorted->count = count;
+sorted->capacity = 2 * count;
+
+/*-------------------------------------------------------------
+Insertion sort the bucket's entries by hash and key. The
+bucket is only just past HMAP_SORTED_MAX entries when it is
+sorted.
+-------------------------------------------------------------*/
+slots = (hmap_sorted_slot_type *)( sorted + 1 );
+count = 0;
+for( link = *bucket; link != HMAP_INVALID_LINK; link = entry->next )
+    {
+    entry = link_to_ptr( map, link );
+    get_entry_key_parts( map, entry, key_parts );
+    slot.key_hash = entry->key_hash;
+    slot.link = link;
+    for( i = count; i > 0 && compare_sorted_slot( map, &slots[ i - 1 ], slot.key_hash, key_parts ) > 0; i-- )
         {
-        return( HMAP_BOOL_FALSE );
+        slots[ i ] = slots[ i - 1 ];
         }
+    slots[ i ] = slot;
+    count++;
     }
 
-return( HMAP_BOOL_TRUE );
+/*-------------------------------------------------------------
+Relink the bucket in the order of its index.
+-------------------------------------------------------------*/
+*bucket = slots[ 0 ].link;
+for( i = 0; i < count; i++ )
+    {
+    entry = link_to_ptr( map, slots[ i ].link );
+    entry->next = HMAP_INVALID_LINK;
+    if( i + 1 < count )
+        {
+        entry->next = slots[ i + 1 ].link;
+        }
+    }
 
-}   /* anon_data_match() */
+sorted_refs = ref_to_ptr( map, map->table->sorted );
+sorted_refs[ key_hash % map->table->buckets_len ] = ptr_to_ref( map, sorted );
+map->table->size += sizeof(*sorted) + sorted->capacity * sizeof(*slots);
+
+}   /* sort_bucket() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      copy_anon_data
+ *      spill_cold_data
  *
  *  Description:
- *      Copy anonymous data from a source to tha destination.
+ *      Spill data until no more than the memory limit is held in
+ *      memory, and the map has room for size more bytes within its
+ *      size limit. The clock hand sweeps the entries, clearing the
+ *      read mark of those read since it last passed and spilling the
+ *      rest. The sweep gives up after two passes, when the data left
+ *      in memory is too small to spill. The entry to keep, if any, is
+ *      not spilled.
  *
  ************************************************************************/
-static void copy_anon_data
+static void spill_cold_data
     (
-    HMAP_anon_type    * destination,/* copy source data here            */
-    HMAP_anon_type    
-                const * source      /* source of data to be copied      */
+    hmap_map_type     * map,        /* hash map private data            */
+    hmap_entry_type   * keep,       /* entry not to spill, or NULL      */
+    unsigned long long  size        /* num bytes about to be added      */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
-unsigned int            i;
+unsigned long long      allowed;
+hmap_entry_type       * entry;
+unsigned long long      limit;
+unsigned long long      other;
+hmap_spill_type       * spill;
+unsigned long long      visited;
 
 /*-------------------------------------------------------------
-Copy the source data to the destination.
+Nothing to do without a usable spill file.
 -------------------------------------------------------------*/
-destination->size = source->size;
-for( i = 0; i < source->size; i++ )
+spill = map->spill;
+if( spill == HMAP_INVALID_POINTER
+ || spill->failed )
     {
-    ( (char *)( destination->ptr ) )[ i ] = ( (char *)( source->ptr ) )[ i ];
+    return;
     }
 
-}   /* copy_anon_data() */
+/*-------------------------------------------------------------
+Sweep while too much data is in memory. Buckets of chained
+maps are finished, as the entries of an unfinished one could
+be removed before the next sweep.
+-------------------------------------------------------------*/
+limit = spill->files[ spill->current ].memory_limit;
+if( map->size_limit != 0 )
+    {
+    other = map->table->size - map->table->data_size;
+    allowed = 0;
+    if( other + size < map->size_limit )
+        {
+        allowed = map->size_limit - other - size;
+        }
+    if( allowed < limit )
+        {
+        limit = allowed;
+        }
+    }
+
+visited = 0;
+while( ( map->table->data_size - spill->live_size[ 0 ] - spill->live_size[ 1 ] > limit
+      && visited <= 2 * (unsigned long long)map->table->entry_count
+      && !spill->failed )
+    || spill->hand.entry != HMAP_INVALID_REF )
+    {
+    entry = next_entry( map, &spill->hand );
+    if( entry == HMAP_INVALID_POINTER )
+        {
+        spill->hand.bucket = 0;
+        continue;
+        }
+    visited++;
+
+    if( entry == keep
+     || entry->data.size <= HMAP_INLINE_SIZE
+     || ( entry->flags & HMAP_ENTRY_SPILLED ) != 0 )
+        {
+        continue;
+        }
+
+    if( ( entry->flags & HMAP_ENTRY_REFERENCED ) != 0 )
+        {
+        entry->flags &= ~HMAP_ENTRY_REFERENCED;
+        }
+    else if( map->table->data_size - spill->live_size[ 0 ] - spill->live_size[ 1 ] > limit
+          && !spill->failed )
+        {
+        spill_entry_data( map, entry );
+        }
+    }
+
+}   /* spill_cold_data() */
+
 
 /*************************************************************************
  *
  *  Procedure:
- *      create_entry
+ *      spill_entry_data
  *
  *  Description:
- *      Allocate and define a new map entry.
+ *      Move an entry's data from memory to the current spill file.
+ *      The data stays in memory if it could not be written.
  *
  ************************************************************************/
-static hmap_entry_type * create_entry
+static void spill_entry_data
     (
     hmap_map_type     * map,        /* hash map private data            */
-    HMAP_anon_type    
-                const * key,        /* entry key                        */
-    HMAP_anon_type    
-                const * data        /* entry data                       */
+    hmap_entry_type   * entry       /* entry to spill                   */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
-hmap_entry_type       * entry;
-
-/*-------------------------------------------------------------
-Allocate and define the new map entry.
--------------------------------------------------------------*/
-entry = map->malloc( sizeof( *entry ) );
-entry->data.size = data->size;
-entry->data.ptr = map->malloc( entry->data.size );
-entry->key.size = key->size;
-entry->key_hash = map->hash( key );
-entry->next = HMAP_INVALID_POINTER;
-entry->previous = HMAP_INVALID_POINTER;
-entry->key.ptr = map->malloc( entry->key.size );
-copy_anon_data( &entry->key, key );
-entry->size = entry->data.size + entry->key.size + sizeof( *entry );
+hmap_blob_type          data_blob;
 
 /*-------------------------------------------------------------
-Update map entry count and size data.
+Write the data, then free its memory.
 -------------------------------------------------------------*/
-map->entry_count++;
-map->data_size += data->size;
-map->key_size += key->size;
-map->size += entry->size;
-
-return( entry );
+data_blob = entry->data;
+if( append_spill( map, entry, get_blob_bytes( map, &data_blob ) ) )
+    {
+    free_data_blob( map, &data_blob );
+    }
 
-}   /* create_entry() */
+}   /* spill_entry_data() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      destroy_entry
+ *      start_lookup
  *
  *  Description:
- *      Deallocate entry memory.
+ *      Hash the key of a lookup and prefetch its bucket. Move-to-front
+ *      maps search the bucket in one step, so the hit is counted and
+ *      moved as for any other read, and no lookup is left partway down
+ *      a bucket whose entries another one moves.
  *
  ************************************************************************/
-static void destroy_entry
+static void start_lookup
     (
     hmap_map_type     * map,        /* hash map private data            */
-    hmap_entry_type   * entry       /* entry to destroy                 */
+    hmap_lookup_type  * lookup      /* lookup with its key set          */
     )
 {
-/*-------------------------------------------------------------
-Update map entry count and size data.
--------------------------------------------------------------*/
-map->entry_count--;
-map->data_size -= entry->data.size;
-map->key_size -= entry->key.size;
-map->size -= entry->size;
+lookup->key_hash = map->hash( &lookup->key );
+lookup->entry = HMAP_INVALID_REF;
+prefetch_bucket( map, lookup->key_hash );
 
-/*-------------------------------------------------------------
-Free the entry memory.
--------------------------------------------------------------*/
-map->free( entry->data.ptr );
-map->free( entry->key.ptr );
-map->free( entry );
+lookup->state = HMAP_LOOKUP_SEARCH;
+if( map->table->engine == HMAP_ENGINE_CHAINED
+ && map->table->move_to_front == HMAP_BOOL_FALSE )
+    {
+    lookup->state = HMAP_LOOKUP_BUCKET;
+    }
 
-}   /* destroy_entry() */
+}   /* start_lookup() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      get_bucket_by_hash
+ *      step_lookup
  *
  *  Description:
- *      Get a pointer to the map bucket associated with this hash value.
+ *      Take the next step of a lookup, prefetching what the step after
+ *      it reads. Chained maps step once per entry of the bucket; the
+ *      other engines and move-to-front maps search their prefetched
+ *      slots or bucket in one step.
+ *      Returns HMAP_BOOL_TRUE when the lookup is done, with its entry
+ *      set to the entry found or HMAP_INVALID_REF.
  *
  ************************************************************************/
-static hmap_entry_type ** get_bucket_by_hash
+static HMAP_bool_t8 step_lookup
     (
     hmap_map_type     * map,        /* hash map private data            */
-    HMAP_hash_val_type  key_hash    /* hash value of key                */
+    hmap_lookup_type  * lookup      /* lookup in flight                 */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
-unsigned int            index;
+hmap_entry_type       * entry;
 
-/*-------------------------------------------------------------
-Convert the key's hash to its bucket index.
--------------------------------------------------------------*/
-index = key_hash % map->buckets_len;
+switch( lookup->state )
+    {
+    case HMAP_LOOKUP_BUCKET:
+        /*-----------------------------------------------------
+        Read the head of the bucket.
+        -----------------------------------------------------*/
+        lookup->entry = link_to_ref( map, *get_bucket_by_hash( map, lookup->key_hash ) );
+        break;
+
+    case HMAP_LOOKUP_ENTRY:
+        /*-----------------------------------------------------
+        Compare the entry, moving on to the next one in the
+        bucket if it does not match.
+        -----------------------------------------------------*/
+        entry = ref_to_ptr( map, lookup->entry );
+        if( entry->key_hash == lookup->key_hash
+         && entry_key_match( map, entry, &lookup->key ) )
+            {
+            return( HMAP_BOOL_TRUE );
+            }
+        lookup->entry = link_to_ref( map, entry->next );
+        break;
+
+    default:
+        /*-----------------------------------------------------
+        Search the engine's slots.
+        -----------------------------------------------------*/
+        entry = lookup_entry( map, &lookup->key, lookup->key_hash );
+        if( entry != HMAP_INVALID_POINTER )
+            {
+            lookup->entry = ptr_to_ref( map, entry );
+            }
+        return( HMAP_BOOL_TRUE );
+    }
 
 /*-------------------------------------------------------------
-Return the bucket.
+The lookup is done at the end of the bucket. Otherwise start
+loading the entry compared in the next step.
 -------------------------------------------------------------*/
-return( &map->buckets[ index ] );
+if( lookup->entry == HMAP_INVALID_REF )
+    {
+    return( HMAP_BOOL_TRUE );
+    }
 
-}   /* get_bucket_by_hash() */
+__builtin_prefetch( ref_to_ptr( map, lookup->entry ) );
+lookup->state = HMAP_LOOKUP_ENTRY;
+
+return( HMAP_BOOL_FALSE );
+
+}   /* step_lookup() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      get_entry_by_hash
+ *      unlink_entry
  *
  *  Description:
- *      Get pointers to the entries associated with this hash. Returns
- *      the number of entries found to match the given hash and writes
- *      them to the entries array.
+ *      Take an entry out of the map's table before it is destroyed.
+ *      A dense map's index slot is left pointing at the removed
+ *      record, so probes pass over it until the array is resized.
+ *      Chained map entries are unlinked by remove_entry, through the
+ *      link it finds them by.
  *
  ************************************************************************/
-static unsigned int get_entry_by_hash
+static void unlink_entry
     (
     hmap_map_type     * map,        /* hash map private data            */
-    HMAP_hash_val_type  key_hash,   /* hash map entry key               */
-    hmap_entry_type  ** entries,    /* out: array of entry ptrs for hash*/
-    unsigned int        entries_len /* capacity of entries array        */
+    hmap_entry_type   * entry       /* entry to remove                  */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
-hmap_entry_type      ** bucket;
-hmap_entry_type       * entry;
+unsigned int            bucket_index;
+hmap_cuckoo_bucket_type
+                      * cuckoo_bucket;
+unsigned int            probe;
+unsigned int            slot;
+hmap_hopscotch_slot_type
+                      * slots;
+unsigned char           tag;
 
 /*-------------------------------------------------------------
-Get the bucket containing the key's hash.
+Dense map records are marked removed when they are freed, and
+chained map entries are unlinked as they are found.
 -------------------------------------------------------------*/
-bucket = get_bucket_by_hash( map, key_hash );
+if( map->table->engine == HMAP_ENGINE_DENSE
+ || map->table->engine == HMAP_ENGINE_CHAINED )
+    {
+    return;
+    }
 
 /*-------------------------------------------------------------
-Find all entries matching the hash.
+Clear the entry's slot in one of its two cuckoo buckets.
 -------------------------------------------------------------*/
-entries_len = 0;
-entry = *bucket;
-while( entry != HMAP_INVALID_POINTER )
+if( map->table->engine == HMAP_ENGINE_CUCKOO )
     {
-    if( entry->key_hash == key_hash )
+    tag = get_cuckoo_tag( entry->key_hash );
+    bucket_index = entry->key_hash & ( map->table->buckets_len - 1 );
+    for( probe = 0; probe < 2; probe++ )
         {
-        entries[ entries_len++ ] = entry;
+        cuckoo_bucket = (hmap_cuckoo_bucket_type *)ref_to_ptr( map, map->table->buckets ) + bucket_index;
+        for( slot = 0; slot < HMAP_CUCKOO_WAYS; slot++ )
+            {
+            if( cuckoo_bucket->entries[ slot ] == ptr_to_ref( map, entry ) )
+                {
+                cuckoo_bucket->tags[ slot ] = 0;
+                cuckoo_bucket->entries[ slot ] = HMAP_INVALID_REF;
+                return;
+                }
+            }
+        bucket_index = get_cuckoo_bucket( map->table->buckets_len, bucket_index, tag );
         }
-    entry = entry->next;
+    return;
     }
 
 /*-------------------------------------------------------------
-Return the number of matching entries found.
+Clear the entry's slot in its hopscotch neighborhood.
 -------------------------------------------------------------*/
-return( entries_len );
+if( map->table->engine == HMAP_ENGINE_HOPSCOTCH )
+    {
+    slots = ref_to_ptr( map, map->table->buckets );
+    bucket_index = get_hopscotch_home( entry->key_hash, map->table->buckets_len );
+    for( slot = 0; slot < HMAP_HOPSCOTCH_RANGE; slot++ )
+        {
+        if( slots[ ( bucket_index + slot ) & ( map->table->buckets_len - 1 ) ].entry == ptr_to_ref( map, entry ) )
+            {
+            slots[ ( bucket_index + slot ) & ( map->table->buckets_len - 1 ) ].entry = HMAP_INVALID_REF;
+            slots[ bucket_index ].hop &= ~( 1u << slot );
+            return;
+            }
+        }
+    }
 
-}   /* get_entry_by_hash() */
+}   /* unlink_entry() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      get_entry_by_key
+ *      unlock_map
  *
  *  Description:
- *      Get a pointer to the entry associated with this key. Returns
- *      HMAP_INVALID_POINTER if the key does not exist in the hash map.
+ *      Release a lock taken with lock_map.
  *
  ************************************************************************/
-static hmap_entry_type * get_entry_by_key
+static void unlock_map
     (
     hmap_map_type     * map,        /* hash map private data            */
-    HMAP_anon_type    
-                const * key         /* hash map entry key               */
+    HMAP_bool_t8        write       /* lock was taken for writing       */
     )
 {
 /*-------------------------------------------------------------
-Local preprocessor definitions
--------------------------------------------------------------*/
-#define MAX_COLLISIONS  ( 5 )
-
-/*-------------------------------------------------------------
-Local variables
--------------------------------------------------------------*/
-hmap_entry_type       * entries[ MAX_COLLISIONS ];
-unsigned int            entries_count;
-hmap_entry_type       * entry;
-HMAP_anon_type        * entry_key;
-unsigned int            i;
-unsigned int            key_hash;
-
-/*-------------------------------------------------------------
-Calculate the key's hash and get the matching entries.
--------------------------------------------------------------*/
-key_hash = map->hash( key );
-entries_count = get_entry_by_hash( map, key_hash, entries, MAX_COLLISIONS );
-
-/*-------------------------------------------------------------
-Find the matching entry.
+Only shared maps are locked.
 -------------------------------------------------------------*/
-entry = HMAP_INVALID_POINTER;
-for( i = 0; i < entries_count; i++ )
+if( map->region == HMAP_INVALID_POINTER )
     {
-    entry_key = &entries[ i ]->key;
-    if( anon_data_match( entry_key, key ) )
-        {
-        entry = entries[ i ];
-        break;
-        }
+    return;
     }
-    
-/*-------------------------------------------------------------
-Returns an invalid pointer if no entry was found.
--------------------------------------------------------------*/
-return( entry );
 
 /*-------------------------------------------------------------
-Clean up local preprocessor definitions.
+Release the writer bit or remove this reader. A writer clears
+the pending bit as well; writers still waiting set it again.
 -------------------------------------------------------------*/
-#undef MAX_COLLISIONS
+if( write )
+    {
+    __atomic_store_n( &map->region->lock, 0, __ATOMIC_RELEASE );
+    }
+else
+    {
+    __atomic_fetch_sub( &map->region->lock, 1, __ATOMIC_RELEASE );
+    }
 
-}   /* get_entry_by_key() */
+}   /* unlock_map() */
 
 
 /*************************************************************************
  *
  *  Procedure:
- *      hash_sdbm
+ *      wait_snapshot_wave
  *
  *  Description:
- *      The default hash function implements the SDBM algorithm
+ *      Wait for the reads started by read_snapshot_wave. Every read is
+ *      waited for, even after one fails, so none is left writing to
+ *      the wave's buffers.
  *
  ************************************************************************/
-static HMAP_hash_val_type hash_sdbm
+static HMAP_status_t8 wait_snapshot_wave
     (
-    const HMAP_anon_type
-                      * key         /* hash map entry key               */
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot being read              */
+    hmap_snapshot_wave_type
+                      * wave,       /* wave of blocks being read        */
+    unsigned int        first_tag   /* tag of the wave's first read     */
     )
 {
 /*-------------------------------------------------------------
 Local variables
 -------------------------------------------------------------*/
-HMAP_hash_val_type      hash;
 unsigned int            i;
-unsigned char         * key_bytes;
+HMAP_status_t8          status;
 
 /*-------------------------------------------------------------
-Initalize variables
+Nothing to wait for without reads in flight.
 -------------------------------------------------------------*/
-hash = 0;
-key_bytes = (unsigned char *)( key->ptr );
+status = HMAP_STATUS_SUCCESS;
+if( !wave->reading )
+    {
+    return( status );
+    }
 
-/*-------------------------------------------------------------
-Hash the key
--------------------------------------------------------------*/
-for( i = 0; i < key->size; i++ )
+for( i = 0; i < wave->count; i++ )
     {
-    /*---------------------------------------------------------
-    hash = ( hash * 65599 ) + byte
-    ---------------------------------------------------------*/
-    hash = (hash << 16) + (hash << 6) - hash + key_bytes[ i ];
+    if( !snapshot->wait( snapshot->context, first_tag + i ) )
+        {
+        status = HMAP_STATUS_IO_ERROR;
+        }
     }
 
-return( hash );
+wave->reading = HMAP_BOOL_FALSE;
+return( status );
 
-}   /* hash_sdbm() */
+}   /* wait_snapshot_wave() */
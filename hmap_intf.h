@@ -48,6 +48,12 @@ enum
     HMAP_STATUS_INVALID_DEF,
     HMAP_STATUS_KEY_NOT_IN_MAP,
     HMAP_STATUS_MAP_UNINITIALIZED,
+    HMAP_STATUS_OUT_OF_MEMORY,
+    HMAP_STATUS_IO_ERROR,
+    HMAP_STATUS_CORRUPT_DATA,
+    HMAP_STATUS_BUSY,
+    HMAP_STATUS_CANCELED,
+    HMAP_STATUS_TOO_MANY_COLLISIONS,
 
     HMAP_STATUS_COUNT
     };
@@ -69,6 +75,57 @@ enum
     HMAP_HASH_FUNC_COUNT
     };
 
+/*-------------------------------------------------------------
+How keys are stored. HMAP_KEY_MODE_PREFIX is for hierarchical
+string keys such as "tenant/region/service/metric": the part
+of each key up to its last separator is stored once in a
+table of shared prefixes, and the entry only stores the rest.
+-------------------------------------------------------------*/
+typedef unsigned char HMAP_key_mode_t8;
+enum
+    {
+    HMAP_KEY_MODE_BYTES,
+    HMAP_KEY_MODE_PREFIX,
+
+    HMAP_KEY_MODE_COUNT
+    };
+
+/*-------------------------------------------------------------
+How the map's table is laid out. HMAP_ENGINE_CHAINED keeps a
+fixed array of map_size buckets, each a linked list of
+separately allocated entries. HMAP_ENGINE_DENSE keeps the
+entries in one append-only array, found through a table of
+8, 16 or 32 bit indices sized to the number of entries; it
+grows as needed and iterates in insertion order.
+HMAP_ENGINE_CUCKOO places each entry in one of two 4-slot
+buckets, so a lookup reads at most two buckets however full
+the map is; inserts may move other entries, and the table
+doubles when no room can be made. It starts with map_size
+slots, rounded up to a power of two. HMAP_ENGINE_HOPSCOTCH
+keeps each entry within 32 slots of its home slot and flags
+it in a bitmap in the home slot, so a lookup only reads the
+flagged slots of one run of consecutive slots, usually one or
+two cache lines. It also starts with map_size slots and
+doubles when an entry can not be moved close enough.
+
+As growing does not separate keys with the same hash, a cuckoo
+map holds at most 8 entries with any one hash and a hopscotch
+map at most 32. Adding another fails with
+HMAP_STATUS_TOO_MANY_COLLISIONS, as does an insert that still
+finds no room after the table has doubled a few times; use a
+hash that spreads the keys, or a chained or dense map.
+-------------------------------------------------------------*/
+typedef unsigned char HMAP_engine_t8;
+enum
+    {
+    HMAP_ENGINE_CHAINED,
+    HMAP_ENGINE_DENSE,
+    HMAP_ENGINE_CUCKOO,
+    HMAP_ENGINE_HOPSCOTCH,
+
+    HMAP_ENGINE_COUNT
+    };
+
 /*-------------------------------------------------------------
 Anonymous data type.
 -------------------------------------------------------------*/
@@ -90,6 +147,19 @@ typedef HMAP_hash_val_type HMAP_hash_func_type
 
 typedef HMAP_hash_func_type * HMAP_hash_fptr_type;
 
+/*-------------------------------------------------------------
+Function comparing two keys for a custom hash. Returns
+HMAP_BOOL_TRUE if the keys are equal. Keys that are equal shall
+have the same hash.
+-------------------------------------------------------------*/
+typedef HMAP_bool_t8 HMAP_equal_func
+    (
+    const HMAP_anon_type  * key_1,  /* key to compare        */
+    const HMAP_anon_type  * key_2   /* key to compare        */
+    );
+
+typedef HMAP_equal_func * HMAP_equal_fptr;
+
 /*-------------------------------------------------------------
 Function for allocating memory.
 -------------------------------------------------------------*/
@@ -110,8 +180,302 @@ typedef void HMAP_free_func
 
 typedef HMAP_free_func * HMAP_free_fptr;
 
+/*-------------------------------------------------------------
+Function for getting the number of bytes the allocator set
+aside for a block (e.g. malloc_usable_size).
+-------------------------------------------------------------*/
+typedef unsigned long long HMAP_usable_size_func
+    (
+    void              * memory      /* allocated memory block*/
+    );
+
+typedef HMAP_usable_size_func * HMAP_usable_size_fptr;
+
+/*-------------------------------------------------------------
+Function for appending bytes to a stream, such as a log file.
+Returns HMAP_BOOL_TRUE if all bytes were written.
+-------------------------------------------------------------*/
+typedef HMAP_bool_t8 HMAP_write_func
+    (
+    void              * context,    /* caller's stream       */
+    const void        * buffer,     /* bytes to write        */
+    unsigned int        size        /* num bytes to write    */
+    );
+
+typedef HMAP_write_func * HMAP_write_fptr;
+
+/*-------------------------------------------------------------
+Function for making previously written bytes durable (e.g.
+fsync or fdatasync). Returns HMAP_BOOL_TRUE on success.
+-------------------------------------------------------------*/
+typedef HMAP_bool_t8 HMAP_sync_func
+    (
+    void              * context     /* caller's stream       */
+    );
+
+typedef HMAP_sync_func * HMAP_sync_fptr;
+
+/*-------------------------------------------------------------
+Function for reading bytes from a stream at an offset (e.g.
+pread). Returns HMAP_BOOL_FALSE on error. Fewer bytes than
+requested are only returned at the end of the stream.
+-------------------------------------------------------------*/
+typedef HMAP_bool_t8 HMAP_read_func
+    (
+    void              * context,    /* caller's stream       */
+    unsigned long long  offset,     /* stream offset         */
+    void              * buffer,     /* out: bytes read       */
+    unsigned int        size,       /* num bytes to read     */
+    unsigned int      * read_size   /* out: num bytes read   */
+    );
+
+typedef HMAP_read_func * HMAP_read_fptr;
+
+/*-------------------------------------------------------------
+Functions reading a stream with several reads in flight (e.g.
+with io_uring, or a pool of threads calling pread). submit
+starts reading size bytes at an offset into buffer and returns
+without waiting. wait waits for the read with the given tag,
+which is unique among the reads in flight. Both return
+HMAP_BOOL_FALSE on error, and wait also if the read came up
+short.
+-------------------------------------------------------------*/
+typedef HMAP_bool_t8 HMAP_submit_func
+    (
+    void              * context,    /* caller's stream       */
+    unsigned long long  offset,     /* stream offset         */
+    void              * buffer,     /* out: bytes read       */
+    unsigned int        size,       /* num bytes to read     */
+    unsigned int        tag         /* identifies the read   */
+    );
+
+typedef HMAP_submit_func * HMAP_submit_fptr;
+
+typedef HMAP_bool_t8 HMAP_wait_func
+    (
+    void              * context,    /* caller's stream       */
+    unsigned int        tag         /* read to wait for      */
+    );
+
+typedef HMAP_wait_func * HMAP_wait_fptr;
+
+/*-------------------------------------------------------------
+A task of a parallel job. Called once for each index in the
+job, possibly from several threads at once.
+-------------------------------------------------------------*/
+typedef void HMAP_task_func
+    (
+    void              * argument,   /* job argument          */
+    unsigned int        index       /* index of task in job  */
+    );
+
+typedef HMAP_task_func * HMAP_task_fptr;
+
+/*-------------------------------------------------------------
+Function for running a parallel job, e.g. on a thread pool.
+Runs task for every index below task_count and returns when
+all tasks have completed.
+-------------------------------------------------------------*/
+typedef void HMAP_parallel_func
+    (
+    void              * context,    /* caller's thread pool  */
+    HMAP_task_fptr      task,       /* task to run           */
+    void              * argument,   /* argument to task      */
+    unsigned int        task_count  /* num tasks to run      */
+    );
+
+typedef HMAP_parallel_func * HMAP_parallel_fptr;
+
+/*-------------------------------------------------------------
+Function visiting a map entry. Returns HMAP_BOOL_FALSE to stop
+the visit. The map must not be changed during the visit.
+-------------------------------------------------------------*/
+typedef HMAP_bool_t8 HMAP_visit_func
+    (
+    void              * context,    /* caller's context      */
+    HMAP_anon_type
+                const * key,        /* entry key             */
+    HMAP_anon_type
+                const * data        /* entry data            */
+    );
+
+typedef HMAP_visit_func * HMAP_visit_fptr;
+
+/*-------------------------------------------------------------
+Function supplying the keys of HMAP_get_data_stream. Returns
+HMAP_BOOL_FALSE when there are no more keys. A key's bytes must
+stay valid until its result has been visited.
+-------------------------------------------------------------*/
+typedef HMAP_bool_t8 HMAP_key_source_func
+    (
+    void              * context,    /* caller's context      */
+    HMAP_anon_type    * key         /* out: next key         */
+    );
+
+typedef HMAP_key_source_func * HMAP_key_source_fptr;
+
+/*-------------------------------------------------------------
+When the mutation log is synced to durable storage. Mutations
+are buffered and written as a group; a group is written and
+synced when group_size mutations have been buffered
+(HMAP_LOG_SYNC_GROUP), after every mutation
+(HMAP_LOG_SYNC_EVERY), or only when HMAP_log_commit is called
+(HMAP_LOG_SYNC_COMMIT). A full buffer is always written.
+-------------------------------------------------------------*/
+typedef unsigned char HMAP_log_sync_t8;
+enum
+    {
+    HMAP_LOG_SYNC_GROUP,
+    HMAP_LOG_SYNC_EVERY,
+    HMAP_LOG_SYNC_COMMIT,
+
+    HMAP_LOG_SYNC_COUNT
+    };
+
+/*-------------------------------------------------------------
+Mutation log definition. Each HMAP_set_data and effective
+HMAP_remove_entry is appended to the log as a compact redo
+record, which HMAP_replay applies to rebuild the map. After a
+write or sync fails, mutations still change the map but are no
+longer logged, and they and HMAP_log_commit return
+HMAP_STATUS_IO_ERROR.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    void              * context;    /* passed to write/sync  */
+    HMAP_write_fptr     write;      /* append to the log     */
+    HMAP_sync_fptr      sync;       /* sync log, or NULL     */
+    unsigned int        buffer_size;/* 0 for default size    */
+    unsigned int        group_size; /* mutations per group   */
+    HMAP_log_sync_t8    sync_policy;/* when to sync the log  */
+    } HMAP_log_def_type;
+
+/*-------------------------------------------------------------
+Function told the result of a save started by HMAP_save_async.
+-------------------------------------------------------------*/
+typedef void HMAP_done_func
+    (
+    void              * context,    /* caller's context      */
+    HMAP_status_t8      status      /* result of the save    */
+    );
+
+typedef HMAP_done_func * HMAP_done_fptr;
+
+/*-------------------------------------------------------------
+Snapshot definition. A snapshot is written as independently
+compressed blocks of entries followed by a block index, so
+blocks can be compressed and decompressed in parallel when a
+parallel hook is provided. Saving uses write, loading uses
+read and the size of the snapshot. When submit and wait are
+also given, loading reads the next group of blocks while the
+current one is decompressed and inserted. A save started with
+HMAP_save_async reports its result to done; the definition
+must stay valid until then.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    void              * context;    /* caller's stream       */
+    HMAP_write_fptr     write;      /* snapshot writer       */
+    HMAP_read_fptr      read;       /* snapshot reader       */
+    HMAP_submit_fptr    submit;     /* start a read, or NULL */
+    HMAP_wait_fptr      wait;       /* wait for a read       */
+    unsigned long long  size;       /* snapshot size (load)  */
+    unsigned int        block_size; /* 0 for default size    */
+    HMAP_parallel_fptr  parallel;   /* job runner, or NULL   */
+    void              * parallel_context;
+                                    /* passed to parallel    */
+    HMAP_done_fptr      done;       /* async result, or NULL */
+    } HMAP_snapshot_def_type;
+
+/*-------------------------------------------------------------
+Spill file definition. A map with a spill file keeps its
+entries and keys in memory, but once more than memory_limit
+bytes of data are held it appends the data of cold entries to
+the file and frees it. Entries not read since a clock hand last
+passed them are the first spilled. Spilled data is read back
+transparently, and HMAP_spill_compact moves the live data to a
+new file to reclaim the space of data since changed or removed.
+Only data larger than a reference is spilled.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    void              * context;    /* caller's spill file   */
+    HMAP_write_fptr     write;      /* append to the file    */
+    HMAP_read_fptr      read;       /* read from the file    */
+    unsigned long long  memory_limit;
+                                    /* data bytes in memory  */
+    } HMAP_spill_def_type;
+
+/*-------------------------------------------------------------
+Memory used by a map, as reported by HMAP_get_memory_usage.
+Overhead is the rest of the map's memory: its private data,
+insertion order and prefix tables, and unused capacity.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    unsigned long long  buckets;    /* bucket or slot arrays */
+    unsigned long long  entries;    /* entry records         */
+    unsigned long long  keys;       /* key blocks, prefixes  */
+    unsigned long long  values;     /* data blocks in memory */
+    unsigned long long  overhead;   /* everything else       */
+    unsigned long long  total;      /* sum of the above      */
+    } HMAP_memory_usage_type;
+
 /*-------------------------------------------------------------
 Hash map definition.
+
+With a custom hash, equal may replace the byte-for-byte
+comparison of keys, so keys such as case-insensitive strings
+need not be canonicalized first. Prefix mode maps compare parts
+of keys and can not use it. Interning tables use it to compare
+strings.
+
+If region is provided, the entire map (buckets, entries, keys
+and data) is placed in that memory block instead of being
+allocated with malloc. The region may be shared between
+processes (e.g. shm_open or memfd and mmap), as the map only
+stores offsets within it. One process creates the map with
+HMAP_create, the others use HMAP_attach. Access to a shared
+map is serialized by a process-shared lock in the region.
+
+A multimap keeps a list of values for each key, maintained
+with HMAP_add_value and HMAP_remove_value and read with
+HMAP_get_values, in place of the single data block handled by
+HMAP_set_data and HMAP_get_data. Multimaps can not be logged.
+
+An ordered map also keeps its entries in a dense array in the
+order they were added, so HMAP_for_each and snapshots visit
+them in that order. Dense engine maps are always in insertion
+order and ignore ordered.
+
+Heap maps other than multimaps may spill cold data to a file
+when spill is provided.
+
+With a segment_size, heap maps other than multimaps append
+their data to segments of that many bytes instead of
+allocating each block separately, so changing data does not
+fragment the heap. HMAP_compact_values moves the live data out
+of sparse segments and frees them.
+
+If usable_size is provided, HMAP_get_memory_usage reports the
+bytes the allocator set aside for each block rather than the
+bytes requested. Shared maps report their region's blocks.
+
+If size_limit is not 0, adding an entry or growing its data
+fails with HMAP_STATUS_OUT_OF_MEMORY rather than take the map
+over size_limit bytes, counted as HMAP_get_size counts them.
+Growing the map's tables counts against the limit too, and an
+insert that needs a table to grow past it fails. Maps with a
+spill file spill cold data to make room first, and spilled
+data does not count against the limit.
+
+A chained map with move_to_front moves keys found deep in a
+bucket to its head every few lookups, so hot keys are found
+sooner. HMAP_get_hit_depth reports how deep lookups go. Only
+reads count and move keys: HMAP_get_data, its batch and stream
+forms, HMAP_get_values and HMAP_key_in_map. Such a map must
+not be read during HMAP_for_each and can not be shared. Other
+engines ignore move_to_front.
 -------------------------------------------------------------*/
 typedef struct
     {
@@ -120,6 +484,25 @@ typedef struct
     HMAP_hash_fptr_type hash;       /* custom hash function  */
     HMAP_malloc_fptr    malloc;     /* memory allocator      */
     HMAP_free_fptr      free;       /* memory deallocator    */
+    void              * region;     /* shared region, or NULL*/
+    unsigned long long  region_size;/* region size in bytes  */
+    HMAP_log_def_type * log;        /* mutation log, or NULL */
+    HMAP_key_mode_t8    key_mode;   /* how keys are stored   */
+    unsigned char       key_separator;
+                                    /* prefix end, 0 for '/' */
+    HMAP_bool_t8        multimap;   /* keys have value lists */
+    HMAP_bool_t8        ordered;    /* keep insertion order  */
+    HMAP_engine_t8      engine;     /* table layout          */
+    HMAP_spill_def_type
+                      * spill;      /* spill file, or NULL   */
+    unsigned int        segment_size;
+                                    /* 0 for no segments     */
+    HMAP_usable_size_fptr
+                        usable_size;/* block size, or NULL   */
+    unsigned long long  size_limit; /* bytes, 0 for no limit */
+    HMAP_bool_t8        move_to_front;
+                                    /* move hits to the head */
+    HMAP_equal_fptr     equal;      /* custom key equality   */
     } HMAP_def_type;
 
 /*-------------------------------------------------------------
@@ -130,6 +513,33 @@ typedef struct
     void              * data;
     } HMAP_obj_type;
 
+/*-------------------------------------------------------------
+Iterator over the values of a multimap key. The values are
+read in place and stay valid until the map is next changed.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    unsigned char const
+                      * next;       /* next packed value     */
+    unsigned char const
+                      * end;        /* end of packed values  */
+    unsigned int        count;      /* num values of key     */
+    } HMAP_values_type;
+
+/*-------------------------------------------------------------
+Interned strings are identified by dense IDs, starting at 0 in
+the order the strings were first interned.
+-------------------------------------------------------------*/
+typedef unsigned int HMAP_intern_id_type;
+
+/*-------------------------------------------------------------
+The public string interning table object.
+-------------------------------------------------------------*/
+typedef struct
+    {
+    void              * data;
+    } HMAP_intern_obj_type;
+
 
 /*--------------------------------------------------------------------------------
                                  MEMORY CONSTANTS
@@ -145,6 +555,28 @@ typedef struct
                                     PROCEDURES
 --------------------------------------------------------------------------------*/
 
+HMAP_status_t8 HMAP_add_value
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_anon_type
+                const * value       /* value to append                  */
+    );
+
+HMAP_status_t8 HMAP_attach
+    (
+    HMAP_def_type     * hmap_def,   /* definition with shared region    */
+    HMAP_obj_type     * out_obj     /* out: hash map object             */
+    );
+
+HMAP_status_t8 HMAP_compact_values
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned int        budget,     /* num entries to scan              */
+    HMAP_bool_t8      * done        /* out: no sparse segments are left */
+    );
+
 HMAP_status_t8 HMAP_create
     (
     HMAP_def_type     * hmap_def,   /* hash map definition              */
@@ -157,6 +589,13 @@ HMAP_status_t8 HMAP_destroy
     HMAP_obj_type     * obj         /* hash map object                  */
     );
 
+HMAP_status_t8 HMAP_for_each
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_visit_fptr     visit,      /* function to visit entries        */
+    void              * context     /* passed to visit                  */
+    );
+
 HMAP_status_t8 HMAP_get_data
     (
     HMAP_obj_type     * obj,        /* hash map object                  */
@@ -165,6 +604,25 @@ HMAP_status_t8 HMAP_get_data
     HMAP_anon_type    * data        /* out: entry data                  */
     );
 
+HMAP_status_t8 HMAP_get_data_batch
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_anon_type
+                const * keys,       /* hash map entry keys              */
+    unsigned int        count,      /* num keys                         */
+    HMAP_anon_type    * data,       /* out: entry data per key          */
+    HMAP_status_t8    * statuses    /* out: status per key              */
+    );
+
+HMAP_status_t8 HMAP_get_data_stream
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_key_source_fptr
+                        next_key,   /* function supplying keys          */
+    HMAP_visit_fptr     visit,      /* function to visit results        */
+    void              * context     /* passed to next_key and visit     */
+    );
+
 HMAP_status_t8 HMAP_get_entry_count
     (
     HMAP_obj_type     * obj,        /* hash map object                  */
@@ -179,12 +637,87 @@ HMAP_status_t8 HMAP_get_hash
     HMAP_hash_val_type* hash        /* out: hash value of data          */
     );
 
+HMAP_status_t8 HMAP_get_hit_depth
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned long long* hits,       /* out: num lookups that hit        */
+    unsigned long long* depth       /* out: links followed to the hits  */
+    );
+
+HMAP_status_t8 HMAP_get_memory_usage
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_memory_usage_type
+                      * usage       /* out: memory used by the map      */
+    );
+
+HMAP_status_t8 HMAP_get_segment_size
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned long long* segment_size,/* out: bytes of value segments    */
+    unsigned long long* live_size   /* out: bytes of live data in them  */
+    );
+
 HMAP_status_t8 HMAP_get_size
     (
     HMAP_obj_type     * obj,        /* hash map object                  */
     unsigned int      * size        /* out: total size of map (bytes)   */
     );
 
+HMAP_status_t8 HMAP_get_spill_size
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned long long* file_size,  /* out: bytes written to spill files*/
+    unsigned long long* live_size   /* out: spilled bytes still in use  */
+    );
+
+HMAP_status_t8 HMAP_get_values
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_values_type  * values      /* out: iterator over values        */
+    );
+
+HMAP_status_t8 HMAP_intern
+    (
+    HMAP_intern_obj_type
+                      * obj,        /* interning table object           */
+    HMAP_anon_type
+                const * string,     /* string to intern                 */
+    HMAP_intern_id_type
+                      * id,         /* out: ID of string                */
+    HMAP_anon_type    * interned    /* out: interned string, or NULL    */
+    );
+
+HMAP_status_t8 HMAP_intern_create
+    (
+    HMAP_def_type     * hmap_def,   /* table definition                 */
+    HMAP_intern_obj_type
+                      * out_obj     /* out: interning table object      */
+    );
+
+HMAP_status_t8 HMAP_intern_destroy
+    (
+    HMAP_intern_obj_type
+                      * obj         /* interning table object           */
+    );
+
+HMAP_status_t8 HMAP_intern_get_count
+    (
+    HMAP_intern_obj_type
+                      * obj,        /* interning table object           */
+    unsigned int      * count       /* out: number of interned strings  */
+    );
+
+HMAP_status_t8 HMAP_intern_get_string
+    (
+    HMAP_intern_obj_type
+                      * obj,        /* interning table object           */
+    HMAP_intern_id_type id,         /* ID of string                     */
+    HMAP_anon_type    * string      /* out: interned string             */
+    );
+
 HMAP_bool_t8 HMAP_key_in_map
     (
     HMAP_obj_type     * obj,        /* hash map object                  */
@@ -192,6 +725,25 @@ HMAP_bool_t8 HMAP_key_in_map
                       * key         /* hash map entry key               */
     );
 
+HMAP_status_t8 HMAP_load
+    (
+    HMAP_def_type     * hmap_def,   /* hash map definition              */
+    HMAP_snapshot_def_type
+                      * snapshot,   /* snapshot to load                 */
+    HMAP_obj_type     * out_obj     /* out: hash map object             */
+    );
+
+HMAP_status_t8 HMAP_log_commit
+    (
+    HMAP_obj_type     * obj         /* hash map object                  */
+    );
+
+HMAP_bool_t8 HMAP_next_value
+    (
+    HMAP_values_type  * values,     /* iterator over values             */
+    HMAP_anon_type    * value       /* out: next value                  */
+    );
+
 HMAP_status_t8 HMAP_remove_entry
     (
     HMAP_obj_type     * obj,        /* hash map object                  */
@@ -199,6 +751,44 @@ HMAP_status_t8 HMAP_remove_entry
                       * key         /* hashmap entry key                */
     );
 
+HMAP_status_t8 HMAP_remove_value
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_anon_type
+                const * key,        /* hash map entry key               */
+    HMAP_anon_type
+                const * value       /* value to remove                  */
+    );
+
+HMAP_status_t8 HMAP_replay
+    (
+    HMAP_def_type     * hmap_def,   /* hash map definition              */
+    void              * context,    /* caller's log stream              */
+    HMAP_read_fptr      read,       /* log reader                       */
+    HMAP_obj_type     * out_obj,    /* out: hash map object             */
+    unsigned long long* log_size    /* out: size of valid log, or NULL  */
+    );
+
+HMAP_status_t8 HMAP_save
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_snapshot_def_type
+                      * snapshot    /* snapshot to write                */
+    );
+
+HMAP_status_t8 HMAP_save_async
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_snapshot_def_type
+                      * snapshot    /* snapshot to write                */
+    );
+
+HMAP_status_t8 HMAP_save_step
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned int        budget      /* num entries to scan              */
+    );
+
 HMAP_status_t8 HMAP_set_data
     (
     HMAP_obj_type     * obj,        /* hash map object                  */
@@ -208,5 +798,19 @@ HMAP_status_t8 HMAP_set_data
                       * data        /* entry data                       */
     );
 
+HMAP_status_t8 HMAP_spill_compact
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    HMAP_spill_def_type
+                      * spill       /* new spill file                   */
+    );
+
+HMAP_status_t8 HMAP_spill_compact_step
+    (
+    HMAP_obj_type     * obj,        /* hash map object                  */
+    unsigned int        budget,     /* num entries to scan              */
+    HMAP_bool_t8      * done        /* out: old spill file is unused    */
+    );
+
 
 #endif /* HMAP_INTF_H_GUARD */